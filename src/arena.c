@@ -0,0 +1,99 @@
+/*!
+ *  @file smake/src/arena.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Block arena for project file records and strings.
+ */
+
+#include "arena.h"
+
+#define SMAKE_ARENA_ALIGN(size) (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+static smake_arena_block_t* SMake_ArenaBlockNew(size_t nSize)
+{
+    size_t nHeader = SMAKE_ARENA_ALIGN(sizeof(smake_arena_block_t));
+    uint8_t *pMemory = (uint8_t*)malloc(nHeader + nSize);
+    XASSERT(pMemory, NULL);
+
+    smake_arena_block_t *pBlock = (smake_arena_block_t*)pMemory;
+    pBlock->pData = pMemory + nHeader;
+    pBlock->pNext = NULL;
+    pBlock->nSize = nSize;
+    pBlock->nUsed = 0;
+    return pBlock;
+}
+
+void SMake_ArenaInit(smake_arena_t *pArena)
+{
+    pArena->pBlocks = NULL;
+    pArena->nTotal = 0;
+}
+
+void SMake_ArenaDestroy(smake_arena_t *pArena)
+{
+    smake_arena_block_t *pBlock = pArena->pBlocks;
+    while (pBlock != NULL)
+    {
+        smake_arena_block_t *pNext = pBlock->pNext;
+        free(pBlock);
+        pBlock = pNext;
+    }
+
+    pArena->pBlocks = NULL;
+    pArena->nTotal = 0;
+}
+
+void* SMake_ArenaAlloc(smake_arena_t *pArena, size_t nSize)
+{
+    nSize = SMAKE_ARENA_ALIGN(nSize);
+    smake_arena_block_t *pBlock = pArena->pBlocks;
+
+    if (pBlock == NULL || pBlock->nUsed + nSize > pBlock->nSize)
+    {
+        /* Oversized requests get a dedicated block behind the current one */
+        if (nSize > SMAKE_ARENA_BLOCK / 4 && pBlock != NULL)
+        {
+            smake_arena_block_t *pLarge = SMake_ArenaBlockNew(nSize);
+            if (pLarge == NULL)
+            {
+                xloge("Failed to allocate arena block: %s", XSTRERR);
+                return NULL;
+            }
+
+            pLarge->pNext = pBlock->pNext;
+            pBlock->pNext = pLarge;
+            pLarge->nUsed = nSize;
+            pArena->nTotal += nSize;
+            return pLarge->pData;
+        }
+
+        size_t nBlockSize = nSize > SMAKE_ARENA_BLOCK ? nSize : SMAKE_ARENA_BLOCK;
+        pBlock = SMake_ArenaBlockNew(nBlockSize);
+
+        if (pBlock == NULL)
+        {
+            xloge("Failed to allocate arena block: %s", XSTRERR);
+            return NULL;
+        }
+
+        pBlock->pNext = pArena->pBlocks;
+        pArena->pBlocks = pBlock;
+    }
+
+    void *pData = pBlock->pData + pBlock->nUsed;
+    pBlock->nUsed += nSize;
+    pArena->nTotal += nSize;
+    return pData;
+}
+
+char* SMake_ArenaStrdup(smake_arena_t *pArena, const char *pStr, size_t nLength)
+{
+    char *pDst = (char*)SMake_ArenaAlloc(pArena, nLength + 1);
+    XASSERT(pDst, NULL);
+
+    memcpy(pDst, pStr, nLength);
+    pDst[nLength] = XSTR_NUL;
+    return pDst;
+}
@@ -0,0 +1,43 @@
+/*!
+ *  @file smake/src/arena.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Block arena for project file records and strings.
+ */
+
+#ifndef __SMAKE_ARENA_H__
+#define __SMAKE_ARENA_H__
+
+#include "stdinc.h"
+
+#define SMAKE_ARENA_BLOCK   65536
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SMakeArenaBlock {
+    struct SMakeArenaBlock *pNext;
+    size_t nUsed;
+    size_t nSize;
+    uint8_t *pData;
+} smake_arena_block_t;
+
+typedef struct SMakeArena {
+    smake_arena_block_t *pBlocks;
+    size_t nTotal;
+} smake_arena_t;
+
+void SMake_ArenaInit(smake_arena_t *pArena);
+void SMake_ArenaDestroy(smake_arena_t *pArena);
+
+void* SMake_ArenaAlloc(smake_arena_t *pArena, size_t nSize);
+char* SMake_ArenaStrdup(smake_arena_t *pArena, const char *pStr, size_t nLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_ARENA_H__ */
@@ -0,0 +1,630 @@
+/*!
+ *  @file smake/src/cache.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Persistent cache of directory listings and source info.
+ *
+ * The cache is a plain text manifest written next to the Makefile:
+ *
+ *   SMAKE-CACHE <version>
+ *   D <mtime sec> <mtime nsec> <inode> <directory path>
+ *   E <file type> <entry name>
+ *   S <size> <mtime sec> <mtime nsec> <has main> <pch> <source path>
+ *   I <include>
+ *
+ * "E" lines belong to the last "D" line. A directory whose mtime and inode
+ * did not change has the same entries, so the scanner can skip readdir().
+ * A source with the same size and mtime does not need to be read again.
+ * "I" lines are the prologue includes of the last "S" line, as they were
+ * counted for the precompiled header. Main and pch values are -1 when the
+ * source was not read for them, pch is 0 if the prologue defines macros.
+ * Like the index of git, entries modified shortly before the scan are not
+ * stored, a change in the same timestamp tick would keep the same mtime.
+ *
+ * Results of the library finder are kept in the user cache directory:
+ *
+ *   SMAKE-FIND <version>
+ *   F <search key>
+ *   R <path of the first match>
+ *   T <mtime sec> <mtime nsec> <directory path>
+ *
+ * "R" and "T" lines belong to the last "F" line, a search without "R" found
+ * nothing. The result is valid while every "T" directory has the same mtime.
+ * Directories are stamped before they are searched, recursive searches that
+ * found nothing are not cached, files can be added anywhere below the root.
+ */
+
+#include <time.h>
+#include "cache.h"
+#include "make.h"
+
+#define SMAKE_CACHE_MAP     1024
+
+void SMake_CacheInit(smake_cache_t *pCache)
+{
+    SMake_ArenaInit(&pCache->arena);
+    XArray_Init(&pCache->dirArr, NULL, XSTDNON, XFALSE);
+    XArray_Init(&pCache->srcArr, NULL, XSTDNON, XFALSE);
+    pCache->dirArr.clearCb = NULL;
+    pCache->srcArr.clearCb = NULL;
+    XMap_Init(&pCache->dirs, SMAKE_CACHE_MAP);
+    XMap_Init(&pCache->sources, SMAKE_CACHE_MAP);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    pCache->nRacySec = (int64_t)now.tv_sec - SMAKE_CACHE_GRANULARITY;
+    pCache->nRacyNsec = (long)now.tv_nsec;
+}
+
+void SMake_CacheDestroy(smake_cache_t *pCache)
+{
+    XMap_Destroy(&pCache->dirs);
+    XMap_Destroy(&pCache->sources);
+    XArray_Destroy(&pCache->dirArr);
+    XArray_Destroy(&pCache->srcArr);
+    SMake_ArenaDestroy(&pCache->arena);
+}
+
+static void SMake_CacheReset(smake_cache_t *pCache)
+{
+    SMake_CacheDestroy(pCache);
+    SMake_CacheInit(pCache);
+}
+
+static xbool_t SMake_CacheSameTime(const struct stat *pStat, int64_t nSec, long nNsec)
+{
+    return ((int64_t)pStat->st_mtim.tv_sec == nSec &&
+            (long)pStat->st_mtim.tv_nsec == nNsec) ? XTRUE : XFALSE;
+}
+
+static xbool_t SMake_CacheRacy(const smake_cache_t *pCache, const struct stat *pStat)
+{
+    int64_t nSec = (int64_t)pStat->st_mtim.tv_sec;
+    return (nSec > pCache->nRacySec || (nSec == pCache->nRacySec &&
+        (long)pStat->st_mtim.tv_nsec >= pCache->nRacyNsec)) ? XTRUE : XFALSE;
+}
+
+const smake_cache_dir_t* SMake_CacheGetDir(smake_cache_t *pCache, const char *pPath, const struct stat *pStat)
+{
+    smake_cache_dir_t *pDir = (smake_cache_dir_t*)XMap_Get(&pCache->dirs, pPath);
+    XASSERT(pDir, NULL);
+
+    if (pDir->nInode != (uint64_t)pStat->st_ino ||
+        !SMake_CacheSameTime(pStat, pDir->nSec, pDir->nNsec)) return NULL;
+
+    return pDir;
+}
+
+static smake_cache_dir_t* SMake_CacheNewDir(smake_cache_t *pCache, const char *pPath, size_t nLength)
+{
+    smake_cache_dir_t *pDir = (smake_cache_dir_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_cache_dir_t));
+    char *pCopy = SMake_ArenaStrdup(&pCache->arena, pPath, nLength);
+    XASSERT((pDir != NULL && pCopy != NULL), NULL);
+
+    pDir->pEntries = pDir->pLast = NULL;
+    pDir->pPath = pCopy;
+    pDir->nInode = 0;
+    pDir->nNsec = 0;
+    pDir->nSec = 0;
+
+    XMap_Put(&pCache->dirs, pDir->pPath, pDir);
+    XArray_AddData(&pCache->dirArr, pDir, XSTDNON);
+    return pDir;
+}
+
+smake_cache_dir_t* SMake_CacheAddDir(smake_cache_t *pCache, const char *pPath, const struct stat *pStat)
+{
+    /* Entries can not be stored if they would break the line format */
+    XASSERT((strchr(pPath, '\n') == NULL), NULL);
+    XASSERT(!SMake_CacheRacy(pCache, pStat), NULL);
+
+    smake_cache_dir_t *pDir = SMake_CacheNewDir(pCache, pPath, strlen(pPath));
+    XASSERT(pDir, NULL);
+
+    pDir->nInode = (uint64_t)pStat->st_ino;
+    pDir->nSec = (int64_t)pStat->st_mtim.tv_sec;
+    pDir->nNsec = (long)pStat->st_mtim.tv_nsec;
+    return pDir;
+}
+
+static xbool_t SMake_CacheAppend(smake_cache_t *pCache, smake_cache_dir_t *pDir, const char *pName, size_t nLength, int nType)
+{
+    smake_cache_entry_t *pEntry = (smake_cache_entry_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_cache_entry_t));
+    char *pCopy = SMake_ArenaStrdup(&pCache->arena, pName, nLength);
+    XASSERT((pEntry != NULL && pCopy != NULL), XFALSE);
+
+    pEntry->pName = pCopy;
+    pEntry->nType = nType;
+    pEntry->pNext = NULL;
+
+    if (pDir->pLast != NULL) pDir->pLast->pNext = pEntry;
+    else pDir->pEntries = pEntry;
+
+    pDir->pLast = pEntry;
+    return XTRUE;
+}
+
+xbool_t SMake_CacheAddEntry(smake_cache_t *pCache, smake_cache_dir_t *pDir, const char *pName, int nType)
+{
+    XASSERT((pDir != NULL && strchr(pName, '\n') == NULL), XFALSE);
+    return SMake_CacheAppend(pCache, pDir, pName, strlen(pName), nType);
+}
+
+const smake_cache_src_t* SMake_CacheGetSource(smake_cache_t *pCache, const char *pPath, const struct stat *pStat)
+{
+    smake_cache_src_t *pSrc = (smake_cache_src_t*)XMap_Get(&pCache->sources, pPath);
+    XASSERT(pSrc, NULL);
+
+    if (pSrc->nSize != (uint64_t)pStat->st_size ||
+        !SMake_CacheSameTime(pStat, pSrc->nSec, pSrc->nNsec)) return NULL;
+
+    return pSrc;
+}
+
+int SMake_CacheGetMain(smake_cache_t *pCache, const char *pPath, const struct stat *pStat)
+{
+    const smake_cache_src_t *pSrc = SMake_CacheGetSource(pCache, pPath, pStat);
+    XASSERT((pSrc != NULL && pSrc->nMain >= 0), XSTDERR);
+    return pSrc->nMain ? XSTDOK : XSTDNON;
+}
+
+static smake_cache_src_t* SMake_CacheNewSource(smake_cache_t *pCache, const char *pPath, size_t nLength)
+{
+    smake_cache_src_t *pSrc = (smake_cache_src_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_cache_src_t));
+    char *pCopy = SMake_ArenaStrdup(&pCache->arena, pPath, nLength);
+    XASSERT((pSrc != NULL && pCopy != NULL), NULL);
+
+    pSrc->pIncludes = pSrc->pLast = NULL;
+    pSrc->pPath = pCopy;
+    pSrc->nMain = -1;
+    pSrc->nPch = -1;
+    pSrc->nNsec = 0;
+    pSrc->nSize = 0;
+    pSrc->nSec = 0;
+
+    XMap_Put(&pCache->sources, pSrc->pPath, pSrc);
+    XArray_AddData(&pCache->srcArr, pSrc, XSTDNON);
+    return pSrc;
+}
+
+smake_cache_src_t* SMake_CacheSource(smake_cache_t *pCache, const char *pPath, const struct stat *pStat)
+{
+    /* Main and prologue scans of the same source share the record */
+    smake_cache_src_t *pSrc = (smake_cache_src_t*)XMap_Get(&pCache->sources, pPath);
+    if (pSrc != NULL) return pSrc;
+
+    XASSERT((strchr(pPath, '\n') == NULL), NULL);
+    XASSERT(!SMake_CacheRacy(pCache, pStat), NULL);
+
+    pSrc = SMake_CacheNewSource(pCache, pPath, strlen(pPath));
+    XASSERT(pSrc, NULL);
+
+    pSrc->nSize = (uint64_t)pStat->st_size;
+    pSrc->nSec = (int64_t)pStat->st_mtim.tv_sec;
+    pSrc->nNsec = (long)pStat->st_mtim.tv_nsec;
+    return pSrc;
+}
+
+xbool_t SMake_CacheAddSource(smake_cache_t *pCache, const char *pPath, const struct stat *pStat, xbool_t bMain)
+{
+    smake_cache_src_t *pSrc = SMake_CacheSource(pCache, pPath, pStat);
+    if (pSrc != NULL) pSrc->nMain = bMain ? 1 : 0;
+    return XTRUE;
+}
+
+static xbool_t SMake_CacheAppendInclude(smake_cache_t *pCache, smake_cache_src_t *pSrc, const char *pName, size_t nLength)
+{
+    smake_cache_incl_t *pIncl = (smake_cache_incl_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_cache_incl_t));
+    char *pCopy = SMake_ArenaStrdup(&pCache->arena, pName, nLength);
+    XASSERT((pIncl != NULL && pCopy != NULL), XFALSE);
+
+    pIncl->pName = pCopy;
+    pIncl->pNext = NULL;
+
+    if (pSrc->pLast != NULL) pSrc->pLast->pNext = pIncl;
+    else pSrc->pIncludes = pIncl;
+
+    pSrc->pLast = pIncl;
+    return XTRUE;
+}
+
+xbool_t SMake_CacheAddInclude(smake_cache_t *pCache, smake_cache_src_t *pSrc, const char *pName, size_t nLength)
+{
+    XASSERT((pSrc != NULL && memchr(pName, '\n', nLength) == NULL), XFALSE);
+    return SMake_CacheAppendInclude(pCache, pSrc, pName, nLength);
+}
+
+void SMake_CacheForget(smake_cache_t *pCache, const char *pPath)
+{
+    /* Records stay in the arena, no file has a negative nanosecond */
+    smake_cache_dir_t *pDir = (smake_cache_dir_t*)XMap_Get(&pCache->dirs, pPath);
+    if (pDir != NULL) pDir->nNsec = -1;
+
+    smake_cache_src_t *pSrc = (smake_cache_src_t*)XMap_Get(&pCache->sources, pPath);
+    if (pSrc != NULL) pSrc->nNsec = -1;
+}
+
+/* Parses "<number> " at the beginning of pLine and moves it forward */
+static xbool_t SMake_CacheNumber(const char **pLine, const char *pEnd, long long *pValue)
+{
+    char *pNext = NULL;
+    errno = 0;
+
+    *pValue = strtoll(*pLine, &pNext, 10);
+    if (errno || pNext == *pLine || pNext >= pEnd || *pNext != ' ') return XFALSE;
+
+    *pLine = pNext + 1;
+    return XTRUE;
+}
+
+static xbool_t SMake_CacheParseLine(smake_cache_t *pCache, smake_cache_dir_t **pCurrent,
+                                    smake_cache_src_t **pSource, const char *pLine, const char *pEnd)
+{
+    XASSERT((pEnd - pLine > 2 && pLine[1] == ' '), XFALSE);
+    char nTag = pLine[0];
+    long long nValues[5];
+    pLine += 2;
+
+    if (nTag == 'D')
+    {
+        int i;
+        for (i = 0; i < 3; i++)
+            if (!SMake_CacheNumber(&pLine, pEnd, &nValues[i])) return XFALSE;
+
+        XASSERT((pLine < pEnd), XFALSE);
+        smake_cache_dir_t *pDir = SMake_CacheNewDir(pCache, pLine, pEnd - pLine);
+        XASSERT(pDir, XFALSE);
+
+        pDir->nSec = (int64_t)nValues[0];
+        pDir->nNsec = (long)nValues[1];
+        pDir->nInode = (uint64_t)nValues[2];
+        *pCurrent = pDir;
+        return XTRUE;
+    }
+    else if (nTag == 'E')
+    {
+        XASSERT((*pCurrent != NULL), XFALSE);
+        if (!SMake_CacheNumber(&pLine, pEnd, &nValues[0])) return XFALSE;
+
+        XASSERT((pLine < pEnd && nValues[0] >= SMAKE_FILE_UNF && nValues[0] <= SMAKE_FILE_H), XFALSE);
+        return SMake_CacheAppend(pCache, *pCurrent, pLine, pEnd - pLine, (int)nValues[0]);
+    }
+    else if (nTag == 'S')
+    {
+        int i;
+        for (i = 0; i < 5; i++)
+            if (!SMake_CacheNumber(&pLine, pEnd, &nValues[i])) return XFALSE;
+
+        XASSERT((pLine < pEnd && nValues[3] >= -1 && nValues[3] <= 1 && nValues[4] >= -1 && nValues[4] <= 1), XFALSE);
+        smake_cache_src_t *pSrc = SMake_CacheNewSource(pCache, pLine, pEnd - pLine);
+        XASSERT(pSrc, XFALSE);
+
+        pSrc->nSize = (uint64_t)nValues[0];
+        pSrc->nSec = (int64_t)nValues[1];
+        pSrc->nNsec = (long)nValues[2];
+        pSrc->nMain = (int)nValues[3];
+        pSrc->nPch = (int)nValues[4];
+        *pSource = pSrc;
+        return XTRUE;
+    }
+    else if (nTag == 'I')
+    {
+        XASSERT((*pSource != NULL), XFALSE);
+        return SMake_CacheAppendInclude(pCache, *pSource, pLine, pEnd - pLine);
+    }
+
+    return XFALSE;
+}
+
+xbool_t SMake_CacheLoad(smake_cache_t *pCache, const char *pPath)
+{
+    size_t nSize = 0;
+    char *pBuffer = (char*)XPath_Load(pPath, &nSize);
+    XASSERT(pBuffer, XFALSE);
+
+    char sMagic[64];
+    int nMagic = xstrncpyf(sMagic, sizeof(sMagic), "%s %d\n", SMAKE_CACHE_MAGIC, SMAKE_CACHE_VERSION);
+
+    if (nSize < (size_t)nMagic || strncmp(pBuffer, sMagic, nMagic))
+    {
+        xlogd("Ignoring cache with unknown format: %s", pPath);
+        free(pBuffer);
+        return XFALSE;
+    }
+
+    smake_cache_dir_t *pCurrent = NULL;
+    smake_cache_src_t *pSource = NULL;
+    const char *pLine = pBuffer + nMagic;
+    const char *pBufEnd = pBuffer + nSize;
+
+    while (pLine < pBufEnd)
+    {
+        const char *pEnd = (const char*)memchr(pLine, '\n', pBufEnd - pLine);
+        if (pEnd == NULL || !SMake_CacheParseLine(pCache, &pCurrent, &pSource, pLine, pEnd))
+        {
+            /* Truncated or corrupted cache is the same as no cache */
+            xlogd("Ignoring corrupted cache: %s", pPath);
+            SMake_CacheReset(pCache);
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        pLine = pEnd + 1;
+    }
+
+    xlogd("Loaded cache: %s (%zu dirs, %zu sources)", pPath,
+        XArray_Used(&pCache->dirArr), XArray_Used(&pCache->srcArr));
+
+    free(pBuffer);
+    return XTRUE;
+}
+
+xbool_t SMake_CacheSave(smake_cache_t *pCache, const char *pPath)
+{
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, SMAKE_ARENA_BLOCK, XFALSE);
+    XByteBuffer_AddFmt(&buffer, "%s %d\n", SMAKE_CACHE_MAGIC, SMAKE_CACHE_VERSION);
+
+    size_t i, nDirs = XArray_Used(&pCache->dirArr);
+    for (i = 0; i < nDirs; i++)
+    {
+        smake_cache_dir_t *pDir = (smake_cache_dir_t*)XArray_GetData(&pCache->dirArr, i);
+        XByteBuffer_AddFmt(&buffer, "D %lld %ld %llu %s\n", (long long)pDir->nSec,
+            pDir->nNsec, (unsigned long long)pDir->nInode, pDir->pPath);
+
+        smake_cache_entry_t *pEntry = pDir->pEntries;
+        while (pEntry != NULL)
+        {
+            XByteBuffer_AddFmt(&buffer, "E %d %s\n", pEntry->nType, pEntry->pName);
+            pEntry = pEntry->pNext;
+        }
+    }
+
+    size_t nSources = XArray_Used(&pCache->srcArr);
+    for (i = 0; i < nSources; i++)
+    {
+        smake_cache_src_t *pSrc = (smake_cache_src_t*)XArray_GetData(&pCache->srcArr, i);
+        XByteBuffer_AddFmt(&buffer, "S %llu %lld %ld %d %d %s\n", (unsigned long long)pSrc->nSize,
+            (long long)pSrc->nSec, pSrc->nNsec, pSrc->nMain, pSrc->nPch, pSrc->pPath);
+
+        smake_cache_incl_t *pIncl = pSrc->pIncludes;
+        while (pIncl != NULL)
+        {
+            XByteBuffer_AddFmt(&buffer, "I %s\n", pIncl->pName);
+            pIncl = pIncl->pNext;
+        }
+    }
+
+    if (buffer.pData == NULL)
+    {
+        xlogw("Failed to serialize cache: %s", pPath);
+        return XFALSE;
+    }
+
+    /* Written to a unique temporary file and renamed, concurrent runs never share it */
+    xbool_t bStatus = SMake_UpdateFile(pPath, (const char*)buffer.pData, buffer.nUsed);
+    XByteBuffer_Clear(&buffer);
+    return bStatus;
+}
+
+void SMake_FindCacheInit(smake_find_cache_t *pCache)
+{
+    SMake_ArenaInit(&pCache->arena);
+    XArray_Init(&pCache->findArr, NULL, XSTDNON, XFALSE);
+    pCache->findArr.clearCb = NULL;
+    XMap_Init(&pCache->finds, SMAKE_CACHE_MAP);
+    pCache->bModified = XFALSE;
+    pCache->bLoaded = XFALSE;
+}
+
+void SMake_FindCacheDestroy(smake_find_cache_t *pCache)
+{
+    XMap_Destroy(&pCache->finds);
+    XArray_Destroy(&pCache->findArr);
+    SMake_ArenaDestroy(&pCache->arena);
+}
+
+static void SMake_FindCacheReset(smake_find_cache_t *pCache)
+{
+    SMake_FindCacheDestroy(pCache);
+    SMake_FindCacheInit(pCache);
+}
+
+static smake_cache_find_t* SMake_FindCacheNew(smake_find_cache_t *pCache, const char *pKey, size_t nLength)
+{
+    char *pCopy = SMake_ArenaStrdup(&pCache->arena, pKey, nLength);
+    XASSERT(pCopy, NULL);
+
+    /* Search done again replaces the stale result */
+    smake_cache_find_t *pFind = (smake_cache_find_t*)XMap_Get(&pCache->finds, pCopy);
+    if (pFind == NULL)
+    {
+        pFind = (smake_cache_find_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_cache_find_t));
+        XASSERT(pFind, NULL);
+
+        pFind->pKey = pCopy;
+        XMap_Put(&pCache->finds, pFind->pKey, pFind);
+        XArray_AddData(&pCache->findArr, pFind, XSTDNON);
+    }
+
+    pFind->pStamps = pFind->pLast = NULL;
+    pFind->pFound = NULL;
+    return pFind;
+}
+
+static xbool_t SMake_FindCacheAppend(smake_find_cache_t *pCache, smake_cache_find_t *pFind, const char *pPath, size_t nLength, int64_t nSec, long nNsec)
+{
+    smake_cache_stamp_t *pStamp = (smake_cache_stamp_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_cache_stamp_t));
+    char *pCopy = SMake_ArenaStrdup(&pCache->arena, pPath, nLength);
+    XASSERT((pStamp != NULL && pCopy != NULL), XFALSE);
+
+    pStamp->pPath = pCopy;
+    pStamp->nNsec = nNsec;
+    pStamp->nSec = nSec;
+    pStamp->pNext = NULL;
+
+    if (pFind->pLast != NULL) pFind->pLast->pNext = pStamp;
+    else pFind->pStamps = pStamp;
+
+    pFind->pLast = pStamp;
+    return XTRUE;
+}
+
+const smake_cache_find_t* SMake_FindCacheGet(smake_find_cache_t *pCache, const char *pKey)
+{
+    smake_cache_find_t *pFind = (smake_cache_find_t*)XMap_Get(&pCache->finds, pKey);
+    XASSERT(pFind, NULL);
+
+    struct stat statbuf;
+    smake_cache_stamp_t *pStamp = pFind->pStamps;
+
+    while (pStamp != NULL)
+    {
+        if (stat(pStamp->pPath, &statbuf) < 0)
+        {
+            if (pStamp->nSec >= 0) return NULL;
+        }
+        else if (pStamp->nSec < 0 || !SMake_CacheSameTime(&statbuf, pStamp->nSec, pStamp->nNsec))
+        {
+            return NULL;
+        }
+
+        pStamp = pStamp->pNext;
+    }
+
+    /* Found file may be removed without touching the stamped directories */
+    if (pFind->pFound != NULL && stat(pFind->pFound, &statbuf) < 0) return NULL;
+    return pFind;
+}
+
+smake_cache_find_t* SMake_FindCacheAdd(smake_find_cache_t *pCache, const char *pKey, const char *pFound)
+{
+    XASSERT((strchr(pKey, '\n') == NULL), NULL);
+    XASSERT((pFound == NULL || strchr(pFound, '\n') == NULL), NULL);
+
+    smake_cache_find_t *pFind = SMake_FindCacheNew(pCache, pKey, strlen(pKey));
+    XASSERT(pFind, NULL);
+
+    if (pFound != NULL) pFind->pFound = SMake_ArenaStrdup(&pCache->arena, pFound, strlen(pFound));
+    pCache->bModified = XTRUE;
+    return pFind;
+}
+
+xbool_t SMake_FindCacheStamp(smake_find_cache_t *pCache, smake_cache_find_t *pFind, const char *pPath, const struct stat *pStat)
+{
+    XASSERT((pFind != NULL && strchr(pPath, '\n') == NULL), XFALSE);
+
+    if (pStat == NULL)
+        return SMake_FindCacheAppend(pCache, pFind, pPath, strlen(pPath), -1, 0);
+
+    return SMake_FindCacheAppend(pCache, pFind, pPath, strlen(pPath),
+        (int64_t)pStat->st_mtim.tv_sec, (long)pStat->st_mtim.tv_nsec);
+}
+
+static xbool_t SMake_FindCacheParseLine(smake_find_cache_t *pCache, smake_cache_find_t **pCurrent, const char *pLine, const char *pEnd)
+{
+    XASSERT((pEnd - pLine > 2 && pLine[1] == ' '), XFALSE);
+    char nTag = pLine[0];
+    long long nValues[2];
+    pLine += 2;
+
+    if (nTag == 'F')
+    {
+        *pCurrent = SMake_FindCacheNew(pCache, pLine, pEnd - pLine);
+        return *pCurrent != NULL ? XTRUE : XFALSE;
+    }
+    else if (nTag == 'R')
+    {
+        XASSERT((*pCurrent != NULL), XFALSE);
+        (*pCurrent)->pFound = SMake_ArenaStrdup(&pCache->arena, pLine, pEnd - pLine);
+        return (*pCurrent)->pFound != NULL ? XTRUE : XFALSE;
+    }
+    else if (nTag == 'T')
+    {
+        XASSERT((*pCurrent != NULL), XFALSE);
+        if (!SMake_CacheNumber(&pLine, pEnd, &nValues[0]) ||
+            !SMake_CacheNumber(&pLine, pEnd, &nValues[1])) return XFALSE;
+
+        XASSERT((pLine < pEnd), XFALSE);
+        return SMake_FindCacheAppend(pCache, *pCurrent, pLine, pEnd - pLine,
+            (int64_t)nValues[0], (long)nValues[1]);
+    }
+
+    return XFALSE;
+}
+
+xbool_t SMake_FindCacheLoad(smake_find_cache_t *pCache, const char *pPath)
+{
+    pCache->bLoaded = XTRUE;
+    size_t nSize = 0;
+
+    char *pBuffer = (char*)XPath_Load(pPath, &nSize);
+    XASSERT(pBuffer, XFALSE);
+
+    char sMagic[64];
+    int nMagic = xstrncpyf(sMagic, sizeof(sMagic), "%s %d\n", SMAKE_FIND_CACHE_MAGIC, SMAKE_FIND_CACHE_VERSION);
+
+    if (nSize < (size_t)nMagic || strncmp(pBuffer, sMagic, nMagic))
+    {
+        xlogd("Ignoring find cache with unknown format: %s", pPath);
+        free(pBuffer);
+        return XFALSE;
+    }
+
+    smake_cache_find_t *pCurrent = NULL;
+    const char *pLine = pBuffer + nMagic;
+    const char *pBufEnd = pBuffer + nSize;
+
+    while (pLine < pBufEnd)
+    {
+        const char *pEnd = (const char*)memchr(pLine, '\n', pBufEnd - pLine);
+        if (pEnd == NULL || !SMake_FindCacheParseLine(pCache, &pCurrent, pLine, pEnd))
+        {
+            xlogd("Ignoring corrupted find cache: %s", pPath);
+            SMake_FindCacheReset(pCache);
+            pCache->bLoaded = XTRUE;
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        pLine = pEnd + 1;
+    }
+
+    xlogd("Loaded find cache: %s (%zu searches)", pPath, XArray_Used(&pCache->findArr));
+    free(pBuffer);
+    return XTRUE;
+}
+
+xbool_t SMake_FindCacheSave(smake_find_cache_t *pCache, const char *pPath)
+{
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, SMAKE_ARENA_BLOCK, XFALSE);
+    XByteBuffer_AddFmt(&buffer, "%s %d\n", SMAKE_FIND_CACHE_MAGIC, SMAKE_FIND_CACHE_VERSION);
+
+    size_t i, nFinds = XArray_Used(&pCache->findArr);
+    for (i = 0; i < nFinds; i++)
+    {
+        smake_cache_find_t *pFind = (smake_cache_find_t*)XArray_GetData(&pCache->findArr, i);
+        XByteBuffer_AddFmt(&buffer, "F %s\n", pFind->pKey);
+        if (pFind->pFound != NULL) XByteBuffer_AddFmt(&buffer, "R %s\n", pFind->pFound);
+
+        smake_cache_stamp_t *pStamp = pFind->pStamps;
+        while (pStamp != NULL)
+        {
+            XByteBuffer_AddFmt(&buffer, "T %lld %ld %s\n", (long long)pStamp->nSec, pStamp->nNsec, pStamp->pPath);
+            pStamp = pStamp->pNext;
+        }
+    }
+
+    if (buffer.pData == NULL)
+    {
+        xlogw("Failed to serialize find cache: %s", pPath);
+        return XFALSE;
+    }
+
+    xbool_t bStatus = SMake_UpdateFile(pPath, (const char*)buffer.pData, buffer.nUsed);
+    XByteBuffer_Clear(&buffer);
+    return bStatus;
+}
@@ -0,0 +1,125 @@
+/*!
+ *  @file smake/src/cache.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Persistent cache of directory listings, source info and find results.
+ */
+
+#ifndef __SMAKE_CACHE_H__
+#define __SMAKE_CACHE_H__
+
+#include "stdinc.h"
+#include "arena.h"
+
+#define SMAKE_CACHE_FILE    ".smake.cache"
+#define SMAKE_CACHE_MAGIC   "SMAKE-CACHE"
+#define SMAKE_CACHE_VERSION 3
+
+/* Coarsest timestamp granularity of common file systems (FAT), in seconds */
+#define SMAKE_CACHE_GRANULARITY  2
+
+#define SMAKE_FIND_CACHE_FILE    "find.cache"
+#define SMAKE_FIND_CACHE_MAGIC   "SMAKE-FIND"
+#define SMAKE_FIND_CACHE_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SMakeCacheEntry {
+    struct SMakeCacheEntry *pNext;
+    const char *pName;
+    int nType;                      /* SMAKE_FILE_UNF for directories */
+} smake_cache_entry_t;
+
+typedef struct SMakeCacheDir {
+    smake_cache_entry_t *pEntries;
+    smake_cache_entry_t *pLast;
+    const char *pPath;
+    uint64_t nInode;
+    int64_t nSec;
+    long nNsec;
+} smake_cache_dir_t;
+
+typedef struct SMakeCacheInclude {
+    struct SMakeCacheInclude *pNext;
+    const char *pName;              /* As written, with the quotes or angle brackets */
+} smake_cache_incl_t;
+
+typedef struct SMakeCacheSource {
+    smake_cache_incl_t *pIncludes;  /* Prologue includes counted for the precompiled header */
+    smake_cache_incl_t *pLast;
+    const char *pPath;
+    uint64_t nSize;
+    int64_t nSec;
+    long nNsec;
+    int nMain;                      /* -1 when the source was not read for main() */
+    int nPch;                       /* -1 when the prologue was not read, 0 if it defines macros */
+} smake_cache_src_t;
+
+typedef struct SMakeCache {
+    smake_arena_t arena;
+    xarray_t dirArr;                /* Insertion order for writing */
+    xarray_t srcArr;
+    xmap_t dirs;
+    xmap_t sources;
+    int64_t nRacySec;               /* Entries modified after this time are not stored */
+    long nRacyNsec;
+} smake_cache_t;
+
+typedef struct SMakeCacheStamp {
+    struct SMakeCacheStamp *pNext;
+    const char *pPath;
+    int64_t nSec;                   /* -1 for a missing directory */
+    long nNsec;
+} smake_cache_stamp_t;
+
+typedef struct SMakeCacheFind {
+    smake_cache_stamp_t *pStamps;   /* Searched directories */
+    smake_cache_stamp_t *pLast;
+    const char *pKey;
+    const char *pFound;             /* First match, NULL when nothing was found */
+} smake_cache_find_t;
+
+typedef struct SMakeFindCache {
+    smake_arena_t arena;
+    xarray_t findArr;               /* Insertion order for writing */
+    xmap_t finds;
+    xbool_t bLoaded;
+    xbool_t bModified;
+} smake_find_cache_t;
+
+void SMake_CacheInit(smake_cache_t *pCache);
+void SMake_CacheDestroy(smake_cache_t *pCache);
+
+xbool_t SMake_CacheLoad(smake_cache_t *pCache, const char *pPath);
+xbool_t SMake_CacheSave(smake_cache_t *pCache, const char *pPath);
+
+const smake_cache_dir_t* SMake_CacheGetDir(smake_cache_t *pCache, const char *pPath, const struct stat *pStat);
+smake_cache_dir_t* SMake_CacheAddDir(smake_cache_t *pCache, const char *pPath, const struct stat *pStat);
+xbool_t SMake_CacheAddEntry(smake_cache_t *pCache, smake_cache_dir_t *pDir, const char *pName, int nType);
+
+int SMake_CacheGetMain(smake_cache_t *pCache, const char *pPath, const struct stat *pStat);
+xbool_t SMake_CacheAddSource(smake_cache_t *pCache, const char *pPath, const struct stat *pStat, xbool_t bMain);
+const smake_cache_src_t* SMake_CacheGetSource(smake_cache_t *pCache, const char *pPath, const struct stat *pStat);
+smake_cache_src_t* SMake_CacheSource(smake_cache_t *pCache, const char *pPath, const struct stat *pStat);
+xbool_t SMake_CacheAddInclude(smake_cache_t *pCache, smake_cache_src_t *pSrc, const char *pName, size_t nLength);
+void SMake_CacheForget(smake_cache_t *pCache, const char *pPath);
+
+void SMake_FindCacheInit(smake_find_cache_t *pCache);
+void SMake_FindCacheDestroy(smake_find_cache_t *pCache);
+
+xbool_t SMake_FindCacheLoad(smake_find_cache_t *pCache, const char *pPath);
+xbool_t SMake_FindCacheSave(smake_find_cache_t *pCache, const char *pPath);
+
+const smake_cache_find_t* SMake_FindCacheGet(smake_find_cache_t *pCache, const char *pKey);
+smake_cache_find_t* SMake_FindCacheAdd(smake_find_cache_t *pCache, const char *pKey, const char *pFound);
+xbool_t SMake_FindCacheStamp(smake_find_cache_t *pCache, smake_cache_find_t *pFind, const char *pPath, const struct stat *pStat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_CACHE_H__ */
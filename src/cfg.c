@@ -21,101 +21,157 @@ static void SMake_CopyPath(char *pDst, int nSize, const char *pSrc)
         pDst[nLength-1] = '\0';
 }
 
-int SMake_GetLogFlags(uint8_t nVerbose)
+xbool_t SMake_SetBackend(smake_ctx_t *pCtx, const char *pName)
 {
-    int nLogFlags = XLOG_ERROR | XLOG_WARN;
-    if (nVerbose) nLogFlags |= XLOG_NOTE;
-    if (nVerbose > 1) nLogFlags |= XLOG_INFO;
-    if (nVerbose > 2) nLogFlags |= XLOG_DEBUG;
-    if (nVerbose > 3) nLogFlags = XLOG_ALL;
-    return nLogFlags;
+    if (!strcmp(pName, "make")) pCtx->nBackend = SMAKE_BACKEND_MAKE;
+    else if (!strcmp(pName, "ninja")) pCtx->nBackend = SMAKE_BACKEND_NINJA;
+    else
+    {
+        xloge("Unknown build backend: %s (expected make or ninja)", pName);
+        return XFALSE;
+    }
+
+    return XTRUE;
 }
 
-xbool_t SMake_IsExcluded(smake_ctx_t *pCtx, const char *pPath)
+void SMake_SetLauncher(smake_ctx_t *pCtx, const char *pName)
 {
-    size_t i, nExcludes = XArray_Used(&pCtx->excludes);
-    for (i = 0; i < nExcludes; i++)
-    {
-        const char *pExcl = (const char *)XArray_GetData(&pCtx->excludes, i);
-        if (xstrused(pExcl) && !strcmp(pExcl, pPath)) return XTRUE;
-    }
+    XASSERT_VOID_RET(pName);
+    pCtx->bAutoLauncher = !strcmp(pName, "auto") ? XTRUE : XFALSE;
+    pCtx->sLauncher[0] = XSTR_NUL;
 
-    return XFALSE;
+    /* "none" keeps the launcher disabled, "auto" is resolved before writing the build */
+    if (!pCtx->bAutoLauncher && strcmp(pName, "none"))
+        xstrncpy(pCtx->sLauncher, sizeof(pCtx->sLauncher), pName);
 }
 
-xbool_t SMake_SerializeIncludes(xarray_t *pArr, const char *pDlmt, char *pOutput, size_t nSize)
+void SMake_SetLinker(smake_ctx_t *pCtx, const char *pName)
 {
-    size_t nCount = XArray_Used(pArr);
-    size_t i, nAvail = nSize - 1;
-    xbool_t bStarted = XFALSE;
+    XASSERT_VOID_RET(pName);
+    pCtx->bAutoLinker = !strcmp(pName, "auto") ? XTRUE : XFALSE;
+    pCtx->sLinker[0] = XSTR_NUL;
 
-    for (i = 0; i < nCount; i++)
-    {
-        const char *pData = (const char*)XArray_GetData(pArr, i);
-        if (!xstrused(pData)) continue;
+    /* "none" keeps the default linker of the compiler, "auto" is resolved before writing the build */
+    if (!pCtx->bAutoLinker && strcmp(pName, "none"))
+        xstrncpy(pCtx->sLinker, sizeof(pCtx->sLinker), pName);
+}
 
-        if (!bStarted)  bStarted = XTRUE;
-        else if (pDlmt) nAvail = xstrncatf(pOutput, nAvail, "%s", pDlmt);
-        nAvail = xstrncatf(pOutput, nAvail, "-I%s", pData);
+xbool_t SMake_SetLto(smake_ctx_t *pCtx, const char *pType)
+{
+    XASSERT(pType, XFALSE);
+    if (!strcmp(pType, "none")) pCtx->nLto = SMAKE_LTO_NONE;
+    else if (!strcmp(pType, "full")) pCtx->nLto = SMAKE_LTO_FULL;
+    else if (!strcmp(pType, "thin")) pCtx->nLto = SMAKE_LTO_THIN;
+    else
+    {
+        xloge("Unknown LTO type: %s (expected full, thin or none)", pType);
+        return XFALSE;
     }
 
-    return bStarted;
+    return XTRUE;
 }
 
-xbool_t SMake_SerializeArray(xarray_t *pArr, const char *pDlmt, char *pOutput, size_t nSize)
+xbool_t SMake_SetScanThreads(smake_ctx_t *pCtx, long nThreads)
 {
-    size_t nCount = XArray_Used(pArr);
-    size_t i, nAvail = nSize - 1;
-    xbool_t bStarted = XFALSE;
+    /* Zero picks the CPU count when the scan starts */
+    if (nThreads < 0 || nThreads > SMAKE_SCAN_THREADS_MAX)
+    {
+        xloge("Invalid scan thread count: %ld (expected 0 to %d)", nThreads, SMAKE_SCAN_THREADS_MAX);
+        return XFALSE;
+    }
 
-    for (i = 0; i < nCount; i++)
+    pCtx->nScanThreads = (uint16_t)nThreads;
+    return XTRUE;
+}
+
+xbool_t SMake_SetUnitySize(smake_ctx_t *pCtx, long nSize)
+{
+    /* Zero disables unity build, one source per batch is no batch at all */
+    if (nSize == 1 || nSize < 0 || nSize > SMAKE_UNITY_SIZE_MAX)
     {
-        const char *pData = (const char*)XArray_GetData(pArr, i);
-        if (!xstrused(pData)) continue;
+        xloge("Invalid unity batch size: %ld (expected 0 or 2 to %d)", nSize, SMAKE_UNITY_SIZE_MAX);
+        return XFALSE;
+    }
 
-        if (!bStarted)  bStarted = XTRUE;
-        else if (pDlmt) nAvail = xstrncatf(pOutput, nAvail, "%s", pDlmt);
-        nAvail = xstrncatf(pOutput, nAvail, "%s", pData);
+    pCtx->nUnitySize = (uint16_t)nSize;
+    return XTRUE;
+}
+
+xbool_t SMake_SetPchHeaders(smake_ctx_t *pCtx, long nHeaders)
+{
+    if (nHeaders < 0 || nHeaders > SMAKE_PCH_HEADERS_MAX)
+    {
+        xloge("Invalid precompiled header count: %ld (expected 0 to %d)", nHeaders, SMAKE_PCH_HEADERS_MAX);
+        return XFALSE;
     }
 
-    return bStarted;
+    pCtx->nPchHeaders = (uint16_t)nHeaders;
+    return XTRUE;
 }
 
-xbool_t SMake_AddToArray(xarray_t *pArr, const char *pFmt, ...)
+static xbool_t SMake_ParseNumber(const char *pArg, long *pValue)
 {
-    va_list args;
-    size_t nLength = 0;
+    char *pEnd = NULL;
+    *pValue = strtol(pArg, &pEnd, 10);
+    return (pEnd != pArg && *pEnd == XSTR_NUL) ? XTRUE : XFALSE;
+}
 
-    va_start(args, pFmt);
-    char *pDest = xstracpyargs(pFmt, args, &nLength);
-    va_end(args);
-    XASSERT(pDest, XFALSE);
+int SMake_GetLogFlags(uint8_t nVerbose)
+{
+    int nLogFlags = XLOG_ERROR | XLOG_WARN;
+    if (nVerbose) nLogFlags |= XLOG_NOTE;
+    if (nVerbose > 1) nLogFlags |= XLOG_INFO;
+    if (nVerbose > 2) nLogFlags |= XLOG_DEBUG;
+    if (nVerbose > 3) nLogFlags = XLOG_ALL;
+    return nLogFlags;
+}
 
+xbool_t SMake_IsExcluded(smake_ctx_t *pCtx, const char *pPath)
+{
+    /* Compile the rules added by -e or config since the last lookup.
+     * The first lookup is done on the main thread before scan workers start. */
+    size_t i, nExcludes = XArray_Used(&pCtx->excludes.array);
+    for (i = pCtx->excludeIdx.nRules; i < nExcludes; i++)
+    {
+        const char *pExcl = (const char *)XArray_GetData(&pCtx->excludes.array, i);
+        if (!SMake_ExclAdd(&pCtx->excludeIdx, pExcl) && xstrused(pExcl))
+            xlogw("Failed to compile exclude rule: %s", pExcl);
+    }
+
+    return SMake_ExclMatch(&pCtx->excludeIdx, pPath);
+}
+
+static const char* SMake_Serialize(xarray_t *pArr, const char *pDlmt, const char *pPrefix, xbyte_buffer_t *pOutput)
+{
     size_t i, nCount = XArray_Used(pArr);
+    xbool_t bStarted = XFALSE;
+    XByteBuffer_Init(pOutput, nCount ? SMAKE_LINE_MAX : 0, XFALSE);
+
     for (i = 0; i < nCount; i++)
     {
         const char *pData = (const char*)XArray_GetData(pArr, i);
         if (!xstrused(pData)) continue;
 
-        if (strlen(pData) == nLength &&
-            !strncmp(pData, pDest, nLength))
+        if (XByteBuffer_AddFmt(pOutput, "%s%s%s", bStarted && pDlmt ? pDlmt : XSTR_EMPTY, pPrefix, pData) < 0)
         {
-            free(pDest);
-            return XTRUE;
+            xloge("Failed to serialize array: %s", XSTRERR);
+            return NULL;
         }
+
+        bStarted = XTRUE;
     }
 
-    int nIndex = XArray_AddData(pArr, pDest, XSTDNON);
-    xarray_data_t *pArrData = XArray_Get(pArr, nIndex);
+    return bStarted ? (const char*)pOutput->pData : XSTR_EMPTY;
+}
 
-    if (pArrData == NULL)
-    {
-        free(pDest);
-        return XFALSE;
-    }
+const char* SMake_SerializeIncludes(xarray_t *pArr, const char *pDlmt, xbyte_buffer_t *pOutput)
+{
+    return SMake_Serialize(pArr, pDlmt, "-I", pOutput);
+}
 
-    pArrData->nSize = nLength + 1;
-    return XTRUE;
+const char* SMake_SerializeArray(xarray_t *pArr, const char *pDlmt, xbyte_buffer_t *pOutput)
+{
+    return SMake_Serialize(pArr, pDlmt, XSTR_EMPTY, pOutput);
 }
 
 static xbool_t SMake_AddSourceFile(smake_ctx_t *pCtx, const char *pFullPath)
@@ -150,10 +206,13 @@ static xbool_t SMake_AddSourceFile(smake_ctx_t *pCtx, const char *pFullPath)
         return XFALSE;
     }
 
-    SMakeFile *pFile = SMake_FileNew(path.sPath, path.sFile, nType);
+    const SMakeDir *pDir = SMake_DirIntern(pCtx, path.sPath);
+    XASSERT(pDir, XFALSE);
+
+    SMakeFile *pFile = SMake_FileNew(pCtx, pDir, path.sFile, nType);
     if (pFile == NULL) return XFALSE;
 
-    xlogd("Loading project file from config: %s/%s", pFile->sPath, pFile->sName);
+    xlogd("Loading project file from config: %s/%s", pFile->pDir->pPath, pFile->pName);
     int nStatus = XArray_AddData(&pCtx->fileArr, pFile, XSTDNON);
     return nStatus >= 0 ? XTRUE : XFALSE;
 }
@@ -182,12 +241,12 @@ static xbool_t SMake_AddIncludePath(smake_ctx_t *pCtx, const char *pFullPath)
     }
 
     xlogd("Using include path from the config: %s", path.sPath);
-    SMake_AddToArray(&pCtx->includes, "%s", path.sPath);
+    SMake_AddToList(&pCtx->includes, "%s", path.sPath);
 
     return XTRUE;
 }
 
-xbool_t SMake_AddTokens(xarray_t *pArr, const char *pDlmt, const char *pInput)
+xbool_t SMake_AddTokens(smake_list_t *pList, const char *pDlmt, const char *pInput)
 {
     xarray_t *pTokens = xstrsplit(pInput, pDlmt);
     XASSERT(pTokens, XFALSE);
@@ -196,7 +255,7 @@ xbool_t SMake_AddTokens(xarray_t *pArr, const char *pDlmt, const char *pInput)
     for (i = 0; i < nUsed; i++)
     {
         const char *pToken = (const char*)XArray_GetData(pTokens, i);
-        if (xstrused(pToken)) SMake_AddToArray(pArr, "%s", pToken);
+        if (xstrused(pToken)) SMake_AddToList(pList, "%s", pToken);
     }
 
     XArray_Destroy(pTokens);
@@ -215,29 +274,67 @@ static xbool_t SMake_AddFindObject(smake_ctx_t *pCtx, xjson_obj_t *pFindObj, xbo
 
     if (xstrused(pFlags))
     {
-        if (!bAppend) XArray_Clear(&pCtx->flagArr);
+        if (!bAppend) SMake_ListClear(&pCtx->flagArr);
         SMake_AddTokens(&pCtx->flagArr, XSTR_SPACE, pFlags);
     }
 
     if (xstrused(pLibs))
     {
-        if (!bAppend) XArray_Clear(&pCtx->libArr);
+        if (!bAppend) SMake_ListClear(&pCtx->libArr);
         SMake_AddTokens(&pCtx->libArr, XSTR_SPACE, pLibs);
     }
 
     if (xstrused(pLd))
     {
-        if (!bAppend) XArray_Clear(&pCtx->ldArr);
+        if (!bAppend) SMake_ListClear(&pCtx->ldArr);
         SMake_AddTokens(&pCtx->ldArr, XSTR_SPACE, pLd);
     }
 
     return XTRUE;
 }
 
+static xbool_t SMake_ParseProfiles(smake_ctx_t *pCtx, xjson_obj_t *pProfilesObj)
+{
+    xarray_t *pObjects = XJSON_GetObjects(pProfilesObj);
+    XASSERT(pObjects, XTRUE);
+
+    size_t i, nUsed = XArray_Used(pObjects);
+    xbool_t bStatus = XTRUE;
+
+    for (i = 0; i < nUsed && bStatus; i++)
+    {
+        xmap_pair_t *pPair = (xmap_pair_t*)XArray_GetData(pObjects, i);
+        if (pPair == NULL || pPair->pData == NULL || !xstrused(pPair->pKey)) continue;
+
+        smake_profile_t *pProfile = SMake_ProfileNew(pCtx, pPair->pKey);
+        if (pProfile == NULL)
+        {
+            bStatus = XFALSE;
+            break;
+        }
+
+        xjson_obj_t *pValueObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "flags");
+        if (pValueObj != NULL) SMake_AddTokens(&pProfile->flagArr, XSTR_SPACE, XJSON_GetString(pValueObj));
+
+        pValueObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "libs");
+        if (pValueObj != NULL) SMake_AddTokens(&pProfile->libArr, XSTR_SPACE, XJSON_GetString(pValueObj));
+
+        pValueObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "ldLibs");
+        if (pValueObj != NULL) SMake_AddTokens(&pProfile->ldArr, XSTR_SPACE, XJSON_GetString(pValueObj));
+
+        pValueObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "ldFlags");
+        if (pValueObj != NULL) xstrncpy(pProfile->sLDFlags, sizeof(pProfile->sLDFlags), XJSON_GetString(pValueObj));
+    }
+
+    XArray_Destroy(pObjects);
+    return bStatus;
+}
+
 int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[])
 {
     int nChar = 0;
-    while ((nChar = getopt(argc, argv, "o:s:c:e:b:i:f:g:l:p:v:L:V1:I1:d1:j1:w1:x1:h1")) != -1)
+    long nValue = 0;
+    while ((nChar = getopt(argc, argv, "a:o:O:s:c:C1:e:b:i:f:g:G:k:l:p:P:t:T:u:v:L:V1:I1:M1:d1:j1:m1:n1:w1:W1:x1:z1:F1:N1:R1:r1:h1")) != -1)
     {
         switch (nChar)
         {
@@ -252,6 +349,10 @@ int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[])
             case 'c':
                 xstrncpy(pCtx->sConfig, sizeof(pCtx->sConfig), optarg);
                 break;
+            case 'C':
+                pCtx->nArgOptions |= SMAKE_ARG_COMPDB;
+                pCtx->bCompDB = XTRUE;
+                break;
             case 'b':
                 SMake_CopyPath(pCtx->sBinaryDst, sizeof(pCtx->sBinaryDst), optarg);
                 break;
@@ -261,6 +362,10 @@ int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[])
             case 'g':
                 xstrncpy(pCtx->sCompiler, sizeof(pCtx->sCompiler), optarg);
                 break;
+            case 'G':
+                pCtx->nArgOptions |= SMAKE_ARG_BACKEND;
+                if (!SMake_SetBackend(pCtx, optarg)) return XFALSE;
+                break;
             case 'e':
                 SMake_AddTokens(&pCtx->excludes, ":", optarg);
                 break;
@@ -276,12 +381,57 @@ int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[])
             case 'p':
                 xstrncpy(pCtx->sName, sizeof(pCtx->sName), optarg);
                 break;
+            case 'a':
+                pCtx->nArgOptions |= SMAKE_ARG_LAUNCHER;
+                SMake_SetLauncher(pCtx, optarg);
+                break;
+            case 'T':
+                pCtx->nArgOptions |= SMAKE_ARG_LTO;
+                if (!SMake_SetLto(pCtx, optarg)) return XFALSE;
+                break;
+            case 'k':
+                pCtx->nArgOptions |= SMAKE_ARG_LINKER;
+                SMake_SetLinker(pCtx, optarg);
+                break;
+            case 't':
+                pCtx->nArgOptions |= SMAKE_ARG_THREADS;
+                if (!SMake_ParseNumber(optarg, &nValue))
+                {
+                    xloge("Invalid scan thread count: %s", optarg);
+                    return XFALSE;
+                }
+
+                if (!SMake_SetScanThreads(pCtx, nValue)) return XFALSE;
+                break;
+            case 'u':
+                pCtx->nArgOptions |= SMAKE_ARG_UNITY;
+                if (!SMake_ParseNumber(optarg, &nValue))
+                {
+                    xloge("Invalid unity batch size: %s", optarg);
+                    return XFALSE;
+                }
+
+                if (!SMake_SetUnitySize(pCtx, nValue)) return XFALSE;
+                break;
+            case 'P':
+                pCtx->nArgOptions |= SMAKE_ARG_PCH;
+                if (!SMake_ParseNumber(optarg, &nValue))
+                {
+                    xloge("Invalid precompiled header count: %s", optarg);
+                    return XFALSE;
+                }
+
+                if (!SMake_SetPchHeaders(pCtx, nValue)) return XFALSE;
+                break;
             case 'v':
                 pCtx->nVerbose = atoi(optarg);
                 break;
             case 'w':
                 pCtx->bOverwrite = XTRUE;
                 break;
+            case 'W':
+                pCtx->bWatch = XTRUE;
+                break;
             case 'd':
                 pCtx->bVPath = XTRUE;
                 break;
@@ -291,6 +441,38 @@ int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[])
             case 'j':
                 pCtx->bWriteCfg = XTRUE;
                 break;
+            case 'n':
+                pCtx->nArgOptions |= SMAKE_ARG_CACHE;
+                pCtx->bUseCache = XFALSE;
+                break;
+            case 'F':
+                pCtx->bFindRefresh = XTRUE;
+                break;
+            case 'M':
+                pCtx->nArgOptions |= SMAKE_ARG_DEPENDS;
+                pCtx->bDepends = XFALSE;
+                break;
+            case 'm':
+                pCtx->nArgOptions |= SMAKE_ARG_MIRROR;
+                pCtx->bMirror = XTRUE;
+                break;
+            case 'z':
+                pCtx->nArgOptions |= SMAKE_ARG_SECTIONS;
+                pCtx->bGcSections = XTRUE;
+                break;
+            case 'N':
+                pCtx->bMinIncludes = XTRUE;
+                break;
+            case 'R':
+                pCtx->bTimeTrace = XTRUE;
+                break;
+            case 'r':
+                pCtx->bReport = XTRUE;
+                break;
+            case 'O':
+                xstrncpy(pCtx->sReportDir, sizeof(pCtx->sReportDir), optarg);
+                pCtx->bReport = XTRUE;
+                break;
             case 'I':
                 pCtx->bInitProj = XTRUE;
                 break;
@@ -307,6 +489,82 @@ int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[])
     return XTRUE;
 }
 
+static void SMake_ApplyFind(smake_ctx_t *pCtx, xjson_obj_t *pResultObj)
+{
+    xjson_obj_t *pAppendObj = XJSON_GetObject(pResultObj, "append");
+    if (pAppendObj != NULL) SMake_AddFindObject(pCtx, pAppendObj, XTRUE);
+
+    xjson_obj_t *pSetObj = XJSON_GetObject(pResultObj, "set");
+    if (pSetObj != NULL) SMake_AddFindObject(pCtx, pSetObj, XFALSE);
+}
+
+static xbool_t SMake_ParseFind(smake_ctx_t *pCtx, xjson_obj_t *pFindObj)
+{
+    xarray_t *pObjects = XJSON_GetObjects(pFindObj);
+    XASSERT_RET(pObjects, XTRUE);
+
+    size_t i, nUsed = XArray_Used(pObjects);
+    smake_find_t *pFinds = (smake_find_t*)calloc(nUsed ? nUsed : 1, sizeof(smake_find_t));
+
+    if (pFinds == NULL)
+    {
+        xloge("Failed to allocate memory for find entries: %s", XSTRERR);
+        XArray_Destroy(pObjects);
+        return XFALSE;
+    }
+
+    for (i = 0; i < nUsed; i++)
+    {
+        xmap_pair_t *pPair = (xmap_pair_t*)XArray_GetData(pObjects, i);
+        if (pPair == NULL || pPair->pData == NULL|| !xstrused(pPair->pKey)) continue;
+
+        xjson_obj_t *pFoundObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "found");
+        xjson_obj_t *pNotFoundObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "notFound");
+        xjson_obj_t *pPkgObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "pkg");
+        if (pFoundObj == NULL && pNotFoundObj == NULL && pPkgObj == NULL) continue;
+
+        smake_find_t *pFinder = &pFinds[i];
+        pFinder->pFindStr = pPair->pKey;
+
+        xjson_obj_t *pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "path");
+        pFinder->pPath = pFindOptObj != NULL ? XJSON_GetString(pFindOptObj) : NULL;
+
+        pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "thisPathOnly");
+        pFinder->bThisPathOnly = pFindOptObj != NULL ? XJSON_GetBool(pFindOptObj) : XFALSE;
+
+        pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "insensitive");
+        pFinder->bInsensitive = pFindOptObj != NULL ? XJSON_GetBool(pFindOptObj) : XTRUE;
+
+        pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "recursive");
+        pFinder->bRecursive = pFindOptObj != NULL ? XJSON_GetBool(pFindOptObj) : XTRUE;
+
+        pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "timeout");
+        pFinder->nTimeout = pFindOptObj != NULL ? XJSON_GetInt(pFindOptObj) : 0;
+    }
+
+    /* Entries are searched together, results are applied in config order */
+    xbool_t bStatus = SMake_FindAll(pCtx, pFinds, nUsed);
+
+    for (i = 0; bStatus && i < nUsed; i++)
+    {
+        xmap_pair_t *pPair = (xmap_pair_t*)XArray_GetData(pObjects, i);
+        if (pFinds[i].pFindStr == NULL) continue;
+
+        xjson_obj_t *pFoundObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "found");
+        xjson_obj_t *pNotFoundObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "notFound");
+        SMake_ApplyFind(pCtx, pFinds[i].nStatus == XSTDOK ? pFoundObj : pNotFoundObj);
+
+        /* Flags of the found library come from its pkg-config modules */
+        xjson_obj_t *pPkgObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "pkg");
+        if (pPkgObj != NULL && pFinds[i].nStatus == XSTDOK)
+            SMake_PkgResolve(&pCtx->pkgCache, XJSON_GetString(pPkgObj), &pCtx->flagArr, &pCtx->libArr);
+    }
+
+    XArray_Destroy(pObjects);
+    free(pFinds);
+    return bStatus;
+}
+
 int SMake_ParseConfig(smake_ctx_t *pCtx)
 {
     XASSERT_RET(!pCtx->bWriteCfg, XTRUE);
@@ -359,7 +617,7 @@ int SMake_ParseConfig(smake_ctx_t *pCtx)
                 if (pValueObj != NULL)
                 {
                     const char *pExcludeStr = XJSON_GetString(pValueObj);
-                    SMake_AddToArray(&pCtx->excludes, "%s", pExcludeStr);
+                    SMake_AddToList(&pCtx->excludes, "%s", pExcludeStr);
                 }
             }
         }
@@ -386,57 +644,11 @@ int SMake_ParseConfig(smake_ctx_t *pCtx)
         }
 
         xjson_obj_t *pFindObj = XJSON_GetObject(pBuildObj, "find");
-        if (pFindObj != NULL)
+        if (pFindObj != NULL && !SMake_ParseFind(pCtx, pFindObj))
         {
-            xarray_t *pObjects = XJSON_GetObjects(pFindObj);
-            if (pObjects != NULL)
-            {
-                size_t i, nUsed = XArray_Used(pObjects);
-                for (i = 0; i < nUsed; i++)
-                {
-                    xmap_pair_t *pPair = (xmap_pair_t*)XArray_GetData(pObjects, i);
-                    if (pPair == NULL || pPair->pData == NULL|| !xstrused(pPair->pKey)) continue;
-
-                    xjson_obj_t *pFoundObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "found");
-                    xjson_obj_t *pNotFoundObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "notFound");
-                    if (pFoundObj == NULL && pNotFoundObj == NULL) continue;
-
-                    smake_find_t finder;
-                    finder.pFindStr = pPair->pKey;
-
-                    xjson_obj_t *pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "path");
-                    finder.pPath = pFindOptObj != NULL ? XJSON_GetString(pFindOptObj) : NULL;
-
-                    pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "thisPathOnly");
-                    finder.bThisPathOnly = pFindOptObj != NULL ? XJSON_GetBool(pFindOptObj) : XFALSE;
-
-                    pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "insensitive");
-                    finder.bInsensitive = pFindOptObj != NULL ? XJSON_GetBool(pFindOptObj) : XTRUE;
-
-                    pFindOptObj = XJSON_GetObject((xjson_obj_t*)pPair->pData, "recursive");
-                    finder.bRecursive = pFindOptObj != NULL ? XJSON_GetBool(pFindOptObj) : XTRUE;
-
-                    XSTATUS nStatus = SMake_FindLibs(pCtx, &finder);
-                    if (nStatus == XSTDOK)
-                    {
-                        xjson_obj_t *pAppendObj = XJSON_GetObject(pFoundObj, "append");
-                        if (pAppendObj != NULL) SMake_AddFindObject(pCtx, pAppendObj, XTRUE);
-
-                        xjson_obj_t *pSetObj = XJSON_GetObject(pFoundObj, "set");
-                        if (pSetObj != NULL) SMake_AddFindObject(pCtx, pSetObj, XFALSE);
-                    }
-                    else
-                    {
-                        xjson_obj_t *pAppendObj = XJSON_GetObject(pNotFoundObj, "append");
-                        if (pAppendObj != NULL) SMake_AddFindObject(pCtx, pAppendObj, XTRUE);
-
-                        xjson_obj_t *pSetObj = XJSON_GetObject(pNotFoundObj, "set");
-                        if (pSetObj != NULL) SMake_AddFindObject(pCtx, pSetObj, XFALSE);
-                    }
-                }
-
-                XArray_Destroy(pObjects);
-            }
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
         }
 
         pValueObj = XJSON_GetObject(pBuildObj, "name");
@@ -463,6 +675,106 @@ int SMake_ParseConfig(smake_ctx_t *pCtx)
         pValueObj = XJSON_GetObject(pBuildObj, "cxx");
         if (pValueObj != NULL) pCtx->bIsCPP = XJSON_GetBool(pValueObj);
 
+        pValueObj = XJSON_GetObject(pBuildObj, "scanThreads");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_THREADS) && !SMake_SetScanThreads(pCtx, XJSON_GetInt(pValueObj)))
+        {
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        pValueObj = XJSON_GetObject(pBuildObj, "cache");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_CACHE)) pCtx->bUseCache = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "depends");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_DEPENDS)) pCtx->bDepends = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "mirror");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_MIRROR)) pCtx->bMirror = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "unity");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_UNITY) && !SMake_SetUnitySize(pCtx, XJSON_GetInt(pValueObj)))
+        {
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        pValueObj = XJSON_GetObject(pBuildObj, "launcher");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_LAUNCHER))
+            SMake_SetLauncher(pCtx, XJSON_GetString(pValueObj));
+
+        pValueObj = XJSON_GetObject(pBuildObj, "linker");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_LINKER))
+            SMake_SetLinker(pCtx, XJSON_GetString(pValueObj));
+
+        pValueObj = XJSON_GetObject(pBuildObj, "gcSections");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_SECTIONS)) pCtx->bGcSections = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "minIncludes");
+        if (pValueObj != NULL && !pCtx->bMinIncludes) pCtx->bMinIncludes = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "timeTrace");
+        if (pValueObj != NULL && !pCtx->bTimeTrace) pCtx->bTimeTrace = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "pgoTrain");
+        if (pValueObj != NULL) xstrncpy(pCtx->sPgoTrain, sizeof(pCtx->sPgoTrain), XJSON_GetString(pValueObj));
+
+        pValueObj = XJSON_GetObject(pBuildObj, "pch");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_PCH) && !SMake_SetPchHeaders(pCtx, XJSON_GetInt(pValueObj)))
+        {
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        pValueObj = XJSON_GetObject(pBuildObj, "unityPerDir");
+        if (pValueObj != NULL) pCtx->bUnityPerDir = XJSON_GetBool(pValueObj);
+
+        xjson_obj_t *pUnityExclArr = XJSON_GetObject(pBuildObj, "unityExcludes");
+        if (pUnityExclArr != NULL)
+        {
+            size_t i, nLength = XJSON_GetArrayLength(pUnityExclArr);
+            for (i = 0; i < nLength; i++)
+            {
+                pValueObj = XJSON_GetArrayItem(pUnityExclArr, i);
+                if (pValueObj != NULL)
+                {
+                    const char *pExcludeStr = XJSON_GetString(pValueObj);
+                    SMake_AddToList(&pCtx->unityExcludes, "%s", pExcludeStr);
+                }
+            }
+        }
+
+        pValueObj = XJSON_GetObject(pBuildObj, "compileCommands");
+        if (pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_COMPDB)) pCtx->bCompDB = XJSON_GetBool(pValueObj);
+
+        pValueObj = XJSON_GetObject(pBuildObj, "backend");
+        const char *pBackend = pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_BACKEND) ? XJSON_GetString(pValueObj) : NULL;
+        if (pBackend != NULL && !SMake_SetBackend(pCtx, pBackend))
+        {
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        pValueObj = XJSON_GetObject(pBuildObj, "lto");
+        const char *pLto = pValueObj != NULL && !(pCtx->nArgOptions & SMAKE_ARG_LTO) ? XJSON_GetString(pValueObj) : NULL;
+        if (pLto != NULL && !SMake_SetLto(pCtx, pLto))
+        {
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
+        }
+
+        xjson_obj_t *pProfilesObj = XJSON_GetObject(pBuildObj, "profiles");
+        if (pProfilesObj != NULL && !SMake_ParseProfiles(pCtx, pProfilesObj))
+        {
+            XJSON_Destroy(&json);
+            free(pBuffer);
+            return XFALSE;
+        }
+
         xjson_obj_t *pSourceArr = XJSON_GetObject(pBuildObj, "sources");
         if (pSourceArr != NULL)
         {
@@ -521,12 +833,47 @@ int SMake_ParseConfig(smake_ctx_t *pCtx)
     return XTRUE;
 }
 
+static void SMake_AddProfilesObject(smake_ctx_t *pCtx, xjson_obj_t *pBuildObj)
+{
+    size_t i, nProfiles = XArray_Used(&pCtx->profiles);
+    XASSERT_VOID_RET(nProfiles);
+
+    xjson_obj_t *pProfilesObj = XJSON_NewObject(NULL, "profiles", XFALSE);
+    XASSERT_VOID_RET(pProfilesObj);
+
+    for (i = 0; i < nProfiles; i++)
+    {
+        smake_profile_t *pProfile = (smake_profile_t*)XArray_GetData(&pCtx->profiles, i);
+        if (pProfile == NULL) continue;
+
+        xjson_obj_t *pProfileObj = XJSON_NewObject(NULL, pProfile->sName, XFALSE);
+        if (pProfileObj == NULL) continue;
+
+        xbyte_buffer_t flags, libs, ld;
+        const char *pFlags = SMake_SerializeArray(&pProfile->flagArr.array, XSTR_SPACE, &flags);
+        const char *pLibs = SMake_SerializeArray(&pProfile->libArr.array, XSTR_SPACE, &libs);
+        const char *pLd = SMake_SerializeArray(&pProfile->ldArr.array, XSTR_SPACE, &ld);
+
+        if (xstrused(pFlags)) XJSON_AddObject(pProfileObj, XJSON_NewString(NULL, "flags", pFlags));
+        if (xstrused(pLibs)) XJSON_AddObject(pProfileObj, XJSON_NewString(NULL, "libs", pLibs));
+        if (xstrused(pLd)) XJSON_AddObject(pProfileObj, XJSON_NewString(NULL, "ldLibs", pLd));
+        if (xstrused(pProfile->sLDFlags)) XJSON_AddObject(pProfileObj, XJSON_NewString(NULL, "ldFlags", pProfile->sLDFlags));
+        XJSON_AddObject(pProfilesObj, pProfileObj);
+
+        XByteBuffer_Clear(&flags);
+        XByteBuffer_Clear(&libs);
+        XByteBuffer_Clear(&ld);
+    }
+
+    XJSON_AddObject(pBuildObj, pProfilesObj);
+}
+
 int SMake_WriteConfig(smake_ctx_t *pCtx)
 {
     XASSERT_RET((pCtx->bWriteCfg || pCtx->bInitProj), XSTDOK);
     const char *pPath = xstrused(pCtx->sConfig) ? pCtx->sConfig : SMAKE_CFG_FILE;
 
-    if (XPath_Exists(pPath) && !pCtx->bOverwrite)
+    if (XPath_Exists(pPath) && !pCtx->bOverwrite && !pCtx->bRegenerate)
     {
         xlogw("SMake config already exists: %s", pPath);
 
@@ -553,34 +900,31 @@ int SMake_WriteConfig(smake_ctx_t *pCtx)
             if (xstrused(pCtx->sInjectPath)) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "inject", pCtx->sInjectPath));
             if (xstrused(pCtx->sLDFlags)) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "ldFlags", pCtx->sLDFlags));
 
-            if (XArray_Used(&pCtx->flagArr))
+            if (XArray_Used(&pCtx->flagArr.array))
             {
-                char sFlags[XSTR_MID];
-                sFlags[0] = XSTR_NUL;
-
-                SMake_SerializeArray(&pCtx->flagArr, XSTR_SPACE, sFlags, sizeof(sFlags));
-                XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "flags", sFlags));
+                xbyte_buffer_t buffer;
+                const char *pFlags = SMake_SerializeArray(&pCtx->flagArr.array, XSTR_SPACE, &buffer);
+                if (pFlags != NULL) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "flags", pFlags));
+                XByteBuffer_Clear(&buffer);
             }
 
-            if (XArray_Used(&pCtx->libArr))
+            if (XArray_Used(&pCtx->libArr.array))
             {
-                char sLibs[XSTR_MID];
-                sLibs[0] = XSTR_NUL;
-
-                SMake_SerializeArray(&pCtx->libArr, XSTR_SPACE, sLibs, sizeof(sLibs));
-                XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "libs", sLibs));
+                xbyte_buffer_t buffer;
+                const char *pLibs = SMake_SerializeArray(&pCtx->libArr.array, XSTR_SPACE, &buffer);
+                if (pLibs != NULL) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "libs", pLibs));
+                XByteBuffer_Clear(&buffer);
             }
 
-            if (XArray_Used(&pCtx->ldArr))
+            if (XArray_Used(&pCtx->ldArr.array))
             {
-                char sLd[XSTR_MID];
-                sLd[0] = XSTR_NUL;
-
-                SMake_SerializeArray(&pCtx->ldArr, XSTR_SPACE, sLd, sizeof(sLd));
-                XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "ldLibs", sLd));
+                xbyte_buffer_t buffer;
+                const char *pLd = SMake_SerializeArray(&pCtx->ldArr.array, XSTR_SPACE, &buffer);
+                if (pLd != NULL) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "ldLibs", pLd));
+                XByteBuffer_Clear(&buffer);
             }
 
-            size_t i, nIncludes = XArray_Used(&pCtx->includes);
+            size_t i, nIncludes = XArray_Used(&pCtx->includes.array);
             if (nIncludes)
             {
                 xjson_obj_t *pIncludesArr = XJSON_NewArray(NULL, "includes", XFALSE);
@@ -588,7 +932,7 @@ int SMake_WriteConfig(smake_ctx_t *pCtx)
                 {
                     for (i = 0; i < nIncludes; i++)
                     {
-                        const char *pIncl = (const char *)XArray_GetData(&pCtx->includes, i);
+                        const char *pIncl = (const char *)XArray_GetData(&pCtx->includes.array, i);
                         if (!xstrused(pIncl)) continue;
 
                         XJSON_AddObject(pIncludesArr, XJSON_NewString(NULL, NULL, pIncl));
@@ -598,7 +942,7 @@ int SMake_WriteConfig(smake_ctx_t *pCtx)
                 }
             }
 
-            size_t nExcludes = XArray_Used(&pCtx->excludes);
+            size_t nExcludes = XArray_Used(&pCtx->excludes.array);
             if (nExcludes)
             {
                 xjson_obj_t *pExcludesArr = XJSON_NewArray(NULL, "excludes", XFALSE);
@@ -606,7 +950,7 @@ int SMake_WriteConfig(smake_ctx_t *pCtx)
                 {
                     for (i = 0; i < nExcludes; i++)
                     {
-                        const char *pExcl = (const char *)XArray_GetData(&pCtx->excludes, i);
+                        const char *pExcl = (const char *)XArray_GetData(&pCtx->excludes.array, i);
                         if (!xstrused(pExcl)) continue;
 
                         XJSON_AddObject(pExcludesArr, XJSON_NewString(NULL, NULL, pExcl));
@@ -616,9 +960,47 @@ int SMake_WriteConfig(smake_ctx_t *pCtx)
                 }
             }
 
+            size_t nUnityExcludes = XArray_Used(&pCtx->unityExcludes.array);
+            if (nUnityExcludes)
+            {
+                xjson_obj_t *pUnityExclArr = XJSON_NewArray(NULL, "unityExcludes", XFALSE);
+                if (pUnityExclArr != NULL)
+                {
+                    for (i = 0; i < nUnityExcludes; i++)
+                    {
+                        const char *pExcl = (const char *)XArray_GetData(&pCtx->unityExcludes.array, i);
+                        if (!xstrused(pExcl)) continue;
+
+                        XJSON_AddObject(pUnityExclArr, XJSON_NewString(NULL, NULL, pExcl));
+                    }
+
+                    XJSON_AddObject(pBuildObj, pUnityExclArr);
+                }
+            }
+
+            SMake_AddProfilesObject(pCtx, pBuildObj);
+
             XJSON_AddObject(pBuildObj, XJSON_NewInt(NULL, "verbose", pCtx->nVerbose));
             XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "overwrite", pCtx->bOverwrite));
             XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "cxx", pCtx->bIsCPP));
+            if (pCtx->nScanThreads != 1) XJSON_AddObject(pBuildObj, XJSON_NewInt(NULL, "scanThreads", pCtx->nScanThreads));
+            if (!pCtx->bUseCache) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "cache", pCtx->bUseCache));
+            if (!pCtx->bDepends) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "depends", pCtx->bDepends));
+            if (pCtx->bMirror) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "mirror", pCtx->bMirror));
+            if (pCtx->nUnitySize) XJSON_AddObject(pBuildObj, XJSON_NewInt(NULL, "unity", pCtx->nUnitySize));
+            if (pCtx->bUnityPerDir) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "unityPerDir", pCtx->bUnityPerDir));
+            if (pCtx->bAutoLauncher) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "launcher", "auto"));
+            else if (xstrused(pCtx->sLauncher)) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "launcher", pCtx->sLauncher));
+            if (pCtx->nLto) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "lto", pCtx->nLto == SMAKE_LTO_THIN ? "thin" : "full"));
+            if (xstrused(pCtx->sPgoTrain)) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "pgoTrain", pCtx->sPgoTrain));
+            if (pCtx->bAutoLinker) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "linker", "auto"));
+            else if (xstrused(pCtx->sLinker)) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "linker", pCtx->sLinker));
+            if (pCtx->bGcSections) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "gcSections", pCtx->bGcSections));
+            if (pCtx->bMinIncludes) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "minIncludes", pCtx->bMinIncludes));
+            if (pCtx->bTimeTrace) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "timeTrace", pCtx->bTimeTrace));
+            if (pCtx->nPchHeaders) XJSON_AddObject(pBuildObj, XJSON_NewInt(NULL, "pch", pCtx->nPchHeaders));
+            if (pCtx->bCompDB) XJSON_AddObject(pBuildObj, XJSON_NewBool(NULL, "compileCommands", pCtx->bCompDB));
+            if (pCtx->nBackend == SMAKE_BACKEND_NINJA) XJSON_AddObject(pBuildObj, XJSON_NewString(NULL, "backend", "ninja"));
             XJSON_AddObject(pRootObj, pBuildObj);
         }
 
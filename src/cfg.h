@@ -17,12 +17,19 @@
 extern "C" {
 #endif
 
-xbool_t SMake_SerializeIncludes(xarray_t *pArr, const char *pDlmt, char *pOutput, size_t nSize);
-xbool_t SMake_SerializeArray(xarray_t *pArr, const char *pDlmt, char *pOutput, size_t nSize);
+/* Output buffer must be cleared by the caller, returns NULL if allocation fails */
+const char* SMake_SerializeIncludes(xarray_t *pArr, const char *pDlmt, xbyte_buffer_t *pOutput);
+const char* SMake_SerializeArray(xarray_t *pArr, const char *pDlmt, xbyte_buffer_t *pOutput);
 
-xbool_t SMake_AddToArray(xarray_t *pArr, const char *pFmt, ...);
-xbool_t SMake_AddTokens(xarray_t *pArr, const char *pDlmt, const char *pInput);
+xbool_t SMake_AddTokens(smake_list_t *pList, const char *pDlmt, const char *pInput);
 xbool_t SMake_IsExcluded(smake_ctx_t *pCtx, const char *pPath);
+xbool_t SMake_SetBackend(smake_ctx_t *pCtx, const char *pName);
+void SMake_SetLauncher(smake_ctx_t *pCtx, const char *pName);
+xbool_t SMake_SetLto(smake_ctx_t *pCtx, const char *pType);
+void SMake_SetLinker(smake_ctx_t *pCtx, const char *pName);
+xbool_t SMake_SetScanThreads(smake_ctx_t *pCtx, long nThreads);
+xbool_t SMake_SetUnitySize(smake_ctx_t *pCtx, long nSize);
+xbool_t SMake_SetPchHeaders(smake_ctx_t *pCtx, long nHeaders);
 
 int SMake_ParseArgs(smake_ctx_t *pCtx, int argc, char *argv[]);
 int SMake_ParseConfig(smake_ctx_t *pCtx);
@@ -0,0 +1,147 @@
+/*!
+ *  @file smake/src/compdb.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Generate compile_commands.json from the project.
+ */
+
+#include "stdinc.h"
+#include "compdb.h"
+#include "cfg.h"
+
+/* Same flags as CFLAGS of the Makefile, joined and not split again, so quoted values stay whole */
+static const char* SMake_GetCompileFlags(smake_ctx_t *pCtx, const char *pDirectory, xbyte_buffer_t *pOutput)
+{
+    xbyte_buffer_t includes, flags;
+    const char *pIncludes = SMake_SerializeIncludes(&pCtx->includes.array, XSTR_SPACE, &includes);
+    const char *pFlags = SMake_SerializeArray(&pCtx->flagArr.array, XSTR_SPACE, &flags);
+    int nStatus = pIncludes != NULL && pFlags != NULL ? XSTDNON : XSTDERR;
+
+    XByteBuffer_Init(pOutput, SMAKE_LINE_MAX, XFALSE);
+    if (nStatus >= 0 && xstrused(pFlags)) nStatus = XByteBuffer_AddFmt(pOutput, " %s", pFlags);
+    if (nStatus >= 0 && xstrused(pIncludes)) nStatus = XByteBuffer_AddFmt(pOutput, " %s", pIncludes);
+
+    /* Makefile takes the directory from $(CURDIR), commands run in the same one */
+    if (nStatus >= 0 && xstrused(pCtx->sLauncher)) nStatus = XByteBuffer_AddFmt(pOutput, " -ffile-prefix-map=%s=.", pDirectory);
+    if (nStatus >= 0 && pCtx->nLto) nStatus = XByteBuffer_AddFmt(pOutput, " %s", SMake_GetLtoFlags(pCtx));
+    if (nStatus >= 0 && pCtx->bGcSections) nStatus = XByteBuffer_AddFmt(pOutput, " %s", SMAKE_SECTION_FLAGS);
+
+    XByteBuffer_Clear(&includes);
+    XByteBuffer_Clear(&flags);
+
+    if (nStatus < 0)
+    {
+        xloge("Failed to serialize compile flags: %s", XSTRERR);
+        XByteBuffer_Clear(pOutput);
+        return NULL;
+    }
+
+    return pOutput->nUsed ? (const char*)pOutput->pData : XSTR_EMPTY;
+}
+
+static xjson_obj_t* SMake_NewCommand(smake_ctx_t *pCtx, const SMakeFile *pObj, const char *pDirectory, const char *pFlags, xbool_t bShared)
+{
+    xjson_obj_t *pCmdObj = XJSON_NewObject(NULL, NULL, XFALSE);
+    char *pSource = xstracpy("%s/%s", pObj->pSource->pDir->pPath, pObj->pSource->pName);
+    char *pOutput = xstracpy("%s/%.*s.o", pCtx->sOutDir, (int)pObj->nLength, pObj->pName);
+
+    /* Shell command line like the one make runs, tools split it the same way */
+    const char *pCompiler = xstrused(pCtx->sCompiler) ? pCtx->sCompiler : (pCtx->bIsCPP ? "c++" : "cc");
+    char *pCommand = pSource != NULL && pOutput != NULL ? xstracpy("%s%s%s -c -o %s %s", pCompiler,
+        pFlags, bShared ? " -fPIC" : XSTR_EMPTY, pOutput, pSource) : NULL;
+
+    if (pCmdObj == NULL || pCommand == NULL)
+    {
+        xloge("Failed to allocate memory for compile command: %s", XSTRERR);
+        XJSON_FreeObject(pCmdObj);
+        free(pCommand);
+        free(pSource);
+        free(pOutput);
+        return NULL;
+    }
+
+    XJSON_AddObject(pCmdObj, XJSON_NewString(NULL, "directory", pDirectory));
+    XJSON_AddObject(pCmdObj, XJSON_NewString(NULL, "file", pSource));
+    XJSON_AddObject(pCmdObj, XJSON_NewString(NULL, "output", pOutput));
+    XJSON_AddObject(pCmdObj, XJSON_NewString(NULL, "command", pCommand));
+
+    free(pCommand);
+    free(pSource);
+    free(pOutput);
+    return pCmdObj;
+}
+
+xbool_t SMake_WriteCompDB(smake_ctx_t *pCtx)
+{
+    if (!pCtx->bCompDB) return XTRUE;
+
+    char sPath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+    if (!SMake_CheckOutput(pCtx, SMAKE_COMPDB_FILE, sPath, sizeof(sPath))) return XFALSE;
+
+    /* Paths in the commands are relative to the working directory of make */
+    char sDirectory[SMAKE_PATH_MAX];
+    if (getcwd(sDirectory, sizeof(sDirectory)) == NULL)
+    {
+        xloge("Failed to read current directory: %s", XSTRERR);
+        return XFALSE;
+    }
+
+    xbyte_buffer_t flags;
+    const char *pFlags = SMake_GetCompileFlags(pCtx, sDirectory, &flags);
+    if (pFlags == NULL) return XFALSE;
+
+    xjson_obj_t *pRootObj = XJSON_NewArray(NULL, NULL, XFALSE);
+    if (pRootObj == NULL)
+    {
+        xloge("Failed to allocate memory for JSON object: %s", XSTRERR);
+        XByteBuffer_Clear(&flags);
+        return XFALSE;
+    }
+
+    xbool_t bShared = strstr(pCtx->sName, ".a") == NULL &&
+                      strstr(pCtx->sName, ".so") != NULL ? XTRUE : XFALSE;
+
+    /* Sources compiled in unity batches are still listed, editors look up commands by file */
+    xarray_t *pObjArr = XArray_Used(&pCtx->srcObjArr) ? &pCtx->srcObjArr : &pCtx->objArr;
+    size_t i, nObjs = XArray_Used(pObjArr);
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(pObjArr, i);
+        if (pObj == NULL || pObj->pSource == NULL) continue;
+
+        xjson_obj_t *pCmdObj = SMake_NewCommand(pCtx, pObj, sDirectory, pFlags, bShared);
+        if (pCmdObj == NULL)
+        {
+            XJSON_FreeObject(pRootObj);
+            XByteBuffer_Clear(&flags);
+            return XFALSE;
+        }
+
+        XJSON_AddObject(pRootObj, pCmdObj);
+    }
+
+    /* Writer allocates the output, commands are indented by 4 spaces */
+    xjson_writer_t linter;
+    XJSON_InitWriter(&linter, NULL, NULL, 1);
+    linter.nTabSize = 4;
+    xbool_t bStatus = XTRUE;
+
+    if (!XJSON_WriteObject(pRootObj, &linter))
+    {
+        xloge("Failed to serialize compilation database: %s", sPath);
+        bStatus = XFALSE;
+    }
+    else
+    {
+        bStatus = SMake_UpdateFile(sPath, linter.pData, linter.nLength);
+        XJSON_DestroyWriter(&linter);
+    }
+
+    if (bStatus) xlogd("Generated compilation database: %s (%zu commands)", sPath, nObjs);
+    XJSON_FreeObject(pRootObj);
+    XByteBuffer_Clear(&flags);
+    return bStatus;
+}
@@ -0,0 +1,28 @@
+/*!
+ *  @file smake/src/compdb.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Generate compile_commands.json from the project.
+ */
+
+#ifndef __SMAKE_COMPDB_H__
+#define __SMAKE_COMPDB_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+#define SMAKE_COMPDB_FILE "compile_commands.json"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_WriteCompDB(smake_ctx_t *pCtx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_COMPDB_H__ */
@@ -0,0 +1,288 @@
+/*!
+ *  @file smake/src/entry.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Locate main() definition in the source files.
+ *
+ * Sources are mapped into memory and "main" candidates are found with
+ * memchr(), which is vectorized by the C library. Most candidates are
+ * rejected by looking at the neighbour bytes only (e.g. "domain" or
+ * "main_loop"). The remaining ones are confirmed with a small lexer that
+ * runs forward from the previous candidate and skips comments, string and
+ * character literals, preprocessor lines and "#if 0" blocks. A candidate
+ * is a definition when it is at file scope and its parameter list is
+ * followed by a function body.
+ */
+
+#include <sys/mman.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include "entry.h"
+
+typedef struct SMakeLexer {
+    const char *pData;
+    size_t nSize;
+    size_t nPosit;
+    size_t nDepth;          /* Brace depth, 0 is file scope */
+    size_t nDisabled;       /* Nesting depth inside "#if 0" block */
+    xbool_t bLineStart;     /* Only whitespace since the last newline */
+} smake_lexer_t;
+
+static xbool_t SMake_IsIdent(char cChar)
+{
+    return (isalnum((unsigned char)cChar) || cChar == '_') ? XTRUE : XFALSE;
+}
+
+static size_t SMake_SkipComment(const char *pData, size_t nSize, size_t nPosit)
+{
+    if (pData[nPosit + 1] == '/')
+    {
+        const char *pEnd = (const char*)memchr(&pData[nPosit], '\n', nSize - nPosit);
+        return pEnd != NULL ? (size_t)(pEnd - pData) : nSize;
+    }
+
+    size_t i;
+    for (i = nPosit + 2; i + 1 < nSize; i++)
+        if (pData[i] == '*' && pData[i + 1] == '/') return i + 2;
+
+    return nSize;
+}
+
+static size_t SMake_SkipLiteral(const char *pData, size_t nSize, size_t nPosit)
+{
+    char cQuote = pData[nPosit++];
+
+    while (nPosit < nSize)
+    {
+        char cChar = pData[nPosit++];
+        if (cChar == '\\') nPosit++;
+        else if (cChar == cQuote || cChar == '\n') break;
+    }
+
+    return nPosit < nSize ? nPosit : nSize;
+}
+
+static size_t SMake_SkipSpace(const char *pData, size_t nSize, size_t nPosit)
+{
+    while (nPosit < nSize)
+    {
+        if (isspace((unsigned char)pData[nPosit])) nPosit++;
+        else if (pData[nPosit] == '\\' && nPosit + 1 < nSize && pData[nPosit + 1] == '\n') nPosit += 2;
+        else if (pData[nPosit] == '/' && nPosit + 1 < nSize &&
+                (pData[nPosit + 1] == '/' || pData[nPosit + 1] == '*'))
+            nPosit = SMake_SkipComment(pData, nSize, nPosit);
+        else break;
+    }
+
+    return nPosit;
+}
+
+static xbool_t SMake_IsWord(const char *pData, size_t nSize, size_t nPosit, const char *pWord)
+{
+    size_t nLength = strlen(pWord);
+    if (nPosit + nLength > nSize || strncmp(&pData[nPosit], pWord, nLength)) return XFALSE;
+    return (nPosit + nLength == nSize || !SMake_IsIdent(pData[nPosit + nLength])) ? XTRUE : XFALSE;
+}
+
+/* Handles preprocessor directive at nPosit and returns the end of its line */
+static size_t SMake_Directive(smake_lexer_t *pLexer, size_t nPosit)
+{
+    const char *pData = pLexer->pData;
+    size_t nSize = pLexer->nSize;
+    size_t nName = SMake_SkipSpace(pData, nSize, nPosit + 1);
+
+    if (SMake_IsWord(pData, nSize, nName, "if") ||
+        SMake_IsWord(pData, nSize, nName, "ifdef") ||
+        SMake_IsWord(pData, nSize, nName, "ifndef"))
+    {
+        if (pLexer->nDisabled) pLexer->nDisabled++;
+        else if (SMake_IsWord(pData, nSize, nName, "if"))
+        {
+            size_t nCond = SMake_SkipSpace(pData, nSize, nName + 2);
+            if (SMake_IsWord(pData, nSize, nCond, "0")) pLexer->nDisabled = 1;
+        }
+    }
+    else if (SMake_IsWord(pData, nSize, nName, "endif"))
+    {
+        if (pLexer->nDisabled) pLexer->nDisabled--;
+    }
+    else if (SMake_IsWord(pData, nSize, nName, "else") ||
+             SMake_IsWord(pData, nSize, nName, "elif"))
+    {
+        if (pLexer->nDisabled == 1) pLexer->nDisabled = 0;
+    }
+
+    /* Skip the rest of the line including continuations and comments */
+    while (nPosit < nSize && pData[nPosit] != '\n')
+    {
+        if (pData[nPosit] == '\\' && nPosit + 1 < nSize && pData[nPosit + 1] == '\n') nPosit += 2;
+        else if (pData[nPosit] == '/' && nPosit + 1 < nSize && pData[nPosit + 1] == '*')
+            nPosit = SMake_SkipComment(pData, nSize, nPosit);
+        else if (pData[nPosit] == '"' || pData[nPosit] == '\'')
+            nPosit = SMake_SkipLiteral(pData, nSize, nPosit);
+        else if (pData[nPosit] == '/' && nPosit + 1 < nSize && pData[nPosit + 1] == '/')
+            nPosit = SMake_SkipComment(pData, nSize, nPosit);
+        else nPosit++;
+    }
+
+    return nPosit;
+}
+
+/* Runs the lexer up to nTarget and returns XTRUE if nTarget is in active code */
+static xbool_t SMake_LexTo(smake_lexer_t *pLexer, size_t nTarget)
+{
+    const char *pData = pLexer->pData;
+    size_t nSize = pLexer->nSize;
+    size_t nPosit = pLexer->nPosit;
+
+    while (nPosit < nTarget)
+    {
+        char cChar = pData[nPosit];
+
+        if (cChar == '\n')
+        {
+            pLexer->bLineStart = XTRUE;
+            nPosit++;
+            continue;
+        }
+
+        if (isspace((unsigned char)cChar))
+        {
+            nPosit++;
+            continue;
+        }
+
+        xbool_t bLineStart = pLexer->bLineStart;
+        pLexer->bLineStart = XFALSE;
+
+        if (cChar == '/' && nPosit + 1 < nSize &&
+           (pData[nPosit + 1] == '/' || pData[nPosit + 1] == '*'))
+        {
+            nPosit = SMake_SkipComment(pData, nSize, nPosit);
+            pLexer->bLineStart = bLineStart;
+        }
+        else if (cChar == '#' && bLineStart) nPosit = SMake_Directive(pLexer, nPosit);
+        else if (pLexer->nDisabled)
+        {
+            /* Nothing but directives matter in disabled block */
+            const char *pEnd = (const char*)memchr(&pData[nPosit], '\n', nSize - nPosit);
+            nPosit = pEnd != NULL ? (size_t)(pEnd - pData) : nSize;
+        }
+        else if (cChar == '"' || cChar == '\'') nPosit = SMake_SkipLiteral(pData, nSize, nPosit);
+        else if (cChar == '{') { pLexer->nDepth++; nPosit++; }
+        else if (cChar == '}') { if (pLexer->nDepth) pLexer->nDepth--; nPosit++; }
+        else nPosit++;
+    }
+
+    pLexer->nPosit = nPosit;
+    return (nPosit == nTarget && !pLexer->nDisabled && !pLexer->nDepth) ? XTRUE : XFALSE;
+}
+
+/* Checks that "main" at nPosit is followed by a parameter list and a body */
+static xbool_t SMake_IsDefinition(const char *pData, size_t nSize, size_t nPosit)
+{
+    /* Member functions like "App::main()" are not the entry point */
+    size_t nPrev = nPosit;
+    while (nPrev > 0 && isspace((unsigned char)pData[nPrev - 1])) nPrev--;
+    if (nPrev > 0 && (pData[nPrev - 1] == ':' || pData[nPrev - 1] == '.' ||
+        pData[nPrev - 1] == '>')) return XFALSE;
+
+    nPosit = SMake_SkipSpace(pData, nSize, nPosit + 4);
+    if (nPosit >= nSize || pData[nPosit] != '(') return XFALSE;
+
+    size_t nParens = 0;
+    while (nPosit < nSize)
+    {
+        char cChar = pData[nPosit];
+        if (cChar == '(') nParens++;
+        else if (cChar == ')' && !--nParens) break;
+        else if (cChar == '"' || cChar == '\'')
+        {
+            nPosit = SMake_SkipLiteral(pData, nSize, nPosit);
+            continue;
+        }
+        else if (cChar == '/' || isspace((unsigned char)cChar))
+        {
+            size_t nNext = SMake_SkipSpace(pData, nSize, nPosit);
+            if (nNext != nPosit)
+            {
+                nPosit = nNext;
+                continue;
+            }
+        }
+        else if (cChar == ';' || cChar == '{') return XFALSE;
+
+        nPosit++;
+    }
+
+    if (nPosit >= nSize) return XFALSE;
+    nPosit = SMake_SkipSpace(pData, nSize, nPosit + 1);
+    return (nPosit < nSize && pData[nPosit] == '{') ? XTRUE : XFALSE;
+}
+
+xbool_t SMake_HasMainBuffer(const char *pData, size_t nSize)
+{
+    smake_lexer_t lexer;
+    lexer.bLineStart = XTRUE;
+    lexer.nDisabled = 0;
+    lexer.pData = pData;
+    lexer.nSize = nSize;
+    lexer.nPosit = 0;
+    lexer.nDepth = 0;
+
+    size_t nPosit = 0;
+    while (nPosit + 4 <= nSize)
+    {
+        const char *pFound = (const char*)memchr(&pData[nPosit], 'm', nSize - nPosit - 3);
+        if (pFound == NULL) break;
+
+        size_t nCandidate = (size_t)(pFound - pData);
+        nPosit = nCandidate + 1;
+
+        if (memcmp(pFound, "main", 4) ||
+            (nCandidate > 0 && SMake_IsIdent(pData[nCandidate - 1])) ||
+            (nCandidate + 4 < nSize && SMake_IsIdent(pData[nCandidate + 4])) ||
+            nCandidate < lexer.nPosit) continue;
+
+        if (SMake_LexTo(&lexer, nCandidate) &&
+            SMake_IsDefinition(pData, nSize, nCandidate)) return XTRUE;
+    }
+
+    return XFALSE;
+}
+
+xbool_t SMake_HasMain(const char *pPath)
+{
+    int nFD = open(pPath, O_RDONLY);
+    if (nFD < 0)
+    {
+        xlogw("Failed to open source file: %s (%s)", pPath, XSTRERR);
+        return XFALSE;
+    }
+
+    struct stat fileStat;
+    if (fstat(nFD, &fileStat) < 0 || fileStat.st_size <= 0)
+    {
+        close(nFD);
+        return XFALSE;
+    }
+
+    size_t nSize = (size_t)fileStat.st_size;
+    void *pData = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, nFD, 0);
+    close(nFD);
+
+    if (pData == MAP_FAILED)
+    {
+        xlogw("Failed to map source file: %s (%s)", pPath, XSTRERR);
+        return XFALSE;
+    }
+
+    /* Whole file is read once from the start */
+    madvise(pData, nSize, MADV_SEQUENTIAL);
+
+    xbool_t bHasMain = SMake_HasMainBuffer((const char*)pData, nSize);
+    munmap(pData, nSize);
+    return bHasMain;
+}
@@ -0,0 +1,26 @@
+/*!
+ *  @file smake/src/entry.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Locate main() definition in the source files.
+ */
+
+#ifndef __SMAKE_ENTRY_H__
+#define __SMAKE_ENTRY_H__
+
+#include "stdinc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_HasMainBuffer(const char *pData, size_t nSize);
+xbool_t SMake_HasMain(const char *pPath);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_ENTRY_H__ */
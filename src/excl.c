@@ -0,0 +1,320 @@
+/*!
+ *  @file smake/src/excl.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Compiled index of excluded paths and glob patterns.
+ *
+ * Rules are split into path components and merged into a trie. Literal
+ * components are looked up by hash, so exact paths and directory prefixes
+ * cost one lookup per component of the checked path regardless of how
+ * many rules are loaded. Components with wildcards are matched with
+ * fnmatch() and "**" matches any number of directories. A rule without
+ * a slash that contains a wildcard (e.g. "*.gen.c") matches at any depth.
+ * The scanner does not descend into excluded directories, so excluding a
+ * directory also covers everything inside it.
+ */
+
+#include <fnmatch.h>
+#include "excl.h"
+
+#define SMAKE_EXCL_ACTIVE   32
+#define SMAKE_EXCL_ROOT     "/"
+#define SMAKE_EXCL_ANY      "**"
+
+typedef struct SMakeExclSet {
+    smake_excl_node_t *nodes[SMAKE_EXCL_ACTIVE];
+    smake_excl_node_t **pNodes;
+    size_t nCount;
+    size_t nSize;
+} smake_excl_set_t;
+
+static void SMake_ExclSetInit(smake_excl_set_t *pSet)
+{
+    pSet->pNodes = pSet->nodes;
+    pSet->nSize = SMAKE_EXCL_ACTIVE;
+    pSet->nCount = 0;
+}
+
+static void SMake_ExclSetFree(smake_excl_set_t *pSet)
+{
+    if (pSet->pNodes != pSet->nodes) free(pSet->pNodes);
+    SMake_ExclSetInit(pSet);
+}
+
+static xbool_t SMake_ExclSetAdd(smake_excl_set_t *pSet, smake_excl_node_t *pNode)
+{
+    size_t i;
+    for (i = 0; i < pSet->nCount; i++)
+        if (pSet->pNodes[i] == pNode) return XTRUE;
+
+    if (pSet->nCount >= pSet->nSize)
+    {
+        size_t nSize = pSet->nSize * 2;
+        smake_excl_node_t **pNodes = NULL;
+
+        if (pSet->pNodes == pSet->nodes)
+        {
+            pNodes = (smake_excl_node_t**)malloc(nSize * sizeof(smake_excl_node_t*));
+            if (pNodes != NULL) memcpy(pNodes, pSet->nodes, sizeof(pSet->nodes));
+        }
+        else pNodes = (smake_excl_node_t**)realloc(pSet->pNodes, nSize * sizeof(smake_excl_node_t*));
+
+        XASSERT(pNodes, XFALSE);
+        pSet->pNodes = pNodes;
+        pSet->nSize = nSize;
+    }
+
+    pSet->pNodes[pSet->nCount++] = pNode;
+
+    /* "**" also matches zero directories */
+    if (pNode->pAnyDepth != NULL) return SMake_ExclSetAdd(pSet, pNode->pAnyDepth);
+    return XTRUE;
+}
+
+static smake_excl_node_t* SMake_ExclNodeNew(smake_excl_t *pIndex, const char *pName, size_t nLength)
+{
+    smake_excl_node_t *pNode = (smake_excl_node_t*)calloc(1, sizeof(smake_excl_node_t));
+    XASSERT(pNode, NULL);
+
+    pNode->pName = (char*)malloc(nLength + 1);
+    if (pNode->pName == NULL)
+    {
+        free(pNode);
+        return NULL;
+    }
+
+    memcpy(pNode->pName, pName, nLength);
+    pNode->pName[nLength] = XSTR_NUL;
+    XArray_Init(&pNode->patterns, NULL, XSTDNON, XFALSE);
+
+    if (XArray_AddData(&pIndex->nodes, pNode, XSTDNON) < 0)
+    {
+        free(pNode->pName);
+        free(pNode);
+        return NULL;
+    }
+
+    return pNode;
+}
+
+static void SMake_ExclClearNode(xarray_data_t *pArrData)
+{
+    XASSERT_VOID_RET(pArrData);
+    smake_excl_node_t *pNode = (smake_excl_node_t*)pArrData->pData;
+    XASSERT_VOID_RET(pNode);
+
+    if (pNode->bChildren) XMap_Destroy(&pNode->children);
+    XArray_Destroy(&pNode->patterns);
+    free(pNode->pName);
+    free(pNode);
+
+    pArrData->pData = NULL;
+    pArrData->nSize = 0;
+}
+
+static xbool_t SMake_ExclIsPattern(const char *pName, size_t nLength)
+{
+    size_t i;
+    for (i = 0; i < nLength; i++)
+        if (pName[i] == '*' || pName[i] == '?' || pName[i] == '[') return XTRUE;
+
+    return XFALSE;
+}
+
+/* Returns next path component, skipping empty and "." components */
+static const char* SMake_ExclNext(const char *pPath, size_t *pLength)
+{
+    while (*pPath)
+    {
+        while (*pPath == '/') pPath++;
+        size_t nLength = strcspn(pPath, "/");
+
+        if (!nLength) break;
+        if (nLength == 1 && pPath[0] == '.')
+        {
+            pPath++;
+            continue;
+        }
+
+        *pLength = nLength;
+        return pPath;
+    }
+
+    *pLength = 0;
+    return NULL;
+}
+
+static smake_excl_node_t* SMake_ExclChild(smake_excl_t *pIndex, smake_excl_node_t *pNode, const char *pName, size_t nLength)
+{
+    if (nLength == 2 && !strncmp(pName, SMAKE_EXCL_ANY, 2))
+    {
+        if (pNode->pAnyDepth == NULL)
+        {
+            pNode->pAnyDepth = SMake_ExclNodeNew(pIndex, pName, nLength);
+            if (pNode->pAnyDepth != NULL) pNode->pAnyDepth->bAnyDepth = XTRUE;
+        }
+
+        return pNode->pAnyDepth;
+    }
+
+    if (SMake_ExclIsPattern(pName, nLength))
+    {
+        size_t i, nUsed = XArray_Used(&pNode->patterns);
+        for (i = 0; i < nUsed; i++)
+        {
+            smake_excl_node_t *pChild = (smake_excl_node_t*)XArray_GetData(&pNode->patterns, i);
+            if (strlen(pChild->pName) == nLength && !strncmp(pChild->pName, pName, nLength)) return pChild;
+        }
+
+        smake_excl_node_t *pChild = SMake_ExclNodeNew(pIndex, pName, nLength);
+        XASSERT(pChild, NULL);
+
+        XArray_AddData(&pNode->patterns, pChild, XSTDNON);
+        return pChild;
+    }
+
+    if (!pNode->bChildren)
+    {
+        XMap_Init(&pNode->children, SMAKE_EXCL_ACTIVE);
+        pNode->bChildren = XTRUE;
+    }
+
+    char sName[XPATH_MAX];
+    if (nLength >= sizeof(sName)) nLength = sizeof(sName) - 1;
+    memcpy(sName, pName, nLength);
+    sName[nLength] = XSTR_NUL;
+
+    smake_excl_node_t *pChild = (smake_excl_node_t*)XMap_Get(&pNode->children, sName);
+    if (pChild != NULL) return pChild;
+
+    pChild = SMake_ExclNodeNew(pIndex, pName, nLength);
+    XASSERT(pChild, NULL);
+
+    XMap_Put(&pNode->children, pChild->pName, pChild);
+    return pChild;
+}
+
+void SMake_ExclInit(smake_excl_t *pIndex)
+{
+    XArray_Init(&pIndex->nodes, NULL, XSTDNON, XFALSE);
+    pIndex->nodes.clearCb = SMake_ExclClearNode;
+    pIndex->pRoot = NULL;
+    pIndex->nRules = 0;
+}
+
+void SMake_ExclDestroy(smake_excl_t *pIndex)
+{
+    XArray_Destroy(&pIndex->nodes);
+    pIndex->pRoot = NULL;
+    pIndex->nRules = 0;
+}
+
+xbool_t SMake_ExclAdd(smake_excl_t *pIndex, const char *pRule)
+{
+    pIndex->nRules++;
+    XASSERT(xstrused(pRule), XFALSE);
+
+    if (pIndex->pRoot == NULL)
+    {
+        pIndex->pRoot = SMake_ExclNodeNew(pIndex, XSTR_EMPTY, 0);
+        XASSERT(pIndex->pRoot, XFALSE);
+    }
+
+    smake_excl_node_t *pNode = pIndex->pRoot;
+    if (*pRule == '/') pNode = SMake_ExclChild(pIndex, pNode, SMAKE_EXCL_ROOT, 1);
+    XASSERT(pNode, XFALSE);
+
+    size_t nLength = 0;
+    const char *pName = SMake_ExclNext(pRule, &nLength);
+    XASSERT(pName, XFALSE);
+
+    /* Floating pattern like "*.gen.c" or "bench_*" matches at any depth */
+    size_t nNextLength = 0;
+    if (*pRule != '/' && SMake_ExclIsPattern(pName, nLength) &&
+        SMake_ExclNext(pName + nLength, &nNextLength) == NULL)
+        pNode = SMake_ExclChild(pIndex, pNode, SMAKE_EXCL_ANY, 2);
+
+    while (pName != NULL && pNode != NULL)
+    {
+        pNode = SMake_ExclChild(pIndex, pNode, pName, nLength);
+        pName = SMake_ExclNext(pName + nLength, &nLength);
+    }
+
+    XASSERT(pNode, XFALSE);
+    pNode->bTerminal = XTRUE;
+    return XTRUE;
+}
+
+static void SMake_ExclStep(smake_excl_set_t *pActive, smake_excl_set_t *pNext, const char *pName)
+{
+    size_t i, j;
+    pNext->nCount = 0;
+
+    for (i = 0; i < pActive->nCount; i++)
+    {
+        smake_excl_node_t *pNode = pActive->pNodes[i];
+        if (pNode->bAnyDepth) SMake_ExclSetAdd(pNext, pNode);
+
+        if (pNode->bChildren)
+        {
+            smake_excl_node_t *pChild = (smake_excl_node_t*)XMap_Get(&pNode->children, pName);
+            if (pChild != NULL) SMake_ExclSetAdd(pNext, pChild);
+        }
+
+        size_t nPatterns = XArray_Used(&pNode->patterns);
+        for (j = 0; j < nPatterns; j++)
+        {
+            smake_excl_node_t *pChild = (smake_excl_node_t*)XArray_GetData(&pNode->patterns, j);
+            if (!fnmatch(pChild->pName, pName, 0)) SMake_ExclSetAdd(pNext, pChild);
+        }
+    }
+}
+
+xbool_t SMake_ExclMatch(smake_excl_t *pIndex, const char *pPath)
+{
+    XASSERT((pIndex->pRoot != NULL && xstrused(pPath)), XFALSE);
+
+    smake_excl_set_t sets[2];
+    SMake_ExclSetInit(&sets[0]);
+    SMake_ExclSetInit(&sets[1]);
+
+    smake_excl_set_t *pActive = &sets[0];
+    smake_excl_set_t *pNext = &sets[1];
+    xbool_t bExcluded = XFALSE;
+
+    SMake_ExclSetAdd(pActive, pIndex->pRoot);
+    if (*pPath == '/') SMake_ExclStep(pActive, pNext, SMAKE_EXCL_ROOT);
+    else
+    {
+        /* Relative paths start at the root node itself */
+        pNext->nCount = 0;
+        SMake_ExclSetAdd(pNext, pIndex->pRoot);
+    }
+
+    size_t i, nLength = 0;
+    const char *pName = SMake_ExclNext(pPath, &nLength);
+    char sName[XPATH_MAX];
+
+    while (pName != NULL && pNext->nCount)
+    {
+        smake_excl_set_t *pSwap = pActive;
+        pActive = pNext;
+        pNext = pSwap;
+
+        if (nLength >= sizeof(sName)) nLength = sizeof(sName) - 1;
+        memcpy(sName, pName, nLength);
+        sName[nLength] = XSTR_NUL;
+
+        SMake_ExclStep(pActive, pNext, sName);
+        pName = SMake_ExclNext(pName + nLength, &nLength);
+    }
+
+    for (i = 0; i < pNext->nCount && !bExcluded; i++)
+        bExcluded = pNext->pNodes[i]->bTerminal;
+
+    SMake_ExclSetFree(&sets[0]);
+    SMake_ExclSetFree(&sets[1]);
+    return bExcluded;
+}
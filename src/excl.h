@@ -0,0 +1,45 @@
+/*!
+ *  @file smake/src/excl.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Compiled index of excluded paths and glob patterns.
+ */
+
+#ifndef __SMAKE_EXCL_H__
+#define __SMAKE_EXCL_H__
+
+#include "stdinc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SMakeExclNode {
+    struct SMakeExclNode *pAnyDepth;  /* Child for "**" component */
+    xarray_t patterns;                /* Children with wildcard components */
+    xmap_t children;                  /* Children with literal components */
+    xbool_t bChildren;
+    xbool_t bAnyDepth;                /* Node itself is a "**" component */
+    xbool_t bTerminal;                /* Some rule ends at this node */
+    char *pName;
+} smake_excl_node_t;
+
+typedef struct SMakeExclIndex {
+    smake_excl_node_t *pRoot;
+    xarray_t nodes;
+    size_t nRules;
+} smake_excl_t;
+
+void SMake_ExclInit(smake_excl_t *pIndex);
+void SMake_ExclDestroy(smake_excl_t *pIndex);
+
+xbool_t SMake_ExclAdd(smake_excl_t *pIndex, const char *pRule);
+xbool_t SMake_ExclMatch(smake_excl_t *pIndex, const char *pPath);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_EXCL_H__ */
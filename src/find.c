@@ -7,6 +7,10 @@
  * @brief Find dynamic and static libraries in the system.
  */
 
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "find.h"
 #include "cfg.h"
 
@@ -18,86 +22,655 @@
     "/usr/local/lib:" \
     "/usr/local/lib64"
 
+#define SMAKE_BIN_PATH \
+    "/bin:" \
+    "/usr/bin:" \
+    "/usr/local/bin"
+
+#define SMAKE_FIND_WORKERS  8
+#define SMAKE_FIND_POLL_US  1000
+
+enum {
+    SMAKE_FIND_PENDING = 0,
+    SMAKE_FIND_RUNNING,
+    SMAKE_FIND_DONE
+};
+
+/* Subdirectory of a recursive search, a miss is valid while it does not change */
+typedef struct SMakeFindSub {
+    char *pPath;
+    struct stat dirStat;
+} smake_find_sub_t;
+
+/* Search of one library in one directory */
+typedef struct SMakeFindJob {
+    struct SMakeFindJob *pEnd;      /* Past the last directory of the same library */
+    const smake_find_t *pFind;
+    const char *pLib;
+    const char *pPath;
+    char sFound[XPATH_MAX];
+    xatomic_t nCancel;
+    xatomic_t nState;
+    struct stat dirStat;            /* Taken before the search, a change during it invalidates the result */
+    smake_find_sub_t *pSubs;        /* First level subdirectories of a recursive search */
+    size_t nSubs;
+    xbool_t bDirStat;
+    xbool_t bComplete;              /* Whole directory was searched, result can be cached */
+    xbool_t bCached;
+    xbool_t bFound;
+} smake_find_job_t;
+
+typedef struct SMakeFindTask {
+    smake_find_job_t *pJobs;        /* Directories of the first library, then the next one */
+    smake_find_t *pFind;
+    xarray_t *pLibs;
+    xarray_t *pPaths;
+    size_t nJobs;
+    uint64_t nStart;                /* Milliseconds, 0 until one of the searches is running */
+    xbool_t bTimedOut;
+} smake_find_task_t;
+
+typedef struct SMakeFindPool {
+    smake_find_job_t **pQueue;
+    smake_find_task_t *pTasks;
+    size_t nTasks;
+    size_t nQueued;
+    xatomic_t nPending;
+    xatomic_t nNext;
+} smake_find_pool_t;
+
 int SMake_SearchCb(xsearch_t *pSearch, xsearch_entry_t *pEntry, const char *pMsg)
 {
-    XSYNC_ATOMIC_SET(pSearch->pInterrupted, XTRUE);\
-    (void)pEntry;
+    XSYNC_ATOMIC_SET(pSearch->pInterrupted, XTRUE);
+    smake_find_job_t *pJob = (smake_find_job_t*)pSearch->pUserCtx;
+
+    /* First match wins, directories after this one can not change the result */
+    if (pJob != NULL && pEntry != NULL)
+    {
+        smake_find_job_t *pNext = pJob + 1;
+        while (pNext < pJob->pEnd) XSYNC_ATOMIC_SET(&(pNext++)->nCancel, XTRUE);
+    }
+
     (void)pMsg;
     return XSTDOK;
 }
 
-static XSTATUS SMake_FindLibrary(const smake_find_t *pFind, const char *pLib, const char *pPath)
+/* Shared by all projects of the user, like the compiler cache */
+static xbool_t SMake_GetFindCachePath(char *pOutput, size_t nSize)
+{
+    const char *pCacheHome = getenv("XDG_CACHE_HOME");
+    if (xstrused(pCacheHome)) xstrncpyf(pOutput, nSize, "%s/smake", pCacheHome);
+    else
+    {
+        const char *pHome = getenv("HOME");
+        XASSERT(xstrused(pHome), XFALSE);
+        xstrncpyf(pOutput, nSize, "%s/.cache/smake", pHome);
+    }
+
+    return XTRUE;
+}
+
+static smake_find_cache_t* SMake_GetFindCache(smake_ctx_t *pCtx)
+{
+    XASSERT(pCtx->bUseCache, NULL);
+    smake_find_cache_t *pCache = &pCtx->findCache;
+    if (pCache->bLoaded) return pCache;
+
+    char sCacheDir[SMAKE_PATH_MAX];
+    char sCachePath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+
+    if (SMake_GetFindCachePath(sCacheDir, sizeof(sCacheDir)))
+    {
+        xstrncpyf(sCachePath, sizeof(sCachePath), "%s/%s", sCacheDir, SMAKE_FIND_CACHE_FILE);
+        SMake_FindCacheLoad(pCache, sCachePath);
+    }
+
+    pCache->bLoaded = XTRUE;
+    return pCache;
+}
+
+static void SMake_FindKey(const smake_find_job_t *pJob, char *pKey, size_t nSize)
+{
+    const smake_find_t *pFind = pJob->pFind;
+    xstrncpyf(pKey, nSize, "%d%d:%s:%s", (int)pFind->bInsensitive,
+        (int)pFind->bRecursive, pJob->pLib, pJob->pPath);
+}
+
+static void SMake_FindCancel(smake_find_job_t *pJob, smake_find_job_t *pEnd)
+{
+    while (pJob < pEnd)
+    {
+        XSYNC_ATOMIC_SET(&pJob->nCancel, XTRUE);
+        pJob++;
+    }
+}
+
+static void SMake_FindSystem(smake_ctx_t *pCtx, smake_find_task_t *pTask)
+{
+    size_t i;
+    for (i = 0; i < pTask->nJobs; i++)
+    {
+        smake_find_job_t *pJob = &pTask->pJobs[i];
+        if (XSYNC_ATOMIC_GET(&pJob->nCancel) || pJob->nState == SMAKE_FIND_DONE) continue;
+
+        if (!SMake_LdCacheFind(&pCtx->ldCache, pJob->pLib, pJob->pPath,
+            pJob->pFind->bRecursive, pJob->sFound, sizeof(pJob->sFound))) continue;
+
+        /* Not a search result, nothing to store in the find cache */
+        xlogd("Found in loader directories: %s", pJob->sFound);
+        SMake_FindCancel(pJob + 1, pJob->pEnd);
+        pJob->nState = SMAKE_FIND_DONE;
+        pJob->bFound = XTRUE;
+    }
+}
+
+static void SMake_FindCached(smake_ctx_t *pCtx, smake_find_task_t *pTask)
+{
+    XASSERT_VOID_RET(!pCtx->bFindRefresh);
+    smake_find_cache_t *pCache = SMake_GetFindCache(pCtx);
+    XASSERT_VOID_RET(pCache);
+
+    char sKey[XPATH_MAX];
+    size_t i;
+
+    for (i = 0; i < pTask->nJobs; i++)
+    {
+        smake_find_job_t *pJob = &pTask->pJobs[i];
+        if (XSYNC_ATOMIC_GET(&pJob->nCancel) || pJob->nState == SMAKE_FIND_DONE) continue;
+
+        SMake_FindKey(pJob, sKey, sizeof(sKey));
+        const smake_cache_find_t *pEntry = SMake_FindCacheGet(pCache, sKey);
+        if (pEntry == NULL) continue;
+
+        xlogd("Using cached search: %s", sKey);
+        pJob->nState = SMAKE_FIND_DONE;
+        pJob->bCached = XTRUE;
+
+        if (pEntry->pFound != NULL)
+        {
+            xstrncpy(pJob->sFound, sizeof(pJob->sFound), pEntry->pFound);
+            SMake_FindCancel(pJob + 1, pJob->pEnd);
+            pJob->bFound = XTRUE;
+        }
+    }
+}
+
+static void SMake_FindStore(smake_ctx_t *pCtx, smake_find_task_t *pTask)
 {
-    xsearch_t search;
-    XSearch_Init(&search, pLib);
+    XASSERT_VOID_RET(pCtx->bUseCache);
+    smake_find_cache_t *pCache = &pCtx->findCache;
+
+    char sKey[XPATH_MAX];
+    size_t i;
+
+    for (i = 0; i < pTask->nJobs; i++)
+    {
+        smake_find_job_t *pJob = &pTask->pJobs[i];
+        if (pJob->bCached || !pJob->bComplete) continue;
 
-    search.callback = SMake_SearchCb;
-    search.bInsensitive = pFind->bInsensitive;
-    search.bRecursive = pFind->bRecursive;
+        SMake_FindKey(pJob, sKey, sizeof(sKey));
+        smake_cache_find_t *pEntry = SMake_FindCacheAdd(pCache, sKey, pJob->bFound ? pJob->sFound : NULL);
+        if (pEntry == NULL) continue;
 
-    XSearch(&search, pPath);
-    size_t nUsed = XArray_Used(&search.fileArray);
+        SMake_FindCacheStamp(pCache, pEntry, pJob->pPath, pJob->bDirStat ? &pJob->dirStat : NULL);
+        if (pJob->bFound) continue;
+
+        /* Libraries are usually installed one level deeper, e.g. /usr/lib/x86_64-linux-gnu */
+        size_t j;
+        for (j = 0; j < pJob->nSubs; j++)
+            SMake_FindCacheStamp(pCache, pEntry, pJob->pSubs[j].pPath, &pJob->pSubs[j].dirStat);
+    }
+}
 
-    if (nUsed > 0)
+static void SMake_FindSubdirs(smake_find_job_t *pJob)
+{
+    char sFileName[NAME_MAX + 1];
+    char sPath[XPATH_MAX];
+    struct stat dirStat;
+    xdir_t dir;
+
+    if (XDir_Open(&dir, pJob->pPath) < 0) return;
+
+    while (XDir_Read(&dir, sFileName, sizeof(sFileName)) > 0)
     {
+        xstrncpyf(sPath, sizeof(sPath), "%s/%s", pJob->pPath, sFileName);
+        if (stat(sPath, &dirStat) < 0 || !S_ISDIR(dirStat.st_mode)) continue;
+
+        smake_find_sub_t *pSubs = (smake_find_sub_t*)realloc(pJob->pSubs, (pJob->nSubs + 1) * sizeof(smake_find_sub_t));
+        if (pSubs == NULL) break;
+        pJob->pSubs = pSubs;
+
+        smake_find_sub_t *pSub = &pJob->pSubs[pJob->nSubs];
+        pSub->pPath = strdup(sPath);
+        if (pSub->pPath == NULL) break;
+
+        pSub->dirStat = dirStat;
+        pJob->nSubs++;
+    }
+
+    XDir_Close(&dir);
+}
+
+static void SMake_FindRun(smake_find_job_t *pJob)
+{
+    XSYNC_ATOMIC_SET(&pJob->nState, SMAKE_FIND_RUNNING);
+
+    /* Canceled by a match in a preceding directory or by the time budget */
+    if (!XSYNC_ATOMIC_GET(&pJob->nCancel))
+    {
+        pJob->bDirStat = stat(pJob->pPath, &pJob->dirStat) >= 0 ? XTRUE : XFALSE;
+        if (pJob->bDirStat && pJob->pFind->bRecursive) SMake_FindSubdirs(pJob);
+        xsearch_t search;
+        XSearch_Init(&search, pJob->pLib);
+
+        search.callback = SMake_SearchCb;
+        search.bInsensitive = pJob->pFind->bInsensitive;
+        search.bRecursive = pJob->pFind->bRecursive;
+        search.pInterrupted = &pJob->nCancel;
+        search.pUserCtx = pJob;
+
+        XSearch(&search, pJob->pPath);
         xsearch_entry_t *pFile = (xsearch_entry_t*)XArray_GetData(&search.fileArray, 0);
-        XASSERT((pFile != NULL) && xstrused(pFile->sPath), XSTDNON);
 
-        size_t nLentgh = strnlen(pFile->sPath, sizeof(pFile->sPath) - 1);
-        while (pFile->sPath[--nLentgh] == '/') pFile->sPath[nLentgh] = '\0';
-        xlogn("Found %s: %s/%s", pLib, pFile->sPath, pFile->sName);
+        if (pFile != NULL && xstrused(pFile->sPath))
+        {
+            size_t nLentgh = strnlen(pFile->sPath, sizeof(pFile->sPath) - 1);
+            while (nLentgh > 1 && pFile->sPath[--nLentgh] == '/') pFile->sPath[nLentgh] = '\0';
+            xstrncpyf(pJob->sFound, sizeof(pJob->sFound), "%s/%s", pFile->sPath, pFile->sName);
+            pJob->bFound = XTRUE;
+        }
+
+        /* Interrupted search without a match did not see the whole tree */
+        pJob->bComplete = pJob->bFound || !XSYNC_ATOMIC_GET(&pJob->nCancel);
+        XSearch_Destroy(&search);
     }
 
-    XSearch_Destroy(&search);
-    return nUsed ? XSTDOK : XSTDNON;
+    XSYNC_ATOMIC_SET(&pJob->nState, SMAKE_FIND_DONE);
 }
 
-static XSTATUS SMake_FindLib(const smake_find_t *pFind, const char *pLib)
+static void* SMake_FindWorker(void *pArg)
 {
-    XASSERT(pLib, XSTDINV);
-    char sLDPath[XPATH_MAX];
+    smake_find_pool_t *pPool = (smake_find_pool_t*)pArg;
+
+    while (XTRUE)
+    {
+        size_t nIndex = (size_t)XSYNC_ATOMIC_ADD(&pPool->nNext, 1) - 1;
+        if (nIndex >= pPool->nQueued) break;
+
+        SMake_FindRun(pPool->pQueue[nIndex]);
+        XSYNC_ATOMIC_SUB(&pPool->nPending, 1);
+    }
+
+    return NULL;
+}
+
+static uint64_t SMake_FindTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static void SMake_FindCheckTime(smake_find_task_t *pTask, uint64_t nNow)
+{
+    if (pTask->pFind->nTimeout <= 0 || pTask->bTimedOut) return;
+    xbool_t bRunning = XFALSE, bPending = XFALSE;
+    size_t i;
+
+    for (i = 0; i < pTask->nJobs; i++)
+    {
+        xatomic_t nState = XSYNC_ATOMIC_GET(&pTask->pJobs[i].nState);
+        if (nState == SMAKE_FIND_RUNNING) bRunning = XTRUE;
+        if (nState != SMAKE_FIND_DONE) bPending = XTRUE;
+    }
+
+    /* Budget starts when the entry gets a worker, not while it is queued */
+    if (!pTask->nStart && bRunning) pTask->nStart = nNow;
+    if (!pTask->nStart || !bPending || nNow - pTask->nStart < (uint64_t)pTask->pFind->nTimeout) return;
+
+    xlogw("Find timed out after %d ms: %s", pTask->pFind->nTimeout, pTask->pFind->pFindStr);
+    SMake_FindCancel(pTask->pJobs, pTask->pJobs + pTask->nJobs);
+    pTask->bTimedOut = XTRUE;
+}
+
+static void SMake_FindRunPool(smake_find_pool_t *pPool)
+{
+    XASSERT_VOID_RET(pPool->nQueued);
+    size_t i, nStarted = 0;
+
+    size_t nWorkers = pPool->nQueued < SMAKE_FIND_WORKERS ? pPool->nQueued : SMAKE_FIND_WORKERS;
+    xthread_t *pThreads = (xthread_t*)calloc(nWorkers, sizeof(xthread_t));
+
+    for (i = 0; pThreads != NULL && i < nWorkers; i++)
+    {
+        if (XThread_Create(&pThreads[i], SMake_FindWorker, pPool, XFALSE) < 0)
+        {
+            xlogw("Failed to start find worker: %s", XSTRERR);
+            break;
+        }
+
+        nStarted++;
+    }
+
+    /* Without workers there is nobody to interrupt, search without a time budget */
+    if (!nStarted) SMake_FindWorker(pPool);
 
+    while (XSYNC_ATOMIC_GET(&pPool->nPending) > 0)
+    {
+        usleep(SMAKE_FIND_POLL_US);
+        uint64_t nNow = SMake_FindTime();
+        for (i = 0; i < pPool->nTasks; i++) SMake_FindCheckTime(&pPool->pTasks[i], nNow);
+    }
+
+    for (i = 0; i < nStarted; i++) XThread_Join(&pThreads[i]);
+    free(pThreads);
+}
+
+static xbool_t SMake_FindTaskInit(smake_find_task_t *pTask, smake_find_t *pFind)
+{
+    memset(pTask, 0, sizeof(smake_find_task_t));
+    pTask->pFind = pFind;
+    pFind->nStatus = XSTDINV;
+    XASSERT_RET(xstrused(pFind->pFindStr), XTRUE);
+
+    char sLDPath[XPATH_MAX];
     if (!xstrused(pFind->pPath)) xstrncpyf(sLDPath, sizeof(sLDPath), "%s", SMAKE_LIB_PATH);
     else if (pFind->bThisPathOnly) xstrncpyf(sLDPath, sizeof(sLDPath), "%s", pFind->pPath);
     else xstrncpyf(sLDPath, sizeof(sLDPath), "%s:%s", pFind->pPath, SMAKE_LIB_PATH);
 
-    xarray_t *pPaths = xstrsplit(sLDPath, ":");
-    XASSERT((pPaths && pPaths->nUsed), XSTDERR);
+    pTask->pLibs = xstrsplit(pFind->pFindStr, ":");
+    pTask->pPaths = xstrsplit(sLDPath, ":");
+    if (pTask->pLibs == NULL || pTask->pPaths == NULL)
+    {
+        xloge("Failed to split input: %s", pFind->pFindStr);
+        return XFALSE;
+    }
+
+    size_t nLibs = XArray_Used(pTask->pLibs);
+    size_t nPaths = XArray_Used(pTask->pPaths);
+    size_t i, j;
 
-    size_t i, nUsed = XArray_Used(pPaths);
-    XSTATUS nStatus = XSTDNON;
+    pTask->nJobs = nLibs * nPaths;
+    XASSERT_RET(pTask->nJobs, XTRUE);
 
-    for (i = 0; i < nUsed; i++)
+    pTask->pJobs = (smake_find_job_t*)calloc(pTask->nJobs, sizeof(smake_find_job_t));
+    if (pTask->pJobs == NULL)
     {
-        const char *pPath = (const char*)XArray_GetData(pPaths, i);
-        if (!xstrused(pPath)) continue;
+        xloge("Failed to allocate memory for find: %s (%s)", pFind->pFindStr, XSTRERR);
+        return XFALSE;
+    }
 
-        nStatus = SMake_FindLibrary(pFind, pLib, pPath);
-        if (nStatus == XSTDOK) break;
+    for (i = 0; i < nLibs; i++)
+    {
+        for (j = 0; j < nPaths; j++)
+        {
+            smake_find_job_t *pJob = &pTask->pJobs[i * nPaths + j];
+            pJob->pLib = (const char*)XArray_GetData(pTask->pLibs, i);
+            pJob->pPath = (const char*)XArray_GetData(pTask->pPaths, j);
+            pJob->pEnd = &pTask->pJobs[(i + 1) * nPaths];
+            pJob->pFind = pFind;
+
+            /* Empty names are skipped like in the sequential search */
+            if (!xstrused(pJob->pLib) || !xstrused(pJob->pPath))
+                pJob->nState = SMAKE_FIND_DONE;
+        }
     }
 
-    return nStatus;
+    return XTRUE;
 }
 
-XSTATUS SMake_FindLibs(smake_ctx_t *pCtx, const smake_find_t *pFind)
+static void SMake_FindTaskDestroy(smake_find_task_t *pTask)
 {
-    XASSERT_RET((pFind != NULL && xstrused(pFind->pFindStr)), XSTDINV);
-    xarray_t *pLibs = xstrsplit(pFind->pFindStr, ":");
-    XASSERT(pLibs, xthrow("Failed to split input: %s", pFind->pFindStr));
+    size_t i, j;
+    for (i = 0; pTask->pJobs != NULL && i < pTask->nJobs; i++)
+    {
+        smake_find_job_t *pJob = &pTask->pJobs[i];
+        for (j = 0; j < pJob->nSubs; j++) free(pJob->pSubs[j].pPath);
+        free(pJob->pSubs);
+    }
+
+    if (pTask->pLibs != NULL) XArray_Destroy(pTask->pLibs);
+    if (pTask->pPaths != NULL) XArray_Destroy(pTask->pPaths);
+    free(pTask->pJobs);
+}
 
-    size_t i, nUsed = XArray_Used(pLibs);
+static XSTATUS SMake_FindResult(smake_find_task_t *pTask)
+{
+    const smake_find_t *pFind = pTask->pFind;
+    size_t nPaths = XArray_Used(pTask->pPaths);
+    size_t i, j, nLibs = XArray_Used(pTask->pLibs);
     XSTATUS nStatus = XSTDNON;
 
-    for (i = 0; i < nUsed; i++)
+    /* Same answer as searching the directories one by one in order */
+    for (i = 0; i < nLibs && nPaths; i++)
     {
-        const char *pLib = (const char*)XArray_GetData(pLibs, i);
+        const char *pLib = (const char*)XArray_GetData(pTask->pLibs, i);
         if (!xstrused(pLib)) continue;
+        nStatus = XSTDNON;
+
+        for (j = 0; j < nPaths; j++)
+        {
+            const smake_find_job_t *pJob = &pTask->pJobs[i * nPaths + j];
+            if (!pJob->bFound) continue;
+
+            xlogn("Found %s: %s", pLib, pJob->sFound);
+            if (pFind->pFound != NULL) xstrncpy(pFind->pFound, pFind->nFoundSize, pJob->sFound);
+
+            nStatus = XSTDOK;
+            break;
+        }
 
-        nStatus = SMake_FindLib(pFind, pLib);
         if (nStatus != XSTDOK) break;
     }
 
-    (void)pCtx;
-    XArray_Destroy(pLibs);
     return nStatus;
-}
\ No newline at end of file
+}
+
+xbool_t SMake_FindAll(smake_ctx_t *pCtx, smake_find_t *pFinds, size_t nCount)
+{
+    XASSERT_RET(nCount, XTRUE);
+    smake_find_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+
+    pool.pTasks = (smake_find_task_t*)calloc(nCount, sizeof(smake_find_task_t));
+    if (pool.pTasks == NULL)
+    {
+        xloge("Failed to allocate memory for find tasks: %s", XSTRERR);
+        return XFALSE;
+    }
+
+    xbool_t bStatus = XTRUE;
+    size_t i, j, nJobs = 0;
+
+    for (pool.nTasks = 0; pool.nTasks < nCount; pool.nTasks++)
+    {
+        smake_find_task_t *pTask = &pool.pTasks[pool.nTasks];
+        if (!SMake_FindTaskInit(pTask, &pFinds[pool.nTasks]))
+        {
+            SMake_FindTaskDestroy(pTask);
+            bStatus = XFALSE;
+            break;
+        }
+
+        /* Loader directories answer most lookups without searching */
+        SMake_FindSystem(pCtx, pTask);
+        if (pCtx->bUseCache) SMake_FindCached(pCtx, pTask);
+        nJobs += pTask->nJobs;
+    }
+
+    pool.pQueue = bStatus && nJobs ? (smake_find_job_t**)calloc(nJobs, sizeof(smake_find_job_t*)) : NULL;
+    if (bStatus && nJobs && pool.pQueue == NULL)
+    {
+        xloge("Failed to allocate memory for find queue: %s", XSTRERR);
+        bStatus = XFALSE;
+    }
+
+    /* Queued in config order, earlier entries get workers first */
+    for (i = 0; bStatus && i < pool.nTasks; i++)
+    {
+        smake_find_task_t *pTask = &pool.pTasks[i];
+        for (j = 0; j < pTask->nJobs; j++)
+        {
+            smake_find_job_t *pJob = &pTask->pJobs[j];
+            if (pJob->nState == SMAKE_FIND_DONE || XSYNC_ATOMIC_GET(&pJob->nCancel)) continue;
+            pool.pQueue[pool.nQueued++] = pJob;
+        }
+    }
+
+    if (bStatus)
+    {
+        xlogd("Searching %zu find entries with %zu uncached search(es)", pool.nTasks, pool.nQueued);
+        pool.nPending = (xatomic_t)pool.nQueued;
+        SMake_FindRunPool(&pool);
+    }
+
+    for (i = 0; i < pool.nTasks; i++)
+    {
+        smake_find_task_t *pTask = &pool.pTasks[i];
+        if (bStatus && pTask->nJobs)
+        {
+            pTask->pFind->nStatus = SMake_FindResult(pTask);
+            SMake_FindStore(pCtx, pTask);
+        }
+
+        SMake_FindTaskDestroy(pTask);
+    }
+
+    free(pool.pQueue);
+    free(pool.pTasks);
+    return bStatus;
+}
+
+XSTATUS SMake_FindLibs(smake_ctx_t *pCtx, const smake_find_t *pFind)
+{
+    XASSERT_RET((pFind != NULL && xstrused(pFind->pFindStr)), XSTDINV);
+    smake_find_t finder = *pFind;
+
+    XASSERT_RET(SMake_FindAll(pCtx, &finder, 1), XSTDERR);
+    return finder.nStatus;
+}
+
+xbool_t SMake_FindSaveCache(smake_ctx_t *pCtx)
+{
+    smake_find_cache_t *pCache = &pCtx->findCache;
+    XASSERT_RET((pCtx->bUseCache && pCache->bModified), XTRUE);
+
+    char sCacheDir[SMAKE_PATH_MAX];
+    char sCachePath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+    XASSERT_RET(SMake_GetFindCachePath(sCacheDir, sizeof(sCacheDir)), XTRUE);
+
+    if (!XPath_Exists(sCacheDir) && !XDir_Create(sCacheDir, 0775))
+    {
+        xlogw("Failed to create cache directory: %s (%s)", sCacheDir, XSTRERR);
+        return XTRUE;
+    }
+
+    /* Missing cache only makes the next run slower */
+    xstrncpyf(sCachePath, sizeof(sCachePath), "%s/%s", sCacheDir, SMAKE_FIND_CACHE_FILE);
+    if (SMake_FindCacheSave(pCache, sCachePath)) xlogd("Saved find cache: %s", sCachePath);
+
+    return XTRUE;
+}
+
+xbool_t SMake_FindLauncher(smake_ctx_t *pCtx)
+{
+    if (!pCtx->bAutoLauncher || xstrused(pCtx->sLauncher)) return XTRUE;
+    const char *pPath = getenv("PATH");
+
+    smake_find_t finder;
+    finder.pPath = xstrused(pPath) ? pPath : SMAKE_BIN_PATH;
+    finder.pFound = pCtx->sLauncher;
+    finder.nFoundSize = sizeof(pCtx->sLauncher);
+    finder.bThisPathOnly = XTRUE;
+    finder.bInsensitive = XFALSE;
+    finder.bRecursive = XFALSE;
+    finder.nTimeout = 0;
+
+    /* First one that is installed, ccache is the common choice for C/C++ */
+    const char *pLaunchers[] = { "ccache", "sccache", NULL };
+    size_t i;
+
+    for (i = 0; pLaunchers[i] != NULL; i++)
+    {
+        finder.pFindStr = pLaunchers[i];
+        if (SMake_FindLibs(pCtx, &finder) != XSTDOK) continue;
+
+        /* Keep the full path, a longer name like ccache-swig is a different tool */
+        const char *pName = strrchr(pCtx->sLauncher, '/');
+        pName = pName != NULL ? pName + 1 : pCtx->sLauncher;
+        if (!strcmp(pName, pLaunchers[i])) return XTRUE;
+    }
+
+    pCtx->sLauncher[0] = XSTR_NUL;
+    xlogi("Compiler launcher not found, compiling without it.");
+    return XTRUE;
+}
+
+static xbool_t SMake_FindLinkerUsable(smake_ctx_t *pCtx, const char *pName)
+{
+    const char *pCompiler = xstrused(pCtx->sCompiler) ? pCtx->sCompiler : (pCtx->bIsCPP ? "c++" : "cc");
+    char sFlag[SMAKE_NAME_MAX];
+    int nStatus = 0;
+
+    /* Compiler must know the linker, e.g. GCC before 12.1 rejects -fuse-ld=mold */
+    xstrncpyf(sFlag, sizeof(sFlag), "-fuse-ld=%s", pName);
+    pid_t nPid = fork();
+    if (nPid < 0) return XFALSE;
+
+    if (nPid == 0)
+    {
+        int nNull = open("/dev/null", O_WRONLY);
+        if (nNull >= 0) { dup2(nNull, STDOUT_FILENO); dup2(nNull, STDERR_FILENO); }
+        execlp(pCompiler, pCompiler, sFlag, "-Wl,--version", (char*)NULL);
+        _exit(127);
+    }
+
+    while (waitpid(nPid, &nStatus, 0) < 0)
+        if (errno != EINTR) return XFALSE;
+
+    if (WIFEXITED(nStatus) && !WEXITSTATUS(nStatus)) return XTRUE;
+    xlogd("Linker %s is not accepted by compiler: %s", pName, pCompiler);
+    return XFALSE;
+}
+
+xbool_t SMake_FindLinker(smake_ctx_t *pCtx)
+{
+    /* lld can not read slim LTO objects of GCC */
+    xbool_t bGccLto = pCtx->nLto != SMAKE_LTO_NONE && !SMake_IsClang(pCtx);
+    if (bGccLto && !strcmp(pCtx->sLinker, "lld"))
+        xlogw("lld can not link LTO objects of GCC, use -k auto or another linker");
+
+    if (!pCtx->bAutoLinker || xstrused(pCtx->sLinker)) return XTRUE;
+    const char *pPath = getenv("PATH");
+
+    smake_find_t finder;
+    finder.pPath = xstrused(pPath) ? pPath : SMAKE_BIN_PATH;
+    finder.pFound = NULL;
+    finder.nFoundSize = 0;
+    finder.bThisPathOnly = XTRUE;
+    finder.bInsensitive = XFALSE;
+    finder.bRecursive = XFALSE;
+    finder.nTimeout = 0;
+
+    /* Fastest first, compiler finds ld.<name> by -fuse-ld=<name> */
+    const char *pLinkers[] = { "mold", "lld", "gold", NULL };
+    char sBinary[SMAKE_NAME_MAX];
+    size_t i;
+
+    for (i = 0; pLinkers[i] != NULL; i++)
+    {
+        if (bGccLto && !strcmp(pLinkers[i], "lld")) continue;
+        xstrncpyf(sBinary, sizeof(sBinary), "ld.%s", pLinkers[i]);
+        finder.pFindStr = sBinary;
+
+        if (SMake_FindLibs(pCtx, &finder) == XSTDOK &&
+            SMake_FindLinkerUsable(pCtx, pLinkers[i]))
+        {
+            xstrncpy(pCtx->sLinker, sizeof(pCtx->sLinker), pLinkers[i]);
+            return XTRUE;
+        }
+    }
+
+    xlogi("Fast linker not found, using default linker of the compiler.");
+    return XTRUE;
+}
@@ -16,11 +16,19 @@
 typedef struct SMakeFind {
     const char *pFindStr;
     const char *pPath;
+    char *pFound;           /* Optional output for the full path of the first match */
+    size_t nFoundSize;
     xbool_t bThisPathOnly;
     xbool_t bInsensitive;
     xbool_t bRecursive;
+    int nTimeout;           /* Milliseconds for the whole entry, 0 for no limit */
+    XSTATUS nStatus;        /* Output of SMake_FindAll() */
 } smake_find_t;
 
+xbool_t SMake_FindAll(smake_ctx_t *pCtx, smake_find_t *pFinds, size_t nCount);
 XSTATUS SMake_FindLibs(smake_ctx_t *pCtx, const smake_find_t *pFind);
+xbool_t SMake_FindLauncher(smake_ctx_t *pCtx);
+xbool_t SMake_FindLinker(smake_ctx_t *pCtx);
+xbool_t SMake_FindSaveCache(smake_ctx_t *pCtx);
 
 #endif /* __SMAKE_FIND_H__ */
\ No newline at end of file
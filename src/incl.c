@@ -0,0 +1,337 @@
+/*!
+ *  @file smake/src/incl.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Reduce include directories to the ones used by #include directives.
+ *
+ * Every project source and header is scanned for #include directives, also
+ * inside of conditional blocks, so no configuration loses a directory it
+ * needs. The included name is resolved against the project headers with the
+ * same file name: a header matches when its directory ends with the directory
+ * part of the name, and the rest of its directory is the include directory
+ * the compiler would need. Quoted includes found next to the including file
+ * need no include directory. Names that do not match a project header are
+ * system or external headers and are left to the fixed include directories.
+ * Directories are emitted by the number of directives they resolve, and
+ * names that match in more than one directory are reported, because the
+ * header that is used depends on the order of the directories.
+ */
+
+#include "incl.h"
+
+#define SMAKE_INCL_CANDIDATES   16
+#define SMAKE_INCL_MAP          1024
+
+typedef struct SMakeInclHeader {
+    struct SMakeInclHeader *pNext;  /* Next header with the same file name */
+    const SMakeFile *pFile;
+} smake_incl_hdr_t;
+
+typedef struct SMakeInclDir {
+    const SMakeDir *pDir;
+    size_t nHits;       /* Directives resolved in the directory */
+    size_t nOrder;      /* Discovered order, first hit for new directories */
+    size_t nRank;       /* Position in the emitted list */
+} smake_incl_dir_t;
+
+typedef struct SMakeInclAmbiguous {
+    const char *pName;
+    const char *pSource;    /* First file that includes the name */
+    const SMakeDir *dirs[SMAKE_INCL_CANDIDATES];
+    size_t nDirs;
+} smake_incl_amb_t;
+
+typedef struct SMakeInclScan {
+    smake_ctx_t *pCtx;
+    xmap_t headerMap;
+    xmap_t dirMap;
+    xmap_t ambMap;
+    xarray_t dirs;
+    xarray_t ambiguous;
+    size_t nDirectives;
+} smake_incl_scan_t;
+
+static smake_incl_dir_t* SMake_InclHit(smake_incl_scan_t *pScan, const SMakeDir *pDir)
+{
+    smake_incl_dir_t *pEntry = (smake_incl_dir_t*)XMap_Get(&pScan->dirMap, pDir->pPath);
+    if (pEntry == NULL)
+    {
+        pEntry = (smake_incl_dir_t*)SMake_ArenaAlloc(&pScan->pCtx->arena, sizeof(smake_incl_dir_t));
+        XASSERT(pEntry, NULL);
+
+        pEntry->nOrder = XArray_Used(&pScan->dirs);
+        pEntry->pDir = pDir;
+        pEntry->nHits = 0;
+        pEntry->nRank = 0;
+
+        XMap_Put(&pScan->dirMap, pDir->pPath, pEntry);
+        XArray_AddData(&pScan->dirs, pEntry, XSTDNON);
+    }
+
+    pEntry->nHits++;
+    return pEntry;
+}
+
+static void SMake_InclAmbiguous(smake_incl_scan_t *pScan, const SMakeFile *pFile, const char *pName,
+                                const SMakeDir **pDirs, size_t nDirs)
+{
+    XASSERT_VOID_RET((XMap_Get(&pScan->ambMap, pName) == NULL));
+    smake_arena_t *pArena = &pScan->pCtx->arena;
+    char sSource[SMAKE_PATH_MAX];
+
+    xstrncpyf(sSource, sizeof(sSource), "%s/%s", pFile->pDir->pPath, pFile->pName);
+    smake_incl_amb_t *pAmb = (smake_incl_amb_t*)SMake_ArenaAlloc(pArena, sizeof(smake_incl_amb_t));
+    char *pNameCopy = SMake_ArenaStrdup(pArena, pName, strlen(pName));
+    char *pSourceCopy = SMake_ArenaStrdup(pArena, sSource, strlen(sSource));
+    XASSERT_VOID_RET((pAmb != NULL && pNameCopy != NULL && pSourceCopy != NULL));
+
+    memcpy(pAmb->dirs, pDirs, nDirs * sizeof(const SMakeDir*));
+    pAmb->pSource = pSourceCopy;
+    pAmb->pName = pNameCopy;
+    pAmb->nDirs = nDirs;
+
+    XMap_Put(&pScan->ambMap, pAmb->pName, pAmb);
+    XArray_AddData(&pScan->ambiguous, pAmb, XSTDNON);
+}
+
+static void SMake_InclResolve(smake_incl_scan_t *pScan, const SMakeFile *pFile, xbool_t bQuoted, const char *pName)
+{
+    const char *pBase = strrchr(pName, '/');
+    size_t nDirPart = pBase != NULL ? (size_t)(pBase - pName) : 0;
+    pBase = pBase != NULL ? pBase + 1 : pName;
+
+    smake_incl_hdr_t *pHeader = (smake_incl_hdr_t*)XMap_Get(&pScan->headerMap, pBase);
+    if (pHeader == NULL) return;
+
+    /* Relative names are only resolved next to the including file */
+    if (strstr(pName, "./") != NULL)
+    {
+        char sPath[SMAKE_PATH_MAX * 2];
+        xstrncpyf(sPath, sizeof(sPath), "%s/%s", pFile->pDir->pPath, pName);
+        if (!bQuoted || !XPath_Exists(sPath)) xlogd("Skipping unresolved include: %s (%s/%s)", pName, pFile->pDir->pPath, pFile->pName);
+        return;
+    }
+
+    const SMakeDir *candidates[SMAKE_INCL_CANDIDATES];
+    size_t i, nCandidates = 0;
+    char sDir[SMAKE_PATH_MAX];
+
+    for (; pHeader != NULL; pHeader = pHeader->pNext)
+    {
+        const SMakeDir *pDir = pHeader->pFile->pDir;
+        size_t nDir = pDir->nLength;
+
+        /* Directory part of the name must be the tail of the header directory */
+        if (nDirPart)
+        {
+            if (nDir <= nDirPart || pDir->pPath[nDir - nDirPart - 1] != '/' ||
+                strncmp(&pDir->pPath[nDir - nDirPart], pName, nDirPart)) continue;
+
+            nDir -= nDirPart + 1;
+        }
+
+        /* Quoted name is found in the directory of the including file first */
+        if (bQuoted && nDir == pFile->pDir->nLength &&
+            !strncmp(pDir->pPath, pFile->pDir->pPath, nDir)) return;
+
+        if (nDir >= sizeof(sDir)) continue;
+        xstrncpyf(sDir, sizeof(sDir), "%.*s", (int)nDir, pDir->pPath);
+
+        const SMakeDir *pIncludeDir = SMake_DirIntern(pScan->pCtx, sDir);
+        if (pIncludeDir == NULL) continue;
+
+        for (i = 0; i < nCandidates && candidates[i] != pIncludeDir; i++);
+        if (i == nCandidates && nCandidates < SMAKE_INCL_CANDIDATES) candidates[nCandidates++] = pIncludeDir;
+    }
+
+    for (i = 0; i < nCandidates; i++) SMake_InclHit(pScan, candidates[i]);
+    if (nCandidates > 1) SMake_InclAmbiguous(pScan, pFile, pName, candidates, nCandidates);
+}
+
+static void SMake_InclScanBuffer(smake_incl_scan_t *pScan, const SMakeFile *pFile, const char *pData, size_t nSize)
+{
+    char sName[SMAKE_PATH_MAX];
+    size_t nPosit = 0;
+
+    while (nPosit < nSize)
+    {
+        const char *pEnd = (const char*)memchr(&pData[nPosit], '\n', nSize - nPosit);
+        size_t nEnd = pEnd != NULL ? (size_t)(pEnd - pData) : nSize;
+        size_t i = nPosit;
+        nPosit = nEnd + 1;
+
+        while (i < nEnd && (pData[i] == ' ' || pData[i] == '\t')) i++;
+        if (i >= nEnd || pData[i++] != '#') continue;
+
+        while (i < nEnd && (pData[i] == ' ' || pData[i] == '\t')) i++;
+        if (nEnd - i < 8 || strncmp(&pData[i], "include", 7)) continue;
+
+        /* Also skips #include_next and names given with a macro */
+        for (i += 7; i < nEnd && (pData[i] == ' ' || pData[i] == '\t'); i++);
+        if (i >= nEnd || (pData[i] != '"' && pData[i] != '<')) continue;
+
+        char cClose = pData[i] == '<' ? '>' : '"';
+        const char *pClose = (const char*)memchr(&pData[i + 1], cClose, nEnd - i - 1);
+        size_t nLength = pClose != NULL ? (size_t)(pClose - &pData[i + 1]) : 0;
+        if (!nLength || nLength >= sizeof(sName)) continue;
+
+        xstrncpyf(sName, sizeof(sName), "%.*s", (int)nLength, &pData[i + 1]);
+        SMake_InclResolve(pScan, pFile, cClose == '"', sName);
+        pScan->nDirectives++;
+    }
+}
+
+static int SMake_InclCompare(const void *pData1, const void *pData2, void *pCtx)
+{
+    (void)pCtx;
+    const smake_incl_dir_t *pFirst = (smake_incl_dir_t*)((xarray_data_t*)pData1)->pData;
+    const smake_incl_dir_t *pSecond = (smake_incl_dir_t*)((xarray_data_t*)pData2)->pData;
+
+    if (pFirst->nHits != pSecond->nHits) return pFirst->nHits > pSecond->nHits ? -1 : 1;
+    return (int)(pFirst->nOrder > pSecond->nOrder) - (int)(pFirst->nOrder < pSecond->nOrder);
+}
+
+static void SMake_InclReport(smake_incl_scan_t *pScan)
+{
+    size_t i, j, nAmbiguous = XArray_Used(&pScan->ambiguous);
+    for (i = 0; i < nAmbiguous; i++)
+    {
+        smake_incl_amb_t *pAmb = (smake_incl_amb_t*)XArray_GetData(&pScan->ambiguous, i);
+        const smake_incl_dir_t *pUsed = NULL;
+        char sOthers[SMAKE_LINE_MAX];
+        sOthers[0] = XSTR_NUL;
+
+        /* Compiler uses the first directory in the emitted order */
+        for (j = 0; j < pAmb->nDirs; j++)
+        {
+            const smake_incl_dir_t *pEntry = (smake_incl_dir_t*)XMap_Get(&pScan->dirMap, pAmb->dirs[j]->pPath);
+            if (pEntry != NULL && (pUsed == NULL || pEntry->nRank < pUsed->nRank)) pUsed = pEntry;
+        }
+
+        XASSERT_VOID_RET(pUsed);
+
+        for (j = 0; j < pAmb->nDirs; j++)
+        {
+            if (pAmb->dirs[j] == pUsed->pDir) continue;
+            xstrncatf(sOthers, sizeof(sOthers) - strlen(sOthers), "%s%s/%s",
+                xstrused(sOthers) ? ", " : XSTR_EMPTY, pAmb->dirs[j]->pPath, pAmb->pName);
+        }
+
+        xlogw("Ambiguous header: %s (included from %s)", pAmb->pName, pAmb->pSource);
+        xlogw("Using %s/%s, also found: %s", pUsed->pDir->pPath, pAmb->pName, sOthers);
+    }
+}
+
+static void SMake_InclScanFile(smake_incl_scan_t *pScan, const SMakeFile *pFile)
+{
+    char sPath[SMAKE_PATH_MAX * 2];
+    xstrncpyf(sPath, sizeof(sPath), "%s/%s", pFile->pDir->pPath, pFile->pName);
+
+    size_t nSize = 0;
+    char *pBuffer = (char*)XPath_Load(sPath, &nSize);
+
+    if (pBuffer == NULL)
+    {
+        xlogw("Failed to read file: %s (%s)", sPath, XSTRERR);
+        return;
+    }
+
+    SMake_InclScanBuffer(pScan, pFile, pBuffer, nSize);
+    free(pBuffer);
+}
+
+xbool_t SMake_InclBuild(smake_ctx_t *pCtx, size_t nFixed)
+{
+    smake_incl_scan_t scan;
+    scan.pCtx = pCtx;
+    scan.nDirectives = 0;
+
+    XMap_Init(&scan.headerMap, SMAKE_INCL_MAP);
+    XMap_Init(&scan.dirMap, SMAKE_NAME_MAX);
+    XMap_Init(&scan.ambMap, SMAKE_NAME_MAX);
+    XArray_Init(&scan.dirs, NULL, XSTDNON, XFALSE);
+    XArray_Init(&scan.ambiguous, NULL, XSTDNON, XFALSE);
+    scan.ambiguous.clearCb = NULL;
+    scan.dirs.clearCb = NULL;
+
+    size_t i, nFiles = XArray_Used(&pCtx->fileArr);
+    xbool_t bStatus = XTRUE;
+
+    for (i = 0; i < nFiles; i++)
+    {
+        const SMakeFile *pFile = (SMakeFile*)XArray_GetData(&pCtx->fileArr, i);
+        if (pFile == NULL || (pFile->nType != SMAKE_FILE_H && pFile->nType != SMAKE_FILE_HPP)) continue;
+
+        smake_incl_hdr_t *pHeader = (smake_incl_hdr_t*)SMake_ArenaAlloc(&pCtx->arena, sizeof(smake_incl_hdr_t));
+        if (pHeader == NULL)
+        {
+            xloge("Failed to allocate memory for header: %s", XSTRERR);
+            bStatus = XFALSE;
+            break;
+        }
+
+        pHeader->pNext = (smake_incl_hdr_t*)XMap_Get(&scan.headerMap, pFile->pName);
+        pHeader->pFile = pFile;
+        XMap_Put(&scan.headerMap, pFile->pName, pHeader);
+    }
+
+    for (i = 0; i < nFiles && bStatus; i++)
+    {
+        const SMakeFile *pFile = (SMakeFile*)XArray_GetData(&pCtx->fileArr, i);
+        if (pFile != NULL && pFile->nType != SMAKE_FILE_UNF &&
+            pFile->nType != SMAKE_FILE_OBJ) SMake_InclScanFile(&scan, pFile);
+    }
+
+    if (bStatus)
+    {
+        size_t nIncludes = XArray_Used(&pCtx->includes.array);
+        size_t nDirs = XArray_Used(&scan.dirs);
+
+        /* Equally used directories keep the discovered order, ambiguous names resolve as before */
+        for (i = 0; i < nDirs; i++)
+        {
+            smake_incl_dir_t *pEntry = (smake_incl_dir_t*)XArray_GetData(&scan.dirs, i);
+            pEntry->nOrder += nIncludes;
+        }
+
+        for (i = 0; i < nIncludes; i++)
+        {
+            const char *pPath = (const char*)XArray_GetData(&pCtx->includes.array, i);
+            smake_incl_dir_t *pEntry = pPath != NULL ? (smake_incl_dir_t*)XMap_Get(&scan.dirMap, pPath) : NULL;
+            if (pEntry != NULL) pEntry->nOrder = i;
+        }
+
+        XArray_Sort(&scan.dirs, SMake_InclCompare, NULL);
+
+        /* Discovered directories are still installed with the headers */
+        SMake_ListDestroy(&pCtx->headerDirs);
+        pCtx->headerDirs = pCtx->includes;
+        SMake_ListInit(&pCtx->includes);
+
+        for (i = 0; i < nFixed; i++)
+        {
+            const char *pPath = (const char*)XArray_GetData(&pCtx->headerDirs.array, i);
+            if (pPath != NULL) SMake_AddToList(&pCtx->includes, "%s", pPath);
+        }
+
+        for (i = 0; i < nDirs; i++)
+        {
+            smake_incl_dir_t *pEntry = (smake_incl_dir_t*)XArray_GetData(&scan.dirs, i);
+            xlogd("Include directory: %s (%zu directives)", pEntry->pDir->pPath, pEntry->nHits);
+            SMake_AddToList(&pCtx->includes, "%s", pEntry->pDir->pPath);
+            pEntry->nRank = i;
+        }
+
+        xlogi("Include directories: %zu used from %zu (%zu directives)", nDirs, nIncludes - nFixed, scan.nDirectives);
+        SMake_InclReport(&scan);
+    }
+
+    XArray_Destroy(&scan.ambiguous);
+    XArray_Destroy(&scan.dirs);
+    XMap_Destroy(&scan.ambMap);
+    XMap_Destroy(&scan.dirMap);
+    XMap_Destroy(&scan.headerMap);
+    return bStatus;
+}
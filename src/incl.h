@@ -0,0 +1,26 @@
+/*!
+ *  @file smake/src/incl.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Reduce include directories to the ones used by #include directives.
+ */
+
+#ifndef __SMAKE_INCL_H__
+#define __SMAKE_INCL_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_InclBuild(smake_ctx_t *pCtx, size_t nFixed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_INCL_H__ */
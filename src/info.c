@@ -57,28 +57,47 @@ void SMake_Usage(const char *pName)
     SMake_Greet(SMAKE_FULL_NAME);
     int nLength = strlen(pName) + 6;
  
-    printf("Usage: %s [-f <'flags'>] [-b <path>] [-i <path>] [-c <path>] [-I] [-V]\n", pName);
-    printf(" %s [-l <'libs'>] [-e <paths>] [-g <name>] [-o <path>] [-d] [-j]\n", WhiteSpace(nLength));
-    printf(" %s [-L <'libs'>] [-p <name>] [-s <path>] [-v <numb>] [-w] [-x] [-h]\n", WhiteSpace(nLength));
+    printf("Usage: %s [-f <'flags'>] [-a <name>] [-b <path>] [-i <path>] [-c <path>] [-C] [-I] [-V]\n", pName);
+    printf(" %s [-l <'libs'>] [-e <paths>] [-g <name>] [-G <name>] [-k <name>] [-o <path>] [-O <name>]\n", WhiteSpace(nLength));
+    printf(" %s [-L <'libs'>] [-p <name>] [-P <numb>] [-s <path>] [-t <numb>] [-T <type>] [-d] [-j]\n", WhiteSpace(nLength));
+    printf(" %s [-u <numb>] [-v <numb>] [-m] [-M] [-n] [-F] [-N] [-r] [-R] [-w] [-W] [-x] [-z] [-h]\n", WhiteSpace(nLength));
     printf("Options are:\n");
     printf("  -f <'flags'>        # Compiler flags\n");
     printf("  -l <'libs'>         # Linked libraries\n");
     printf("  -L <'libs'>         # Custom libraries (LD_LIBS)\n");
+    printf("  -a <name>           # Compiler launcher (auto, ccache, sccache)\n");
     printf("  -b <path>           # Install destination for binary\n");
     printf("  -c <path>           # Specify path to config file\n");
-    printf("  -e <paths>          # Exclude files or directories\n");
+    printf("  -e <paths>          # Exclude files, directories or globs\n");
     printf("  -g <name>           # Specify the desired compiler\n");
+    printf("  -G <name>           # Build backend (make, ninja)\n");
     printf("  -i <path>           # Install destination for includes\n");
+    printf("  -k <name>           # Linker (auto, mold, lld, gold, bfd)\n");
     printf("  -o <path>           # Object output destination\n");
+    printf("  -O <name>           # Report build of a profile or PGO phase\n");
     printf("  -p <name>           # Program or library name\n");
+    printf("  -P <numb>           # Precompile most included headers\n");
     printf("  -s <path>           # Path to source files\n");
+    printf("  -t <numb>           # Scan threads (0 = CPU count)\n");
+    printf("  -T <type>           # Link time optimization (full, thin, none)\n");
+    printf("  -u <numb>           # Unity build batch size\n");
     printf("  -v <numb>           # Verbosity level\n");
     printf("  -V                  # Print version and exit\n");
+    printf("  -C                  # Generate compile_commands.json\n");
     printf("  -I                  # Initialize project\n");
     printf("  -j                  # Generate smake.json\n");
     printf("  -d                  # Virtual directory\n");
+    printf("  -m                  # Mirror source tree in output directory\n");
+    printf("  -n                  # Do not use the scan cache\n");
+    printf("  -F                  # Refresh cached find results\n");
+    printf("  -N                  # Only include directories used by #include\n");
+    printf("  -r                  # Print build report from time traces\n");
+    printf("  -R                  # Collect compiler time traces\n");
+    printf("  -M                  # Do not track header dependencies\n");
     printf("  -w                  # Force overwrite output\n");
+    printf("  -W                  # Watch the project and regenerate on changes\n");
     printf("  -x                  # Create Makefile for CPP\n");
+    printf("  -z                  # Remove unused sections at link time\n");
     printf("  -h                  # Print version and usage\n\n");
     printf("Hints:\n1) You can exclude multiple files and directories with \";\" tokenizer\n");
     printf("2) To build static/shared library use parameter: -p <name>.a/<name>.so\n");
@@ -0,0 +1,219 @@
+/*!
+ *  @file smake/src/ldcache.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Library directories known by the dynamic loader.
+ *
+ * ld.so.cache maps sonames to library paths. It is written in the old
+ * format ("ld.so-1.7.0"), in the new format ("glibc-ld.so.cache1.1") or
+ * in the old format followed by the new one. Find entries usually name
+ * the development link (libz.so) which is not in the cache, so the file
+ * is looked up in the directories of the cached libraries instead.
+ */
+
+#include "ldcache.h"
+
+#define SMAKE_LDCACHE_OLD       "ld.so-1.7.0"
+#define SMAKE_LDCACHE_NEW       "glibc-ld.so.cache1.1"
+#define SMAKE_LDCACHE_OLD_HDR   16
+#define SMAKE_LDCACHE_OLD_ENTRY 12
+#define SMAKE_LDCACHE_NEW_HDR   48
+#define SMAKE_LDCACHE_NEW_ENTRY 24
+#define SMAKE_LDCACHE_ALIGN     8
+
+#define SMAKE_LDCACHE_TYPE      0x00ff
+#define SMAKE_LDCACHE_LIBC6     0x0003
+
+/* Cache flags and multiarch triplet of the host, as used by ldconfig */
+#if defined(__x86_64__) && defined(__ILP32__)
+#define SMAKE_LDCACHE_ARCH      0x0803
+#define SMAKE_MULTIARCH         "x86_64-linux-gnux32"
+#elif defined(__x86_64__)
+#define SMAKE_LDCACHE_ARCH      0x0303
+#define SMAKE_MULTIARCH         "x86_64-linux-gnu"
+#elif defined(__aarch64__)
+#define SMAKE_LDCACHE_ARCH      0x0a03
+#define SMAKE_MULTIARCH         "aarch64-linux-gnu"
+#elif defined(__i386__)
+#define SMAKE_LDCACHE_ARCH      0x0003
+#define SMAKE_MULTIARCH         "i386-linux-gnu"
+#elif defined(__arm__) && defined(__ARM_PCS_VFP)
+#define SMAKE_LDCACHE_ARCH      0x0903
+#define SMAKE_MULTIARCH         "arm-linux-gnueabihf"
+#elif defined(__powerpc64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SMAKE_LDCACHE_ARCH      0x0503
+#define SMAKE_MULTIARCH         "powerpc64le-linux-gnu"
+#elif defined(__s390x__)
+#define SMAKE_LDCACHE_ARCH      0x0403
+#define SMAKE_MULTIARCH         "s390x-linux-gnu"
+#elif defined(__riscv) && __riscv_xlen == 64 && defined(__riscv_float_abi_double)
+#define SMAKE_LDCACHE_ARCH      0x1003
+#define SMAKE_MULTIARCH         "riscv64-linux-gnu"
+#endif
+
+void SMake_LdCacheInit(smake_ldcache_t *pCache)
+{
+    SMake_ListInit(&pCache->dirs);
+    pCache->bLoaded = XFALSE;
+}
+
+void SMake_LdCacheDestroy(smake_ldcache_t *pCache)
+{
+    SMake_ListDestroy(&pCache->dirs);
+    pCache->bLoaded = XFALSE;
+}
+
+const char* SMake_LdCacheMultiarch(void)
+{
+#ifdef SMAKE_MULTIARCH
+    return SMAKE_MULTIARCH;
+#else
+    return NULL;
+#endif
+}
+
+static uint32_t SMake_LdCacheU32(const uint8_t *pData)
+{
+    uint32_t nValue;
+    memcpy(&nValue, pData, sizeof(nValue));
+    return nValue;
+}
+
+static xbool_t SMake_LdCacheArch(uint32_t nFlags)
+{
+#ifdef SMAKE_LDCACHE_ARCH
+    return nFlags == SMAKE_LDCACHE_ARCH ? XTRUE : XFALSE;
+#else
+    /* Unknown host, any glibc library will do */
+    return (nFlags & SMAKE_LDCACHE_TYPE) == SMAKE_LDCACHE_LIBC6 ? XTRUE : XFALSE;
+#endif
+}
+
+static void SMake_LdCacheAdd(smake_ldcache_t *pCache, const uint8_t *pStrings, size_t nSize, uint32_t nFlags, uint32_t nOffset)
+{
+    if (!SMake_LdCacheArch(nFlags) || nOffset >= nSize) return;
+    const char *pPath = (const char*)pStrings + nOffset;
+
+    /* String table is not trusted to be terminated */
+    size_t nLength = strnlen(pPath, nSize - nOffset);
+    if (nLength == nSize - nOffset) return;
+
+    const char *pSlash = strrchr(pPath, '/');
+    if (pSlash == NULL || pSlash == pPath) return;
+
+    SMake_AddToList(&pCache->dirs, "%.*s", (int)(pSlash - pPath), pPath);
+}
+
+static xbool_t SMake_LdCacheParseNew(smake_ldcache_t *pCache, const uint8_t *pData, size_t nSize)
+{
+    XASSERT((nSize >= SMAKE_LDCACHE_NEW_HDR), XFALSE);
+    uint32_t i, nLibs = SMake_LdCacheU32(pData + sizeof(SMAKE_LDCACHE_NEW) - 1);
+
+    /* String offsets are relative to the header of the new format */
+    XASSERT((nLibs <= (nSize - SMAKE_LDCACHE_NEW_HDR) / SMAKE_LDCACHE_NEW_ENTRY), XFALSE);
+
+    for (i = 0; i < nLibs; i++)
+    {
+        const uint8_t *pEntry = pData + SMAKE_LDCACHE_NEW_HDR + (size_t)i * SMAKE_LDCACHE_NEW_ENTRY;
+        SMake_LdCacheAdd(pCache, pData, nSize, SMake_LdCacheU32(pEntry), SMake_LdCacheU32(pEntry + 8));
+    }
+
+    return XTRUE;
+}
+
+static xbool_t SMake_LdCacheParseOld(smake_ldcache_t *pCache, const uint8_t *pData, size_t nSize)
+{
+    XASSERT((nSize >= SMAKE_LDCACHE_OLD_HDR), XFALSE);
+    uint32_t i, nLibs = SMake_LdCacheU32(pData + SMAKE_LDCACHE_OLD_HDR - 4);
+    XASSERT((nLibs <= (nSize - SMAKE_LDCACHE_OLD_HDR) / SMAKE_LDCACHE_OLD_ENTRY), XFALSE);
+
+    size_t nEntries = SMAKE_LDCACHE_OLD_HDR + (size_t)nLibs * SMAKE_LDCACHE_OLD_ENTRY;
+    size_t nNew = (nEntries + SMAKE_LDCACHE_ALIGN - 1) & ~((size_t)SMAKE_LDCACHE_ALIGN - 1);
+
+    /* Newer ldconfig appends the new format, it has the same libraries */
+    if (nNew + SMAKE_LDCACHE_NEW_HDR <= nSize &&
+        !memcmp(pData + nNew, SMAKE_LDCACHE_NEW, sizeof(SMAKE_LDCACHE_NEW) - 1))
+        return SMake_LdCacheParseNew(pCache, pData + nNew, nSize - nNew);
+
+    /* Otherwise the strings follow the entries of the old format */
+    for (i = 0; i < nLibs; i++)
+    {
+        const uint8_t *pEntry = pData + SMAKE_LDCACHE_OLD_HDR + (size_t)i * SMAKE_LDCACHE_OLD_ENTRY;
+        SMake_LdCacheAdd(pCache, pData + nEntries, nSize - nEntries, SMake_LdCacheU32(pEntry), SMake_LdCacheU32(pEntry + 8));
+    }
+
+    return XTRUE;
+}
+
+xbool_t SMake_LdCacheLoad(smake_ldcache_t *pCache, const char *pPath)
+{
+    pCache->bLoaded = XTRUE;
+    size_t nSize = 0;
+
+    uint8_t *pBuffer = (uint8_t*)XPath_Load(pPath, &nSize);
+    XASSERT(pBuffer, XFALSE);
+    xbool_t bStatus = XFALSE;
+
+    if (nSize >= sizeof(SMAKE_LDCACHE_NEW) - 1 && !memcmp(pBuffer, SMAKE_LDCACHE_NEW, sizeof(SMAKE_LDCACHE_NEW) - 1))
+        bStatus = SMake_LdCacheParseNew(pCache, pBuffer, nSize);
+    else if (nSize >= sizeof(SMAKE_LDCACHE_OLD) - 1 && !memcmp(pBuffer, SMAKE_LDCACHE_OLD, sizeof(SMAKE_LDCACHE_OLD) - 1))
+        bStatus = SMake_LdCacheParseOld(pCache, pBuffer, nSize);
+
+    if (!bStatus) xlogd("Ignoring loader cache with unknown format: %s", pPath);
+    else xlogd("Loaded loader cache: %s (%zu dirs)", pPath, XArray_Used(&pCache->dirs.array));
+
+    free(pBuffer);
+    return bStatus;
+}
+
+static xbool_t SMake_LdCacheCheck(const char *pDir, const char *pName, const char *pPath,
+                                  xbool_t bRecursive, char *pFound, size_t nSize)
+{
+    size_t nLength = strlen(pPath);
+    while (nLength > 1 && pPath[nLength - 1] == '/') nLength--;
+
+    /* Directory has to be the searched one or, when recursive, one below it */
+    xbool_t bRoot = (nLength == 1 && pPath[0] == '/') ? XTRUE : XFALSE;
+    if (!bRoot && strncmp(pDir, pPath, nLength)) return XFALSE;
+    if (bRoot ? (!bRecursive && pDir[1] != XSTR_NUL) :
+        (pDir[nLength] != XSTR_NUL && (!bRecursive || pDir[nLength] != '/'))) return XFALSE;
+
+    char sPath[XPATH_MAX];
+    struct stat statbuf;
+
+    xstrncpyf(sPath, sizeof(sPath), "%s/%s", pDir, pName);
+    if (stat(sPath, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) return XFALSE;
+
+    xstrncpy(pFound, nSize, sPath);
+    return XTRUE;
+}
+
+xbool_t SMake_LdCacheFind(smake_ldcache_t *pCache, const char *pName, const char *pPath,
+                          xbool_t bRecursive, char *pFound, size_t nSize)
+{
+    /* Plain file names only, anything else is left to the search */
+    if (strchr(pName, '/') != NULL || strchr(pName, '*') != NULL) return XFALSE;
+    if (!pCache->bLoaded) SMake_LdCacheLoad(pCache, SMAKE_LDCACHE_FILE);
+
+    size_t i, nUsed = XArray_Used(&pCache->dirs.array);
+    for (i = 0; i < nUsed; i++)
+    {
+        const char *pDir = (const char*)XArray_GetData(&pCache->dirs.array, i);
+        if (pDir != NULL && SMake_LdCacheCheck(pDir, pName, pPath, bRecursive, pFound, nSize)) return XTRUE;
+    }
+
+    /* Libraries without a soname, e.g. static ones, are not in the cache */
+    const char *pMultiarch = SMake_LdCacheMultiarch();
+    const char *pPrefixes[] = { "/lib", "/usr/lib", "/usr/local/lib", NULL };
+    char sDir[XPATH_MAX];
+
+    for (i = 0; pMultiarch != NULL && pPrefixes[i] != NULL; i++)
+    {
+        xstrncpyf(sDir, sizeof(sDir), "%s/%s", pPrefixes[i], pMultiarch);
+        if (SMake_LdCacheCheck(sDir, pName, pPath, bRecursive, pFound, nSize)) return XTRUE;
+    }
+
+    return XFALSE;
+}
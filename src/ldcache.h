@@ -0,0 +1,39 @@
+/*!
+ *  @file smake/src/ldcache.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Library directories known by the dynamic loader.
+ */
+
+#ifndef __SMAKE_LDCACHE_H__
+#define __SMAKE_LDCACHE_H__
+
+#include "stdinc.h"
+#include "list.h"
+
+#define SMAKE_LDCACHE_FILE  "/etc/ld.so.cache"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SMakeLdCache {
+    smake_list_t dirs;      /* Directories of the cached libraries in cache order */
+    xbool_t bLoaded;
+} smake_ldcache_t;
+
+void SMake_LdCacheInit(smake_ldcache_t *pCache);
+void SMake_LdCacheDestroy(smake_ldcache_t *pCache);
+
+const char* SMake_LdCacheMultiarch(void);
+xbool_t SMake_LdCacheLoad(smake_ldcache_t *pCache, const char *pPath);
+xbool_t SMake_LdCacheFind(smake_ldcache_t *pCache, const char *pName, const char *pPath,
+                          xbool_t bRecursive, char *pFound, size_t nSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_LDCACHE_H__ */
@@ -0,0 +1,77 @@
+/*!
+ *  @file smake/src/list.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Insertion ordered list of unique strings.
+ */
+
+#include "list.h"
+
+static void SMake_ListClearCb(xarray_data_t *pArrData)
+{
+    XASSERT_VOID_RET(pArrData);
+    XASSERT_VOID_RET(pArrData->pData);
+
+    free(pArrData->pData);
+    pArrData->pData = NULL;
+    pArrData->nSize = 0;
+}
+
+void SMake_ListInit(smake_list_t *pList)
+{
+    XArray_Init(&pList->array, NULL, XSTDNON, XFALSE);
+    pList->array.clearCb = SMake_ListClearCb;
+    XMap_Init(&pList->index, SMAKE_LIST_SIZE);
+}
+
+void SMake_ListClear(smake_list_t *pList)
+{
+    /* Index keys point to array entries, drop them first */
+    XMap_Destroy(&pList->index);
+    XArray_Clear(&pList->array);
+    XMap_Init(&pList->index, SMAKE_LIST_SIZE);
+}
+
+void SMake_ListDestroy(smake_list_t *pList)
+{
+    XMap_Destroy(&pList->index);
+    XArray_Destroy(&pList->array);
+}
+
+xbool_t SMake_ListContains(smake_list_t *pList, const char *pEntry)
+{
+    XASSERT(pEntry, XFALSE);
+    return XMap_Get(&pList->index, pEntry) != NULL ? XTRUE : XFALSE;
+}
+
+xbool_t SMake_AddToList(smake_list_t *pList, const char *pFmt, ...)
+{
+    va_list args;
+    size_t nLength = 0;
+
+    va_start(args, pFmt);
+    char *pDest = xstracpyargs(pFmt, args, &nLength);
+    va_end(args);
+    XASSERT(pDest, XFALSE);
+
+    if (XMap_Get(&pList->index, pDest) != NULL)
+    {
+        free(pDest);
+        return XTRUE;
+    }
+
+    int nIndex = XArray_AddData(&pList->array, pDest, XSTDNON);
+    xarray_data_t *pArrData = XArray_Get(&pList->array, nIndex);
+
+    if (pArrData == NULL)
+    {
+        free(pDest);
+        return XFALSE;
+    }
+
+    pArrData->nSize = nLength + 1;
+    XMap_Put(&pList->index, pDest, pDest);
+    return XTRUE;
+}
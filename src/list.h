@@ -0,0 +1,37 @@
+/*!
+ *  @file smake/src/list.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Insertion ordered list of unique strings.
+ */
+
+#ifndef __SMAKE_LIST_H__
+#define __SMAKE_LIST_H__
+
+#include "stdinc.h"
+
+#define SMAKE_LIST_SIZE     64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SMakeList {
+    xarray_t array;     /* Entries in first-seen order */
+    xmap_t index;       /* Entry lookup for de-duplication */
+} smake_list_t;
+
+void SMake_ListInit(smake_list_t *pList);
+void SMake_ListClear(smake_list_t *pList);
+void SMake_ListDestroy(smake_list_t *pList);
+
+xbool_t SMake_ListContains(smake_list_t *pList, const char *pEntry);
+xbool_t SMake_AddToList(smake_list_t *pList, const char *pFmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_LIST_H__ */
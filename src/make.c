@@ -7,56 +7,259 @@
  * @brief Analyze project and generate the Makefile.
  */
 
+#include <ctype.h>
 #include "stdinc.h"
 #include "make.h"
+#include "entry.h"
+#include "find.h"
+#include "incl.h"
+#include "ninja.h"
+#include "pch.h"
+#include "report.h"
+#include "scan.h"
+#include "unity.h"
 #include "cfg.h"
 
-void SMake_ClearCallback(xarray_data_t *pArrData)
+const SMakeDir* SMake_DirIntern(smake_ctx_t *pCtx, const char *pPath)
 {
-    XASSERT_VOID_RET(pArrData);
-    XASSERT_VOID_RET(pArrData->pData);
+    size_t nFullLength = strlen(pPath);
+    size_t nLength = nFullLength;
+    while (nLength > 1 && pPath[nLength - 1] == '/') nLength--;
 
-    free(pArrData->pData);
-    pArrData->pData = NULL;
-    pArrData->nSize = 0;
+    char *pTrimmed = NULL;
+    if (nLength != nFullLength)
+    {
+        pTrimmed = xstracpy("%.*s", (int)nLength, pPath);
+        XASSERT(pTrimmed, NULL);
+    }
+
+    const char *pKey = pTrimmed != NULL ? pTrimmed : pPath;
+    SMakeDir *pDir = (SMakeDir*)XMap_Get(&pCtx->dirMap, pKey);
+
+    if (pDir == NULL)
+    {
+        pDir = (SMakeDir*)SMake_ArenaAlloc(&pCtx->arena, sizeof(SMakeDir));
+        char *pCopy = SMake_ArenaStrdup(&pCtx->arena, pKey, nLength);
+
+        if (pDir == NULL || pCopy == NULL)
+        {
+            xloge("Faild to allocate memory for directory: %s", pPath);
+            free(pTrimmed);
+            return NULL;
+        }
+
+        pDir->pPath = pCopy;
+        pDir->nLength = nLength;
+        XMap_Put(&pCtx->dirMap, pDir->pPath, pDir);
+    }
+
+    free(pTrimmed);
+    return pDir;
 }
 
-SMakeFile* SMake_FileNew(const char *pPath, const char *pName, int nType)
+SMakeFile* SMake_FileNew(smake_ctx_t *pCtx, const SMakeDir *pDir, const char *pName, int nType)
 {
-    SMakeFile *pFile = malloc(sizeof(SMakeFile));
-    if (pFile == NULL)
+    XASSERT((pDir != NULL && pName != NULL), NULL);
+    size_t nLength = strlen(pName);
+
+    SMakeFile *pFile = (SMakeFile*)SMake_ArenaAlloc(&pCtx->arena, sizeof(SMakeFile));
+    char *pNameCopy = SMake_ArenaStrdup(&pCtx->arena, pName, nLength);
+
+    if (pFile == NULL || pNameCopy == NULL)
     {
         xloge("Faild to allocate memory for SmakeFile.");
         return NULL;
     }
 
-    size_t nLength = xstrncpy(pFile->sPath, sizeof(pFile->sPath), pPath);
-    while (pFile->sPath[--nLength] == '/') pFile->sPath[nLength] = '\0';
-
-    xstrncpy(pFile->sName, sizeof(pFile->sName), pName);
+    pFile->pName = pNameCopy;
+    pFile->nLength = nLength;
+    pFile->pSource = NULL;
+    pFile->pBinary = NULL;
+    pFile->bNoPch = XFALSE;
     pFile->nType = nType;
+    pFile->pDir = pDir;
     return pFile;
 }
 
+static size_t SMake_StemLength(const SMakeFile *pFile)
+{
+    const char *pExt = strrchr(pFile->pName, '.');
+    return pExt != NULL ? (size_t)(pExt - pFile->pName) : pFile->nLength;
+}
+
+/* Appends directory of the source relative to the project path, ".." becomes "__" */
+static size_t SMake_MirrorDir(smake_ctx_t *pCtx, const SMakeDir *pDir, char *pOutput, size_t nSize)
+{
+    const char *pPath = pDir->pPath;
+    size_t nRoot = strlen(pCtx->sPath);
+    size_t nUsed = 0;
+
+    if (!strncmp(pPath, pCtx->sPath, nRoot) &&
+        (pPath[nRoot] == '/' || pPath[nRoot] == XSTR_NUL)) pPath += nRoot;
+
+    while (*pPath)
+    {
+        while (*pPath == '/') pPath++;
+        size_t nLength = strcspn(pPath, "/");
+        if (!nLength) break;
+
+        const char *pName = pPath;
+        pPath += nLength;
+
+        if (nLength == 1 && pName[0] == '.') continue;
+        if (nLength == 2 && !strncmp(pName, "..", 2)) pName = "__";
+
+        int nBytes = xstrncpyf(pOutput + nUsed, nSize - nUsed, "%.*s/", (int)nLength, pName);
+        if (nBytes <= 0 || nUsed + nBytes >= nSize) break;
+        nUsed += nBytes;
+    }
+
+    return nUsed;
+}
+
+/* Number of path components other than ".", e.g. ./obj/release gives 2 */
+static size_t SMake_PathDepth(const char *pPath)
+{
+    size_t nDepth = 0;
+
+    while (*pPath)
+    {
+        while (*pPath == '/') pPath++;
+        size_t nLength = strcspn(pPath, "/");
+        if (!nLength) break;
+
+        if (nLength != 1 || pPath[0] != '.') nDepth++;
+        pPath += nLength;
+    }
+
+    return nDepth;
+}
+
+SMakeFile* SMake_ObjectNew(smake_ctx_t *pCtx, const SMakeFile *pSource)
+{
+    SMakeFile *pObj = (SMakeFile*)SMake_ArenaAlloc(&pCtx->arena, sizeof(SMakeFile));
+    if (pObj == NULL)
+    {
+        xloge("Faild to allocate memory for SmakeFile.");
+        return NULL;
+    }
+
+    /* Object name is a slice of the source name without extension */
+    pObj->nLength = SMake_StemLength(pSource);
+    pObj->pName = pSource->pName;
+    pObj->pDir = pSource->pDir;
+    pObj->nType = SMAKE_FILE_OBJ;
+    pObj->pSource = pSource;
+    pObj->pBinary = NULL;
+    pObj->bNoPch = XFALSE;
+    pObj->bMain = XFALSE;
+
+    if (pCtx->bMirror)
+    {
+        /* Mirrored objects are named by their path under $(ODIR), it is never longer than the source path */
+        size_t nSize = pSource->pDir->nLength + pObj->nLength + 2;
+        char *pName = (char*)SMake_ArenaAlloc(&pCtx->arena, nSize);
+        XASSERT(pName, NULL);
+
+        size_t nUsed = SMake_MirrorDir(pCtx, pSource->pDir, pName, nSize);
+        memcpy(pName + nUsed, pSource->pName, pObj->nLength);
+        pName[nUsed + pObj->nLength] = XSTR_NUL;
+
+        pObj->nLength = nUsed + pObj->nLength;
+        pObj->pName = pName;
+    }
+
+    return pObj;
+}
+
+static void SMake_ProfileClear(xarray_data_t *pArrData)
+{
+    XASSERT_VOID_RET(pArrData);
+    smake_profile_t *pProfile = (smake_profile_t*)pArrData->pData;
+    XASSERT_VOID_RET(pProfile);
+
+    SMake_ListDestroy(&pProfile->flagArr);
+    SMake_ListDestroy(&pProfile->libArr);
+    SMake_ListDestroy(&pProfile->ldArr);
+    free(pProfile);
+
+    pArrData->pData = NULL;
+    pArrData->nSize = 0;
+}
+
+smake_profile_t* SMake_ProfileNew(smake_ctx_t *pCtx, const char *pName)
+{
+    XASSERT(xstrused(pName), NULL);
+    size_t i, nLength = strlen(pName);
+
+    /* Name is used as a make value and a directory name */
+    for (i = 0; i < nLength; i++)
+    {
+        if (!isalnum((unsigned char)pName[i]) && pName[i] != '_' && pName[i] != '-')
+        {
+            xloge("Invalid profile name: %s (expected letters, digits, '_' or '-')", pName);
+            return NULL;
+        }
+    }
+
+    size_t nUsed = XArray_Used(&pCtx->profiles);
+    for (i = 0; i < nUsed; i++)
+    {
+        smake_profile_t *pProfile = (smake_profile_t*)XArray_GetData(&pCtx->profiles, i);
+        if (pProfile != NULL && !strcmp(pProfile->sName, pName)) return pProfile;
+    }
+
+    smake_profile_t *pProfile = (smake_profile_t*)calloc(1, sizeof(smake_profile_t));
+    XASSERT(pProfile, NULL);
+
+    xstrncpy(pProfile->sName, sizeof(pProfile->sName), pName);
+    SMake_ListInit(&pProfile->flagArr);
+    SMake_ListInit(&pProfile->libArr);
+    SMake_ListInit(&pProfile->ldArr);
+
+    if (XArray_AddData(&pCtx->profiles, pProfile, XSTDNON) < 0)
+    {
+        SMake_ListDestroy(&pProfile->flagArr);
+        SMake_ListDestroy(&pProfile->libArr);
+        SMake_ListDestroy(&pProfile->ldArr);
+        free(pProfile);
+        return NULL;
+    }
+
+    return pProfile;
+}
+
 void SMake_InitContext(smake_ctx_t *pCtx) 
 {
-    XArray_Init(&pCtx->includes, NULL, XSTDNON, XFALSE);
-    XArray_Init(&pCtx->excludes, NULL, XSTDNON, XFALSE);
+    SMake_ListInit(&pCtx->includes);
+    SMake_ListInit(&pCtx->headerDirs);
+    SMake_ListInit(&pCtx->excludes);
     XArray_Init(&pCtx->fileArr, NULL, XSTDNON, XFALSE);
-    XArray_Init(&pCtx->pathArr, NULL, XSTDNON, XFALSE);
-    XArray_Init(&pCtx->flagArr, NULL, XSTDNON, XFALSE);
-    XArray_Init(&pCtx->libArr, NULL, XSTDNON, XFALSE);
+    SMake_ListInit(&pCtx->pathArr);
+    SMake_ListInit(&pCtx->flagArr);
+    SMake_ListInit(&pCtx->libArr);
     XArray_Init(&pCtx->objArr, NULL, XSTDNON, XFALSE);
-    XArray_Init(&pCtx->ldArr, NULL, XSTDNON, XFALSE);
-
-    pCtx->includes.clearCb = SMake_ClearCallback;
-    pCtx->excludes.clearCb = SMake_ClearCallback;
-    pCtx->pathArr.clearCb = SMake_ClearCallback;
-    pCtx->fileArr.clearCb = SMake_ClearCallback;
-    pCtx->flagArr.clearCb = SMake_ClearCallback;
-    pCtx->libArr.clearCb = SMake_ClearCallback;
-    pCtx->objArr.clearCb = SMake_ClearCallback;
-    pCtx->ldArr.clearCb = SMake_ClearCallback;
+    XArray_Init(&pCtx->srcObjArr, NULL, XSTDNON, XFALSE);
+    SMake_ListInit(&pCtx->ldArr);
+    XArray_Init(&pCtx->profiles, NULL, XSTDNON, XFALSE);
+    pCtx->profiles.clearCb = SMake_ProfileClear;
+    SMake_ExclInit(&pCtx->excludeIdx);
+    SMake_ListInit(&pCtx->unityExcludes);
+    SMake_ExclInit(&pCtx->unityExclIdx);
+
+    /* File and object records are owned by the arena */
+    pCtx->fileArr.clearCb = NULL;
+    pCtx->objArr.clearCb = NULL;
+    pCtx->srcObjArr.clearCb = NULL;
+    SMake_ArenaInit(&pCtx->arena);
+    XMap_Init(&pCtx->dirMap, SMAKE_NAME_MAX);
+    SMake_CacheInit(&pCtx->prevCache);
+    SMake_CacheInit(&pCtx->nextCache);
+    SMake_FindCacheInit(&pCtx->findCache);
+    SMake_LdCacheInit(&pCtx->ldCache);
+    SMake_PkgInit(&pCtx->pkgCache);
+    SMake_ListInit(&pCtx->watchDirs);
+    SMake_ListInit(&pCtx->mainFiles);
 
     pCtx->sPath[0] = pCtx->sOutDir[0] = '.';
     pCtx->sPath[1] = pCtx->sOutDir[1] = XSTR_NUL;
@@ -69,26 +272,105 @@ void SMake_InitContext(smake_ctx_t *pCtx)
     pCtx->sConfig[0] = XSTR_NUL;
     pCtx->sName[0] = XSTR_NUL;
     pCtx->sMain[0] = XSTR_NUL;
+    pCtx->sLauncher[0] = XSTR_NUL;
+    pCtx->sPgoTrain[0] = XSTR_NUL;
+    pCtx->sReportDir[0] = XSTR_NUL;
+    pCtx->sLinker[0] = XSTR_NUL;
 
     pCtx->bSrcFromCfg = XFALSE;
+    pCtx->bUseCache = XTRUE;
+    pCtx->bDepends = XTRUE;
+    pCtx->bMirror = XFALSE;
+    pCtx->bCompDB = XFALSE;
     pCtx->bOverwrite = XFALSE;
     pCtx->bInitProj = XFALSE;
     pCtx->bWriteCfg = XFALSE;
     pCtx->bVPath = XFALSE;
     pCtx->bIsCPP = XFALSE;
     pCtx->nVerbose = XSTDNON;
+    pCtx->nScanThreads = 1;
+    pCtx->nBackend = SMAKE_BACKEND_MAKE;
+    pCtx->nUnitySize = 0;
+    pCtx->bUnityPerDir = XFALSE;
+    pCtx->nPchHeaders = 0;
+    pCtx->bUsePch = XFALSE;
+    pCtx->bAutoLauncher = XFALSE;
+    pCtx->nLto = SMAKE_LTO_NONE;
+    pCtx->nMains = 0;
+    pCtx->bAutoLinker = XFALSE;
+    pCtx->bGcSections = XFALSE;
+    pCtx->bTimeTrace = XFALSE;
+    pCtx->bReport = XFALSE;
+    pCtx->bMinIncludes = XFALSE;
+    pCtx->bFindRefresh = XFALSE;
+    pCtx->bWatch = XFALSE;
+    pCtx->bRegenerate = XFALSE;
+    pCtx->nArgOptions = 0;
+    pCtx->bMainName = XFALSE;
+    pCtx->bToolsFound = XFALSE;
+    pCtx->nCfgIncludes = 0;
 }
 
 void SMake_ClearContext(smake_ctx_t *pCtx)
 {
-    XArray_Destroy(&pCtx->includes);
-    XArray_Destroy(&pCtx->excludes);
+    SMake_ListDestroy(&pCtx->includes);
+    SMake_ListDestroy(&pCtx->headerDirs);
+    SMake_ListDestroy(&pCtx->excludes);
     XArray_Destroy(&pCtx->fileArr);
-    XArray_Destroy(&pCtx->pathArr);
-    XArray_Destroy(&pCtx->flagArr);
-    XArray_Destroy(&pCtx->libArr);
+    SMake_ListDestroy(&pCtx->pathArr);
+    SMake_ListDestroy(&pCtx->flagArr);
+    SMake_ListDestroy(&pCtx->libArr);
     XArray_Destroy(&pCtx->objArr);
-    XArray_Destroy(&pCtx->ldArr);
+    XArray_Destroy(&pCtx->srcObjArr);
+    SMake_ListDestroy(&pCtx->ldArr);
+    XArray_Destroy(&pCtx->profiles);
+    SMake_ExclDestroy(&pCtx->excludeIdx);
+    SMake_ListDestroy(&pCtx->unityExcludes);
+    SMake_ExclDestroy(&pCtx->unityExclIdx);
+    XMap_Destroy(&pCtx->dirMap);
+    SMake_ArenaDestroy(&pCtx->arena);
+    SMake_CacheDestroy(&pCtx->prevCache);
+    SMake_CacheDestroy(&pCtx->nextCache);
+    SMake_FindCacheDestroy(&pCtx->findCache);
+    SMake_LdCacheDestroy(&pCtx->ldCache);
+    SMake_PkgDestroy(&pCtx->pkgCache);
+    SMake_ListDestroy(&pCtx->watchDirs);
+    SMake_ListDestroy(&pCtx->mainFiles);
+}
+
+void SMake_ResetProject(smake_ctx_t *pCtx)
+{
+    /* Options and search results are kept, everything found by the scan is dropped */
+    smake_list_t includes = pCtx->includes;
+    SMake_ListInit(&pCtx->includes);
+    size_t i;
+
+    for (i = 0; i < pCtx->nCfgIncludes; i++)
+    {
+        const char *pPath = (const char*)XArray_GetData(&includes.array, i);
+        if (pPath != NULL) SMake_AddToList(&pCtx->includes, "%s", pPath);
+    }
+
+    SMake_ListDestroy(&includes);
+    SMake_ListClear(&pCtx->headerDirs);
+    SMake_ListClear(&pCtx->pathArr);
+    SMake_ListClear(&pCtx->watchDirs);
+    SMake_ListClear(&pCtx->mainFiles);
+
+    /* File and object records are owned by the arena */
+    XArray_Clear(&pCtx->fileArr);
+    XArray_Clear(&pCtx->objArr);
+    XArray_Clear(&pCtx->srcObjArr);
+    XMap_Destroy(&pCtx->dirMap);
+    XMap_Init(&pCtx->dirMap, SMAKE_NAME_MAX);
+    SMake_ArenaDestroy(&pCtx->arena);
+    SMake_ArenaInit(&pCtx->arena);
+
+    if (pCtx->bMainName) pCtx->sName[0] = XSTR_NUL;
+    pCtx->sMain[0] = XSTR_NUL;
+    pCtx->bMainName = XFALSE;
+    pCtx->bUsePch = XFALSE;
+    pCtx->nMains = 0;
 }
 
 int SMake_GetFileType(const char *pPath, int nLen)
@@ -101,10 +383,25 @@ int SMake_GetFileType(const char *pPath, int nLen)
     return SMAKE_FILE_UNF;
 }
 
+static void SMake_GetCachePath(smake_ctx_t *pCtx, char *pOutput, size_t nSize)
+{
+    /* Cache lives next to the generated Makefile */
+    if (pCtx->bVPath) xstrncpy(pOutput, nSize, SMAKE_CACHE_FILE);
+    else xstrncpyf(pOutput, nSize, "%s/%s", pCtx->sPath, SMAKE_CACHE_FILE);
+}
+
 xbool_t SMake_LoadFiles(smake_ctx_t *pCtx, const char *pPath)
 {
     const char *pFilePath = pPath ? pPath : pCtx->sPath;
 
+    /* Watch mode passes the cache of the previous run in memory */
+    if (pCtx->bUseCache && !XArray_Used(&pCtx->prevCache.dirArr) && !XArray_Used(&pCtx->prevCache.srcArr))
+    {
+        char sCachePath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+        SMake_GetCachePath(pCtx, sCachePath, sizeof(sCachePath));
+        SMake_CacheLoad(&pCtx->prevCache, sCachePath);
+    }
+
     if (pCtx->bSrcFromCfg)
     {
         size_t nUsed = XArray_Used(&pCtx->fileArr);
@@ -118,93 +415,181 @@ xbool_t SMake_LoadFiles(smake_ctx_t *pCtx, const char *pPath)
         return XFALSE;
     }
 
-    xdir_t dir;
-    if (XDir_Open(&dir, pFilePath) < 0)
+    return SMake_ScanFiles(pCtx, pFilePath);
+}
+
+static xbool_t SMake_FindMain(smake_ctx_t *pCtx, const char *pPath)
+{
+    struct stat fileStat;
+    xbool_t bStat = (pCtx->bUseCache && stat(pPath, &fileStat) >= 0) ? XTRUE : XFALSE;
+    int nCached = bStat ? SMake_CacheGetMain(&pCtx->prevCache, pPath, &fileStat) : XSTDERR;
+
+    /* Unchanged sources are not read again */
+    xbool_t bHasMain = nCached >= 0 ? (xbool_t)nCached : SMake_HasMain(pPath);
+    if (bStat) SMake_CacheAddSource(&pCtx->nextCache, pPath, &fileStat, bHasMain);
+    if (!bHasMain) return XFALSE;
+
+    xlogi("Located main function in the file: %s", pPath);
+    return XTRUE;
+}
+
+/* Entry point and the number of its directories used in the binary name */
+typedef struct SMakeMain {
+    SMakeFile *pObj;
+    size_t nDepth;
+    xbool_t bFull;
+    char sName[SMAKE_NAME_MAX];
+} smake_main_t;
+
+static void SMake_MainFormat(smake_ctx_t *pCtx, smake_main_t *pMain)
+{
+    const SMakeFile *pSrc = pMain->pObj->pSource;
+    char sDir[SMAKE_PATH_MAX];
+    char sName[SMAKE_NAME_MAX];
+
+    /* Name is built from the end: last directories of the source and its stem, e.g. a_main */
+    size_t nStem = SMake_StemLength(pSrc);
+    if (nStem >= sizeof(sName)) nStem = sizeof(sName) - 1;
+    size_t nFirst = sizeof(sName) - 1 - nStem;
+    memcpy(&sName[nFirst], pSrc->pName, nStem);
+    sName[sizeof(sName) - 1] = XSTR_NUL;
+
+    size_t nEnd = SMake_MirrorDir(pCtx, pSrc->pDir, sDir, sizeof(sDir));
+    size_t nDirs = 0;
+
+    while (nDirs < pMain->nDepth && nEnd > 0)
     {
-        xloge("Failed to open directory: %s (%s)", pFilePath, XSTRERR);
-        return XFALSE;
+        size_t nStart = --nEnd;
+        while (nStart > 0 && sDir[nStart - 1] != '/') nStart--;
+
+        size_t nLength = nEnd - nStart;
+        if (nLength + 1 > nFirst) break;
+
+        nFirst -= nLength + 1;
+        memcpy(&sName[nFirst], &sDir[nStart], nLength);
+        sName[nFirst + nLength] = '_';
+        nEnd = nStart;
+        nDirs++;
     }
 
-    char sFileName[SMAKE_NAME_MAX];
-    while(XDir_Read(&dir, sFileName, sizeof(sFileName)) > 0)
-    {
-        char sFullPath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
-        int nBytes = xstrncpyf(sFullPath, sizeof(sFullPath), "%s/%s", pFilePath, sFileName);
-        if (nBytes <= 0) continue;
+    pMain->bFull = nDirs < pMain->nDepth ? XTRUE : XFALSE;
+    xstrncpy(pMain->sName, sizeof(pMain->sName), &sName[nFirst]);
+}
 
-        if (SMake_IsExcluded(pCtx, sFullPath))
-        {
-            xlogi("Path is excluded: %s", sFullPath);
-            continue;
-        }
+static xbool_t SMake_MainTaken(smake_ctx_t *pCtx, const char *pName)
+{
+    static const char *pTargets[] = { "all", "clean", "install", "pgo-gen", "pgo-train", "pgo-use", NULL };
+    size_t i, nLength = strlen(pName);
 
-        int nType = SMake_GetFileType(sFullPath, nBytes);
-        xbool_t bIsDir = (int)(dir.pEntry->d_type) == 4 ? XTRUE : XFALSE;
+    for (i = 0; pTargets[i] != NULL; i++)
+        if (!strcmp(pTargets[i], pName)) return XTRUE;
 
-        if (!bIsDir && nType != SMAKE_FILE_UNF)
-        {
-            SMakeFile *pFile = SMake_FileNew(pFilePath, sFileName, nType);
-            if (pFile == NULL) return XFALSE;
+    /* Objects of mirror mode and sources of "." output are in directories next to the binaries */
+    if (!pCtx->bMirror && strcmp(pCtx->sOutDir, ".")) return XFALSE;
+    size_t nObjs = XArray_Used(&pCtx->objArr);
+    char sDir[SMAKE_PATH_MAX];
 
-            xlogd("Found project file: %s", sFullPath);
-            XArray_AddData(&pCtx->fileArr, pFile, XSTDNON);
-        }
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || pObj->pSource == NULL) continue;
 
-        if (bIsDir) SMake_LoadFiles(pCtx, sFullPath);
+        size_t nUsed = SMake_MirrorDir(pCtx, pObj->pSource->pDir, sDir, sizeof(sDir));
+        if (nUsed > nLength && sDir[nLength] == '/' && !strncmp(sDir, pName, nLength)) return XTRUE;
     }
 
-    XDir_Close(&dir);
-    return XTRUE;
+    return XFALSE;
 }
 
-static xbool_t SMake_FindMain(smake_ctx_t *pCtx, const char *pPath)
+static int SMake_MainCompare(const void *pA, const void *pB)
 {
-    xbyte_buffer_t buffer;
-    XPath_LoadBuffer(pPath, &buffer);
-    XASSERT_RET(buffer.pData, XFALSE);
+    return strcmp(((const smake_main_t*)pA)->sName, ((const smake_main_t*)pB)->sName);
+}
+
+static xbool_t SMake_NameMains(smake_ctx_t *pCtx)
+{
+    size_t i, j, nCount = 0, nObjs = XArray_Used(&pCtx->objArr);
+    XASSERT_RET(SMake_IsMulti(pCtx), XTRUE);
 
-    char *pBuffer = (char*)buffer.pData;
-    int nPosit = xstrsrc(pBuffer, "main");
+    if (xstrused(pCtx->sName))
+        xlogw("Program name is ignored, every entry point gets own binary: %s", pCtx->sName);
 
-    if (nPosit <= 0)
+    smake_main_t *pMains = (smake_main_t*)calloc(pCtx->nMains, sizeof(smake_main_t));
+    if (pMains == NULL)
     {
-        XByteBuffer_Clear(&buffer);
+        xloge("Failed to allocate memory for binary names: %s", XSTRERR);
         return XFALSE;
     }
 
-    /* Check empty space before "main" */
-    if (pBuffer[nPosit - 1] != '\n' &&
-        pBuffer[nPosit - 1] != '\t' &&
-        pBuffer[nPosit - 1] != ' ')
+    for (i = 0; i < nObjs && nCount < pCtx->nMains; i++)
     {
-        XByteBuffer_Clear(&buffer);
-        return XFALSE;
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || !pObj->bMain) continue;
+
+        pMains[nCount].pObj = pObj;
+        SMake_MainFormat(pCtx, &pMains[nCount++]);
     }
 
-    nPosit += 4; /* Skip "main" */
-    xbool_t bRetVal = XFALSE;
+    /* Sources with the same stem take their directories into the name until it is unique */
+    xbool_t bCollision = XTRUE, bStatus = XTRUE;
+    while (bCollision && bStatus)
+    {
+        qsort(pMains, nCount, sizeof(smake_main_t), SMake_MainCompare);
+        bCollision = XFALSE;
 
-    /* Skip empty space */
-    while (pBuffer[nPosit] == '\n') nPosit++;
-    while (pBuffer[nPosit] == '\t') nPosit++;
-    while (pBuffer[nPosit] == ' ') nPosit++;
+        /* Names of phony targets and directories are taken, e.g. tools/tools.c becomes tools_tools */
+        for (i = 0; i < nCount && bStatus; i++)
+        {
+            if (!SMake_MainTaken(pCtx, pMains[i].sName)) continue;
 
-    /* Check if function is starting */
-    if (pBuffer[nPosit] == '(')
-    {
-        xlogi("Located main function in the file: %s", pPath);
-        bRetVal = XTRUE;
+            if (pMains[i].bFull)
+            {
+                xloge("Binary name is reserved: %s", pMains[i].sName);
+                bStatus = XFALSE;
+                break;
+            }
+
+            pMains[i].nDepth++;
+            SMake_MainFormat(pCtx, &pMains[i]);
+            bCollision = XTRUE;
+        }
 
-        if (xstrused(pCtx->sMain))
+        if (bCollision) continue;
+
+        for (i = 0; i < nCount && bStatus; i = j)
         {
-            xloge("Main function already exists in \"%s\" object", pCtx->sMain);
-            xlogi("You can exclude file or directory with argument: -e");
-            bRetVal = XFALSE;
+            xbool_t bGrown = XFALSE;
+            for (j = i + 1; j < nCount && !strcmp(pMains[i].sName, pMains[j].sName); j++);
+            if (j - i < 2) continue;
+
+            for (bCollision = XTRUE; i < j; i++)
+            {
+                if (pMains[i].bFull) continue;
+                pMains[i].nDepth++;
+                SMake_MainFormat(pCtx, &pMains[i]);
+                bGrown = XTRUE;
+            }
+
+            if (!bGrown)
+            {
+                xloge("Binary name is not unique: %s", pMains[j - 1].sName);
+                bStatus = XFALSE;
+            }
         }
     }
 
-    XByteBuffer_Clear(&buffer);
-    return bRetVal;
+    for (i = 0; i < nCount && bStatus; i++)
+    {
+        smake_main_t *pMain = &pMains[i];
+        pMain->pObj->pBinary = SMake_ArenaStrdup(&pCtx->arena, pMain->sName, strlen(pMain->sName));
+        if (pMain->pObj->pBinary == NULL) bStatus = XFALSE;
+
+        if (pMain->nDepth) xlogi("Binary of %s/%s is named: %s",
+            pMain->pObj->pSource->pDir->pPath, pMain->pObj->pSource->pName, pMain->sName);
+    }
+
+    free(pMains);
+    return bStatus;
 }
 
 xbool_t SMake_ParseProject(smake_ctx_t *pCtx)
@@ -216,49 +601,50 @@ xbool_t SMake_ParseProject(smake_ctx_t *pCtx)
         return XFALSE;
     }
 
+    /* Include paths from the config are kept, discovered ones can be reduced */
+    size_t nFixed = XArray_Used(&pCtx->includes.array);
+    pCtx->nCfgIncludes = nFixed;
+
     for (i = 0; i < nFiles; i++)
     {
         SMakeFile *pFile = (SMakeFile*)XArray_GetData(&pCtx->fileArr, i);
         if (pFile != NULL)
         {
-            char sName[SMAKE_NAME_MAX];
-            xstrncpy(sName, sizeof(sName), pFile->sName);
-
-            int nLength = strlen(sName);
-            int nLastBytes = 0;
-
-            if (pFile->nType == SMAKE_FILE_CPP) nLastBytes = 4;
-            else if (pFile->nType == SMAKE_FILE_C) nLastBytes = 2;
-            else if (pFile->nType == SMAKE_FILE_H || 
-                     pFile->nType == SMAKE_FILE_HPP)
+            if (pFile->nType == SMAKE_FILE_H ||
+                pFile->nType == SMAKE_FILE_HPP)
             {
-                SMake_AddToArray(&pCtx->includes, "%s", pFile->sPath);
+                SMake_AddToList(&pCtx->includes, "%s", pFile->pDir->pPath);
                 continue;
             }
 
-            if (!nLastBytes)
+            if (pFile->nType != SMAKE_FILE_CPP &&
+                pFile->nType != SMAKE_FILE_C)
             {
-                xlogd("Skipping file: %s/%s", pFile->sPath, pFile->sName);
+                xlogd("Skipping file: %s/%s", pFile->pDir->pPath, pFile->pName);
                 continue;
             }
 
-            nLength -= nLastBytes;
-            sName[nLength] = XSTR_NUL;
-
-            char sPath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
-            xstrncpyf(sPath, sizeof(sPath), "%s/%s", pFile->sPath, pFile->sName);
-            if (SMake_FindMain(pCtx, sPath)) xstrncpy(pCtx->sMain, sizeof(pCtx->sMain), sName);
+            SMakeFile *pObj = SMake_ObjectNew(pCtx, pFile);
+            if (pObj == NULL) continue;
 
-            size_t nLeftBytes = sizeof(sName) - nLength;
-            strncat(sName, ".$(OBJ)", nLeftBytes);
-
-            SMakeFile *pObj = SMake_FileNew(pFile->sPath, sName, SMAKE_FILE_OBJ);
-            if (pObj != NULL)
+            /* First main() names the target, with more of them every one gets its own binary.
+             * Libraries do not have entry points, their sources are not read for it. */
+            if (strstr(pCtx->sName, ".a") == NULL && strstr(pCtx->sName, ".so") == NULL)
             {
-                SMake_AddToArray(&pCtx->pathArr, "%s", pObj->sPath);
-                XArray_AddData(&pCtx->objArr, pObj, XSTDNON);
-                xlogd("Loaded compile object: %s/%s", pObj->sPath, sName);
+                char *pPath = xstracpy("%s/%s", pFile->pDir->pPath, pFile->pName);
+                if (pPath != NULL && SMake_FindMain(pCtx, pPath))
+                {
+                    if (pCtx->bWatch) SMake_AddToList(&pCtx->mainFiles, "%s", pPath);
+                    if (!pCtx->nMains++) xstrncpyf(pCtx->sMain, sizeof(pCtx->sMain), "%.*s", (int)SMake_StemLength(pFile), pFile->pName);
+                    pObj->bMain = XTRUE;
+                }
+
+                free(pPath);
             }
+
+            SMake_AddToList(&pCtx->pathArr, "%s", pObj->pDir->pPath);
+            XArray_AddData(&pCtx->objArr, pObj, XSTDNON);
+            xlogd("Loaded compile object: %s/%.*s.$(OBJ)", pObj->pDir->pPath, (int)pObj->nLength, pObj->pName);
         }
     }
 
@@ -268,7 +654,10 @@ xbool_t SMake_ParseProject(smake_ctx_t *pCtx)
         return XFALSE;
     }
 
-    return XTRUE;
+    if (!SMake_NameMains(pCtx)) return XFALSE;
+    if (pCtx->bMinIncludes && !SMake_InclBuild(pCtx, nFixed)) return XFALSE;
+    if (!SMake_PchBuild(pCtx)) return XFALSE;
+    return SMake_UnityBuild(pCtx);
 }
 
 xbool_t SMake_InitProject(smake_ctx_t *pCtx)
@@ -346,8 +735,21 @@ int SMake_CompareName(const void *pData1, const void *pData2, void *pCtx)
     SMakeFile *pObj1 = (SMakeFile*)pFirst->pData;
     SMakeFile *pObj2 = (SMakeFile*)pSecond->pData;
 
+    /* Order as the emitted "name.$(OBJ)" strings */
+    const char *pSuffix = ".$(OBJ)";
+    size_t nSuffix = strlen(pSuffix);
+    size_t i, nLength1 = pObj1->nLength + nSuffix;
+    size_t nLength2 = pObj2->nLength + nSuffix;
+
+    for (i = 0; i < nLength1 && i < nLength2; i++)
+    {
+        uint8_t nChar1 = i < pObj1->nLength ? pObj1->pName[i] : pSuffix[i - pObj1->nLength];
+        uint8_t nChar2 = i < pObj2->nLength ? pObj2->pName[i] : pSuffix[i - pObj2->nLength];
+        if (nChar1 != nChar2) return (int)nChar1 - (int)nChar2;
+    }
+
     (void)pCtx;
-    return strcmp(pObj1->sName, pObj2->sName);
+    return (int)(nLength1 > nLength2) - (int)(nLength1 < nLength2);
 }
 
 int SMake_CompareLen(const void *pData1, const void *pData2, void *pCtx)
@@ -362,17 +764,414 @@ int SMake_CompareLen(const void *pData1, const void *pData2, void *pCtx)
     return strlen(pStr1) > strlen(pStr2);
 }
 
-xbool_t SMake_WriteMake(smake_ctx_t *pCtx)
+/* Compile recipe suffix, gcc report is moved from stderr next to the object */
+static void SMake_AddTimeReport(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const char *pObject)
+{
+    if (!pCtx->bTimeTrace) XByteBuffer_AddFmt(pBuffer, "\n");
+    else if (SMake_IsClang(pCtx)) XByteBuffer_AddFmt(pBuffer, " $(TIMEFLAGS)\n");
+    else XByteBuffer_AddFmt(pBuffer, " $(TIMEFLAGS) $(call TIMEREPORT,%s)\n", pObject);
+}
+
+static xbool_t SMake_WriteMirrorRules(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const char *pCompiler,
+                                      const char *pCFlags, const char *pFPIC, const char *pLibs)
 {
-    char sMakefile[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
-    xlogd("Starting Makefile generation: %s/Makefile", pCtx->sPath);
+    const char *pLaunch = xstrused(pCtx->sLauncher) ? "$(LAUNCHER) " : XSTR_EMPTY;
+    const char *pDepFlags = pCtx->bDepends ? " $(DEPFLAGS)" : XSTR_EMPTY;
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
 
-    if (pCtx->bVPath) xstrncpyf(sMakefile, sizeof(sMakefile), "Makefile");
-    else xstrncpyf(sMakefile, sizeof(sMakefile), "%s/Makefile", pCtx->sPath);
+    smake_list_t dirs;
+    SMake_ListInit(&dirs);
+    SMake_AddToList(&dirs, "$(ODIR)");
 
-    if (XPath_Exists(sMakefile) && !pCtx->bOverwrite)
+    for (i = 0; i < nObjs; i++)
     {
-        xlogw("The Makefile already exists: %s", sMakefile);
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || pObj->pSource == NULL) continue;
+
+        /* Objects in the project root go directly to $(ODIR) */
+        int nDirLength = (int)pObj->nLength;
+        while (nDirLength > 0 && pObj->pName[nDirLength - 1] != '/') nDirLength--;
+        if (nDirLength > 0) nDirLength--;
+
+        const char *pDir = XSTR_EMPTY;
+        if (nDirLength)
+        {
+            SMake_AddToList(&dirs, "$(ODIR)/%.*s", nDirLength, pObj->pName);
+            pDir = "/";
+        }
+
+        const char *pPchDep = pCtx->bUsePch && !pObj->bNoPch ? " $(PCH).gch" : XSTR_EMPTY;
+        const char *pPchFlags = pCtx->bUsePch && !pObj->bNoPch ? " $(PCHFLAGS)" : XSTR_EMPTY;
+
+        XByteBuffer_AddFmt(pBuffer, "\n$(ODIR)/%.*s.$(OBJ): %s/%s%s | $(ODIR)%s%.*s\n",
+            (int)pObj->nLength, pObj->pName, pObj->pSource->pDir->pPath,
+            pObj->pSource->pName, pPchDep, pDir, nDirLength, pObj->pName);
+
+        XByteBuffer_AddFmt(pBuffer, "\t%s$(%s) $(%s)%s%s%s -c -o $@ $<%s", pLaunch, pCompiler, pCFlags, pFPIC, pPchFlags, pDepFlags, pLibs);
+        SMake_AddTimeReport(pCtx, pBuffer, "$@");
+    }
+
+    /* Directories are created once, timestamps of order-only prerequisites are ignored */
+    size_t nDirs = XArray_Used(&dirs.array);
+    XByteBuffer_AddFmt(pBuffer, "\n");
+
+    for (i = 0; i < nDirs; i++)
+    {
+        const char *pDir = (const char*)XArray_GetData(&dirs.array, i);
+        XByteBuffer_AddFmt(pBuffer, "%s%s", i ? XSTR_SPACE : XSTR_EMPTY, pDir);
+    }
+
+    XByteBuffer_AddFmt(pBuffer, ":\n\t@mkdir -p $@\n");
+    SMake_ListDestroy(&dirs);
+    return XTRUE;
+}
+
+static void SMake_WritePchRules(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const char *pCompiler,
+                                const char *pCFlags, const char *pFPIC)
+{
+    const char *pLaunch = xstrused(pCtx->sLauncher) ? "$(LAUNCHER) " : XSTR_EMPTY;
+    const char *pDepFlags = pCtx->bDepends ? " $(DEPFLAGS) -MF $(PCH).d" : XSTR_EMPTY;
+    const char *pLang = pCtx->bIsCPP ? "c++-header" : "c-header";
+
+    /* Header must be compiled with the same flags as the objects that use it */
+    XByteBuffer_AddFmt(pBuffer, "\n$(PCH).gch: $(PCH)\n");
+    XByteBuffer_AddFmt(pBuffer, "\t%s$(%s) $(%s)%s%s -x %s -o $@ $<\n", pLaunch, pCompiler, pCFlags, pFPIC, pDepFlags, pLang);
+    if (pCtx->bMirror) return;
+
+    /* Suffix rule can not have prerequisites, must not come before the default goal */
+    if (!pCtx->bDepends) XByteBuffer_AddFmt(pBuffer, "\n$(OBJS): $(PCH).gch\n");
+
+    const char *pPrefix = pCtx->bDepends ? "$(ODIR)/" : XSTR_EMPTY;
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+    xbool_t bFirst = XTRUE;
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || !pObj->bNoPch) continue;
+
+        if (bFirst) XByteBuffer_AddFmt(pBuffer, "\n");
+        XByteBuffer_AddFmt(pBuffer, "%s%.*s.$(OBJ): PCHFLAGS =\n", pPrefix, (int)pObj->nLength, pObj->pName);
+        bFirst = XFALSE;
+    }
+}
+
+static xbool_t SMake_WriteProfiles(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const char *pCFlags)
+{
+    size_t i, nProfiles = XArray_Used(&pCtx->profiles);
+    if (!nProfiles) return XTRUE;
+
+    XByteBuffer_AddFmt(pBuffer, "PROFILES =");
+    for (i = 0; i < nProfiles; i++)
+    {
+        smake_profile_t *pProfile = (smake_profile_t*)XArray_GetData(&pCtx->profiles, i);
+        if (pProfile != NULL) XByteBuffer_AddFmt(pBuffer, " %s", pProfile->sName);
+    }
+
+    /* Every profile builds in its own tree, default build stays in $(ODIR) */
+    XByteBuffer_AddFmt(pBuffer, "\n\nifneq ($(PROFILE),)\n");
+    XByteBuffer_AddFmt(pBuffer, "ifeq ($(filter $(PROFILE),$(PROFILES)),)\n");
+    XByteBuffer_AddFmt(pBuffer, "$(error Unknown profile: $(PROFILE), expected one of: $(PROFILES))\n");
+    XByteBuffer_AddFmt(pBuffer, "endif\nODIR := $(ODIR)/$(PROFILE)\nendif\n");
+
+    for (i = 0; i < nProfiles; i++)
+    {
+        smake_profile_t *pProfile = (smake_profile_t*)XArray_GetData(&pCtx->profiles, i);
+        if (pProfile == NULL) continue;
+
+        xbyte_buffer_t flags, libs, ld;
+        const char *pFlags = SMake_SerializeArray(&pProfile->flagArr.array, XSTR_SPACE, &flags);
+        const char *pLibs = SMake_SerializeArray(&pProfile->libArr.array, XSTR_SPACE, &libs);
+        const char *pLd = SMake_SerializeArray(&pProfile->ldArr.array, XSTR_SPACE, &ld);
+        xbool_t bStatus = pFlags != NULL && pLibs != NULL && pLd != NULL;
+
+        if (bStatus && (xstrused(pFlags) || xstrused(pLibs) ||
+            xstrused(pLd) || xstrused(pProfile->sLDFlags)))
+        {
+            XByteBuffer_AddFmt(pBuffer, "\nifeq ($(PROFILE),%s)\n", pProfile->sName);
+            if (xstrused(pFlags)) XByteBuffer_AddFmt(pBuffer, "%s += %s\n", pCFlags, pFlags);
+            if (xstrused(pLd)) XByteBuffer_AddFmt(pBuffer, "LD_LIBS += %s\n", pLd);
+            if (xstrused(pProfile->sLDFlags)) XByteBuffer_AddFmt(pBuffer, "LDFLAGS += %s\n", pProfile->sLDFlags);
+            if (xstrused(pLibs)) XByteBuffer_AddFmt(pBuffer, "LIBS += %s\n", pLibs);
+            XByteBuffer_AddFmt(pBuffer, "endif\n");
+            xlogi("Profile %s: %s %s %s", pProfile->sName, pFlags, pLd, pLibs);
+        }
+
+        XByteBuffer_Clear(&flags);
+        XByteBuffer_Clear(&libs);
+        XByteBuffer_Clear(&ld);
+        if (!bStatus) return XFALSE;
+    }
+
+    XByteBuffer_AddFmt(pBuffer, "\n");
+    return XTRUE;
+}
+
+static void SMake_ProfilesUse(smake_ctx_t *pCtx, xbool_t *pLibs, xbool_t *pLdLibs, xbool_t *pLdFlags)
+{
+    size_t i, nProfiles = XArray_Used(&pCtx->profiles);
+
+    for (i = 0; i < nProfiles; i++)
+    {
+        smake_profile_t *pProfile = (smake_profile_t*)XArray_GetData(&pCtx->profiles, i);
+        if (pProfile == NULL) continue;
+
+        if (XArray_Used(&pProfile->libArr.array)) *pLibs = XTRUE;
+        if (XArray_Used(&pProfile->ldArr.array)) *pLdLibs = XTRUE;
+        if (xstrused(pProfile->sLDFlags)) *pLdFlags = XTRUE;
+    }
+}
+
+xbool_t SMake_IsCCache(smake_ctx_t *pCtx)
+{
+    /* ccache needs extra options to cache objects that use precompiled header */
+    const char *pName = strrchr(pCtx->sLauncher, '/');
+    pName = pName != NULL ? pName + 1 : pCtx->sLauncher;
+    return !strcmp(pName, "ccache") ? XTRUE : XFALSE;
+}
+
+xbool_t SMake_IsClang(smake_ctx_t *pCtx)
+{
+    const char *pName = strrchr(pCtx->sCompiler, '/');
+    pName = pName != NULL ? pName + 1 : pCtx->sCompiler;
+    return strstr(pName, "clang") != NULL ? XTRUE : XFALSE;
+}
+
+xbool_t SMake_IsMulti(smake_ctx_t *pCtx)
+{
+    return pCtx->nMains > 1 ? XTRUE : XFALSE;
+}
+
+const char* SMake_GetMainName(smake_ctx_t *pCtx, size_t nIndex, int *pLength)
+{
+    /* Binary is named after the source of its entry point, see SMake_NameMains() */
+    SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, nIndex);
+    if (pObj == NULL || pObj->pBinary == NULL) return NULL;
+
+    *pLength = (int)strlen(pObj->pBinary);
+    return pObj->pBinary;
+}
+
+const char* SMake_GetLtoFlags(smake_ctx_t *pCtx)
+{
+    if (pCtx->nLto == SMAKE_LTO_NONE) return XSTR_EMPTY;
+    if (SMake_IsClang(pCtx)) return pCtx->nLto == SMAKE_LTO_THIN ? "-flto=thin" : "-flto";
+
+    /* GCC has no ThinLTO, "auto" takes parallel jobs from make jobserver if there is one */
+    if (pCtx->nLto == SMAKE_LTO_THIN) xlogw("ThinLTO is not supported by GCC, using -flto=auto");
+    return "-flto=auto";
+}
+
+void SMake_AddLtoAr(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer)
+{
+    /* Archive index must list the symbols of LTO objects, plain ar can not read them */
+    if (SMake_IsClang(pCtx)) { XByteBuffer_AddFmt(pBuffer, "llvm-ar"); return; }
+
+    /* Cross compilers have their own wrapper, e.g. arm-linux-gnueabi-gcc-ar */
+    size_t nLength = strlen(pCtx->sCompiler);
+    if (nLength >= 3 && !strcmp(&pCtx->sCompiler[nLength - 3], "gcc"))
+        XByteBuffer_AddFmt(pBuffer, "%s-ar", pCtx->sCompiler);
+    else if (nLength >= 3 && !strcmp(&pCtx->sCompiler[nLength - 3], "g++"))
+        XByteBuffer_AddFmt(pBuffer, "%.*sgcc-ar", (int)nLength - 3, pCtx->sCompiler);
+    else XByteBuffer_AddFmt(pBuffer, "gcc-ar");
+}
+
+const char* SMake_GetLinkFlags(smake_ctx_t *pCtx, xbyte_buffer_t *pOutput)
+{
+    const char *pLinker = pCtx->sLinker;
+    xbool_t bGold = !strcmp(pLinker, "gold") ? XTRUE : XFALSE;
+    xbool_t bIcf = bGold || !strcmp(pLinker, "lld");
+    int nStatus = XSTDNON;
+
+    /* mold and lld use all cores by default, gold links in one thread unless asked.
+     * Only gold and lld are known to accept --icf=safe, older mold knows just "all". */
+    XByteBuffer_Init(pOutput, SMAKE_NAME_MAX, XFALSE);
+    if (xstrused(pLinker)) nStatus = XByteBuffer_AddFmt(pOutput, " -fuse-ld=%s", pLinker);
+    if (nStatus >= 0 && bGold) nStatus = XByteBuffer_AddFmt(pOutput, " -Wl,--threads");
+    if (nStatus >= 0 && pCtx->bGcSections) nStatus = XByteBuffer_AddFmt(pOutput, " -Wl,--gc-sections%s", bIcf ? " -Wl,--icf=safe" : XSTR_EMPTY);
+
+    if (nStatus < 0)
+    {
+        xloge("Failed to serialize link flags: %s", XSTRERR);
+        return NULL;
+    }
+
+    return pOutput->nUsed ? (const char*)pOutput->pData + 1 : XSTR_EMPTY;
+}
+
+static void SMake_WriteMainVars(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer)
+{
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+    XByteBuffer_AddFmt(pBuffer, "BINS =");
+
+    for (i = 0; i < nObjs; i++)
+    {
+        int nLength = 0;
+        const char *pName = SMake_GetMainName(pCtx, i, &nLength);
+        if (pName != NULL) XByteBuffer_AddFmt(pBuffer, " %.*s", nLength, pName);
+    }
+
+    /* Entry points are compiled as every other object, but linked only into own binary */
+    XByteBuffer_AddFmt(pBuffer, "\nMAIN_OBJS =");
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj != NULL && pObj->bMain) XByteBuffer_AddFmt(pBuffer, " %.*s.$(OBJ)", (int)pObj->nLength, pObj->pName);
+    }
+
+    XByteBuffer_AddFmt(pBuffer, "\n");
+}
+
+static void SMake_WriteMainRules(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const char *pLink, const char *pLdLibs, const char *pLibs)
+{
+    const char *pCommon = pCtx->bDepends || pCtx->bMirror ? "$(COMMON_OBJECTS)" : "$(COMMON_OBJS)";
+    const char *pPrefix = pCtx->bDepends || pCtx->bMirror ? "$(ODIR)/" : XSTR_EMPTY;
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+
+    for (i = 0; i < nObjs; i++)
+    {
+        int nLength = 0;
+        const char *pName = SMake_GetMainName(pCtx, i, &nLength);
+        if (pName == NULL) continue;
+
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        int nObjLength = (int)pObj->nLength;
+
+        /* Binary is the real target, make sees ./name as name and the alias would depend on itself */
+        if (strcmp(pCtx->sOutDir, ".")) XByteBuffer_AddFmt(pBuffer, "\n.PHONY: %.*s\n%.*s: $(ODIR)/%.*s", nLength, pName, nLength, pName, nLength, pName);
+        XByteBuffer_AddFmt(pBuffer, "\n$(ODIR)/%.*s: %s%.*s.$(OBJ) %s%s\n", nLength, pName, pPrefix, nObjLength, pObj->pName, pCommon, pCtx->bMirror ? " | $(ODIR)" : XSTR_EMPTY);
+
+        XByteBuffer_AddFmt(pBuffer, "\t%s -o $(ODIR)/%.*s $(ODIR)/%.*s.$(OBJ) $(COMMON_OBJECTS)%s%s\n",
+            pLink, nLength, pName, nObjLength, pObj->pName, pLdLibs, pLibs);
+    }
+}
+
+static void SMake_WritePgoVars(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const char *pCFlags)
+{
+    xbool_t bClang = SMake_IsClang(pCtx);
+
+    if (!bClang && pCtx->sOutDir[0] == '/')
+        xlogw("GCC does not match profile data of absolute object paths, use relative output directory for PGO");
+
+    /* Paths are taken before $(ODIR) is moved, each profile trains its own data */
+    XByteBuffer_AddFmt(pBuffer, "PGO_DATA := $(abspath $(ODIR))/pgo-data\n");
+    XByteBuffer_AddFmt(pBuffer, "PGO_BIN := $(ODIR)/pgo-gen%s\n", SMake_IsMulti(pCtx) ? XSTR_EMPTY : "/$(NAME)");
+    XByteBuffer_AddFmt(pBuffer, "PGO_TRAIN = %s\n", pCtx->sPgoTrain);
+
+    /* GCC names profile data after the object path joined to the working directory,
+     * make strips "./" from targets, so it must not be in $(ODIR) of the phase either */
+    const char *pGenFlags = bClang ? "-fprofile-generate=$(PGO_DATA)" :
+        "-fprofile-generate=$(PGO_DATA) -fprofile-update=prefer-atomic -fprofile-prefix-path=$(CURDIR)/$(ODIR)";
+
+    const char *pUseFlags = bClang ? "-fprofile-use=$(PGO_DATA)/default.profdata -Wno-profile-instr-unprofiled" :
+        "-fprofile-use=$(PGO_DATA) -fprofile-correction -Wno-missing-profile -fprofile-prefix-path=$(CURDIR)/$(ODIR)";
+
+    XByteBuffer_AddFmt(pBuffer, "\nifeq ($(PGO),gen)\nODIR := $(patsubst ./%%,%%,$(ODIR)/pgo-gen)\nPGOFLAGS = %s\n", pGenFlags);
+    XByteBuffer_AddFmt(pBuffer, "else ifeq ($(PGO),use)\nODIR := $(patsubst ./%%,%%,$(ODIR)/pgo-use)\nPGOFLAGS = %s\n", pUseFlags);
+    XByteBuffer_AddFmt(pBuffer, "else ifneq ($(PGO),)\n$(error Unknown PGO phase: $(PGO), expected gen or use)\nendif\n");
+    XByteBuffer_AddFmt(pBuffer, "%s += $(PGOFLAGS)\n\n", pCFlags);
+}
+
+static void SMake_WritePgoRules(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer)
+{
+    /* Every phase is a separate make with its own $(ODIR), jobserver is passed to it */
+    XByteBuffer_AddFmt(pBuffer, "\n.PHONY: pgo-gen pgo-train pgo-use\n");
+    const char *pGoal = SMake_IsMulti(pCtx) ? "all" : "$(NAME)";
+    XByteBuffer_AddFmt(pBuffer, "pgo-gen:\n\t$(MAKE) PGO=gen %s\n\n", pGoal);
+    XByteBuffer_AddFmt(pBuffer, "pgo-train: pgo-gen\n\t$(RM) -r $(PGO_DATA)\n\t$(PGO_TRAIN)\n");
+    if (SMake_IsClang(pCtx)) XByteBuffer_AddFmt(pBuffer, "\tllvm-profdata merge -o $(PGO_DATA)/default.profdata $(PGO_DATA)/*.profraw\n");
+    XByteBuffer_AddFmt(pBuffer, "\npgo-use:\n\t$(MAKE) PGO=use %s\n", pGoal);
+}
+
+/* Both paths are absolute and normalized, e.g. /a/b/obj/.smake-unity -> /a/b/src gives ../../src */
+void SMake_AddRelative(xbyte_buffer_t *pBuffer, const char *pFrom, const char *pTo)
+{
+    size_t i, nCommon = 0;
+    for (i = 0; pFrom[i] && pFrom[i] == pTo[i]; i++)
+        if (pFrom[i] == '/') nCommon = i;
+
+    if (!pFrom[i] && (pTo[i] == '/' || !pTo[i])) nCommon = i;
+    for (i = nCommon; pFrom[i]; i++)
+        if (pFrom[i] == '/' && pFrom[i + 1] && pFrom[i + 1] != '/') XByteBuffer_AddFmt(pBuffer, "../");
+
+    if (pTo[nCommon] == '/') nCommon++;
+    XByteBuffer_AddFmt(pBuffer, "%s", &pTo[nCommon]);
+}
+
+xbool_t SMake_UpdateFile(const char *pPath, const char *pData, size_t nLength)
+{
+    size_t nSize = 0;
+    uint8_t *pOld = XPath_Load(pPath, &nSize);
+
+    /* Keep mtime of unchanged file so its dependents are not rebuilt */
+    xbool_t bSame = (pOld != NULL && nSize == nLength && !memcmp(pOld, pData, nLength)) ? XTRUE : XFALSE;
+    free(pOld);
+
+    if (bSame)
+    {
+        xlogd("Generated file is up to date: %s", pPath);
+        return XTRUE;
+    }
+
+    /* Unique name in the same directory, concurrent runs do not share it */
+    char sTmpPath[XPATH_MAX];
+    xstrncpyf(sTmpPath, sizeof(sTmpPath), "%s.XXXXXX", pPath);
+
+    int nFD = mkstemp(sTmpPath);
+    if (nFD < 0)
+    {
+        xloge("Failed to create temporary file: %s (%s)", sTmpPath, XSTRERR);
+        return XFALSE;
+    }
+
+    /* Replaced file keeps its mode, a new one gets the default of open() */
+    struct stat fileStat;
+    mode_t nMode;
+
+    if (stat(pPath, &fileStat) >= 0) nMode = fileStat.st_mode & 07777;
+    else
+    {
+        mode_t nMask = umask(0);
+        umask(nMask);
+        nMode = 0666 & ~nMask;
+    }
+
+    xbool_t bStatus = fchmod(nFD, nMode) < 0 ? XFALSE : XTRUE;
+    size_t nDone = 0;
+
+    while (bStatus && nDone < nLength)
+    {
+        ssize_t nWritten = write(nFD, pData + nDone, nLength - nDone);
+        if (nWritten < 0 && errno == EINTR) continue;
+        if (nWritten <= 0) bStatus = XFALSE;
+        else nDone += (size_t)nWritten;
+    }
+
+    if (close(nFD) < 0) bStatus = XFALSE;
+
+    /* Running make or compiler never reads a half written file */
+    if (!bStatus || rename(sTmpPath, pPath) < 0)
+    {
+        xloge("Failed to write generated file: %s (%s)", pPath, XSTRERR);
+        unlink(sTmpPath);
+        return XFALSE;
+    }
+
+    xlogd("Updated generated file: %s", pPath);
+    return XTRUE;
+}
+
+xbool_t SMake_CheckOutput(smake_ctx_t *pCtx, const char *pFileName, char *pOutput, size_t nSize)
+{
+    xlogd("Starting %s generation: %s/%s", pFileName, pCtx->sPath, pFileName);
+
+    if (pCtx->bVPath) xstrncpyf(pOutput, nSize, "%s", pFileName);
+    else xstrncpyf(pOutput, nSize, "%s/%s", pCtx->sPath, pFileName);
+
+    /* Regenerations of watch mode run unattended, the first run asks as usual */
+    if (XPath_Exists(pOutput) && !pCtx->bOverwrite && !pCtx->bRegenerate)
+    {
+        xlogw("The %s already exists: %s", pFileName, pOutput);
 
         char sAnswer[8];
         sAnswer[0] = '\0';
@@ -380,61 +1179,119 @@ xbool_t SMake_WriteMake(smake_ctx_t *pCtx)
         XCLI_GetInput("Would you like to owerwrite? (Y/N): ", sAnswer, sizeof(sAnswer), XTRUE);
         if (!xstrused(sAnswer) || (sAnswer[0] != 'y' && sAnswer[0] != 'Y'))
         {
-            xlogn("Stopping Makefile generation.");
+            xlogn("Stopping %s generation.", pFileName);
             return XFALSE;
         }
     }
 
-    xfile_t file;
-    if (XFile_Open(&file, sMakefile, "cwt", NULL)< 0)
-    {
-        xloge("Failed to open destination file: %s (%s)", sMakefile, XSTRERR);
-        return XFALSE;
-    }
+    return XTRUE;
+}
 
-    XFile_Print(&file, "####################################\n");
-    XFile_Print(&file, "# Automatically generated by SMake #\n");
-    XFile_Print(&file, "# https://github.com/kala13x/smake #\n");
-    XFile_Print(&file, "####################################\n\n");
+xbool_t SMake_WriteMake(smake_ctx_t *pCtx)
+{
+    char sOutput[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+    if (!SMake_CheckOutput(pCtx, "Makefile", sOutput, sizeof(sOutput))) return XFALSE;
 
-    const char *pCompiler = pCtx->bIsCPP ? "CXX" : "CC";
-    const char *pCFlags = pCtx->bIsCPP ? "CXXFLAGS" : "CFLAGS";
+    /* Makefile is generated in memory and replaces the old one at once */
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, SMAKE_ARENA_BLOCK, XFALSE);
 
-    char sIncludes[SMAKE_LINE_MAX];
-    char sFlags[SMAKE_LINE_MAX];
-    char sLibs[SMAKE_LINE_MAX];
-    char sLd[SMAKE_LINE_MAX];
+    XByteBuffer_AddFmt(&buffer, "####################################\n");
+    XByteBuffer_AddFmt(&buffer, "# Automatically generated by SMake #\n");
+    XByteBuffer_AddFmt(&buffer, "# https://github.com/kala13x/smake #\n");
+    XByteBuffer_AddFmt(&buffer, "####################################\n\n");
 
-    sIncludes[0] = XSTR_NUL;
-    sFlags[0] = XSTR_NUL;
-    sLibs[0] = XSTR_NUL;
-    sLd[0] = XSTR_NUL;
+    const char *pCompiler = pCtx->bIsCPP ? "CXX" : "CC";
+    const char *pCFlags = pCtx->bIsCPP ? "CXXFLAGS" : "CFLAGS";
 
     xbool_t bStatic, bShared;
     bStatic = bShared = XFALSE;
 
-    if (xstrused(pCtx->sCompiler)) XFile_Print(&file, "%s = %s\n", pCompiler, pCtx->sCompiler);
-    if (!xstrused(pCtx->sName)) xstrncpy(pCtx->sName, sizeof(pCtx->sName), pCtx->sMain);
+    /* Binary names and object list are written in the same order */
+    XArray_Sort(&pCtx->objArr, SMake_CompareName, NULL);
+
+    if (xstrused(pCtx->sCompiler)) XByteBuffer_AddFmt(&buffer, "%s = %s\n", pCompiler, pCtx->sCompiler);
+    if (xstrused(pCtx->sLauncher)) XByteBuffer_AddFmt(&buffer, "LAUNCHER = %s\n", pCtx->sLauncher);
+    if (!xstrused(pCtx->sName) && !SMake_IsMulti(pCtx))
+    {
+        xstrncpy(pCtx->sName, sizeof(pCtx->sName), pCtx->sMain);
+        pCtx->bMainName = XTRUE;
+    }
 
     if (strstr(pCtx->sName, ".a") != NULL) bStatic = XTRUE;
     else if (strstr(pCtx->sName, ".so") != NULL) bShared = XTRUE;
 
-    SMake_SerializeIncludes(&pCtx->includes, XSTR_SPACE, sIncludes, sizeof(sIncludes));
-    SMake_SerializeArray(&pCtx->flagArr, XSTR_SPACE, sFlags, sizeof(sFlags));
-    SMake_SerializeArray(&pCtx->libArr, XSTR_SPACE, sLibs, sizeof(sLibs));
-    SMake_SerializeArray(&pCtx->ldArr, XSTR_SPACE, sLd, sizeof(sLd));
+    if (bStatic && pCtx->nLto)
+    {
+        XByteBuffer_AddFmt(&buffer, "AR = ");
+        SMake_AddLtoAr(pCtx, &buffer);
+        XByteBuffer_AddFmt(&buffer, "\n");
+    }
+
+    if (pCtx->bVPath) SMake_AddToList(&pCtx->pathArr, "%s", pCtx->sPath);
+    XArray_Sort(&pCtx->pathArr.array, SMake_CompareLen, NULL);
+
+    xbyte_buffer_t includes, flags, libs, ld, vpath, linkFlags;
+    const char *pIncludes = SMake_SerializeIncludes(&pCtx->includes.array, XSTR_SPACE, &includes);
+    const char *pFlags = SMake_SerializeArray(&pCtx->flagArr.array, XSTR_SPACE, &flags);
+    const char *pLibs = SMake_SerializeArray(&pCtx->libArr.array, XSTR_SPACE, &libs);
+    const char *pLd = SMake_SerializeArray(&pCtx->ldArr.array, XSTR_SPACE, &ld);
+    const char *pVPath = SMake_SerializeArray(&pCtx->pathArr.array, ":", &vpath);
+    const char *pLinkFlags = SMake_GetLinkFlags(pCtx, &linkFlags);
 
-    if (xstrused(sFlags)) XFile_Print(&file, "%s = %s\n", pCFlags, sFlags);
-    else if (xstrused(sIncludes)) XFile_Print(&file, "%s = %s\n", pCFlags, sIncludes);
-    if (xstrused(sFlags) && xstrused(sIncludes)) XFile_Print(&file, "%s += %s\n", pCFlags, sIncludes);
+    xbool_t bStatus = pIncludes != NULL && pFlags != NULL &&
+        pLibs != NULL && pLd != NULL && pVPath != NULL && pLinkFlags != NULL;
 
-    if (xstrused(sLd)) XFile_Print(&file, "LD_LIBS = %s\n", sLd);
-    if (xstrused(pCtx->sLDFlags)) XFile_Print(&file, "LDFLAGS = %s\n", pCtx->sLDFlags);
-    if (xstrused(sLibs)) XFile_Print(&file, "LIBS = %s\n", sLibs);
+    if (!bStatus)
+    {
+        XByteBuffer_Clear(&includes);
+        XByteBuffer_Clear(&flags);
+        XByteBuffer_Clear(&libs);
+        XByteBuffer_Clear(&ld);
+        XByteBuffer_Clear(&vpath);
+        XByteBuffer_Clear(&linkFlags);
+        XByteBuffer_Clear(&buffer);
+        return XFALSE;
+    }
 
-    XFile_Print(&file, "NAME = %s\n", pCtx->sName);
-    XFile_Print(&file, "ODIR = %s\n", pCtx->sOutDir);
-    XFile_Print(&file, "OBJ = o\n\n");
+    if (xstrused(pFlags)) XByteBuffer_AddFmt(&buffer, "%s = %s\n", pCFlags, pFlags);
+    else if (xstrused(pIncludes)) XByteBuffer_AddFmt(&buffer, "%s = %s\n", pCFlags, pIncludes);
+    if (xstrused(pFlags) && xstrused(pIncludes)) XByteBuffer_AddFmt(&buffer, "%s += %s\n", pCFlags, pIncludes);
+
+    /* Cached objects do not depend on the location of the checkout */
+    if (xstrused(pCtx->sLauncher)) XByteBuffer_AddFmt(&buffer, "%s += %s\n", pCFlags, SMAKE_PREFIX_MAP_MAKE);
+
+    /* Flags are also used by the link rule, where the optimization happens */
+    if (pCtx->nLto)
+    {
+        XByteBuffer_AddFmt(&buffer, "LTOFLAGS = %s\n", SMake_GetLtoFlags(pCtx));
+        XByteBuffer_AddFmt(&buffer, "%s += $(LTOFLAGS)\n", pCFlags);
+    }
+
+    if (bStatic) pLinkFlags = XSTR_EMPTY;
+
+    if (pCtx->bGcSections) XByteBuffer_AddFmt(&buffer, "%s += %s\n", pCFlags, SMAKE_SECTION_FLAGS);
+
+    /* Only compile rules use the flags, link and header rules do not write traces */
+    if (pCtx->bTimeTrace)
+    {
+        XByteBuffer_AddFmt(&buffer, "TIMEFLAGS = %s\n", SMake_IsClang(pCtx) ? "-ftime-trace" : "-ftime-report");
+        if (!SMake_IsClang(pCtx)) XByteBuffer_AddFmt(&buffer, "TIMEREPORT = 2> $(1)%s; s=$$?; %s $(1)%s >&2; exit $$s\n",
+            SMAKE_REPORT_EXT, SMAKE_REPORT_FILTER, SMAKE_REPORT_EXT);
+    }
+
+    if (xstrused(pLd)) XByteBuffer_AddFmt(&buffer, "LD_LIBS = %s\n", pLd);
+    if (xstrused(pCtx->sLDFlags)) XByteBuffer_AddFmt(&buffer, "LDFLAGS = %s\n", pCtx->sLDFlags);
+    if (xstrused(pLinkFlags)) XByteBuffer_AddFmt(&buffer, "LDFLAGS += %s\n", pLinkFlags);
+    if (xstrused(pLibs)) XByteBuffer_AddFmt(&buffer, "LIBS = %s\n", pLibs);
+
+    if (pCtx->bDepends) XByteBuffer_AddFmt(&buffer, "DEPFLAGS = -MMD -MP\n");
+    if (SMake_IsMulti(pCtx)) SMake_WriteMainVars(pCtx, &buffer);
+    else XByteBuffer_AddFmt(&buffer, "NAME = %s\n", pCtx->sName);
+    XByteBuffer_AddFmt(&buffer, "ODIR = %s\n", pCtx->sOutDir);
+    XByteBuffer_AddFmt(&buffer, "OBJ = o\n\n");
+    bStatus = SMake_WriteProfiles(pCtx, &buffer, pCFlags);
+    if (xstrused(pCtx->sPgoTrain)) SMake_WritePgoVars(pCtx, &buffer, pCFlags);
 
     if (xstrused(pCtx->sInjectPath) && XPath_Exists(pCtx->sInjectPath))
     {
@@ -443,98 +1300,212 @@ xbool_t SMake_WriteMake(smake_ctx_t *pCtx)
 
         if (fileBuffer.pData != NULL)
         {
-            XFile_Print(&file, "%s\n\n", (char*)fileBuffer.pData);
+            XByteBuffer_AddFmt(&buffer, "%s\n\n", (char*)fileBuffer.pData);
             XByteBuffer_Clear(&fileBuffer);
         }
     }
 
-    xlogi("Compiler flags: %s %s", sFlags, sIncludes);
-    xlogi("Linked libraries: %s", sLibs);
-    xlogi("Custom libraries: %s", sLd);
+    xlogi("Compiler flags: %s %s", pFlags, pIncludes);
+    xlogi("Linked libraries: %s", pLibs);
+    xlogi("Custom libraries: %s", pLd);
     xlogi("Binary file name: %s", pCtx->sName);
     xlogi("Output Directory: %s", pCtx->sOutDir);
     xlogi("Inject file: %s", xstrused(pCtx->sInjectPath) ? pCtx->sInjectPath : "None");
     xlogi("Compiler: %s", strlen(pCtx->sCompiler) ? pCtx->sCompiler : pCompiler);
 
-    XArray_Sort(&pCtx->objArr, SMake_CompareName, NULL);
     size_t i, nObjs = XArray_Used(&pCtx->objArr);
-    XFile_Print(&file, "OBJS = ");
+    XByteBuffer_AddFmt(&buffer, "OBJS = ");
 
     for (i = 0; i < nObjs; i++)
     {
         SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
         if (pObj == NULL) continue;
 
-        if (nObjs < 2) { XFile_Print(&file, "%s\n", pObj->sName); break; }
-        if (!i) { XFile_Print(&file, "%s \\\n", pObj->sName); continue; }
+        int nLength = (int)pObj->nLength;
 
-        if (i == (nObjs - 1)) XFile_Print(&file, "\t%s\n\n", pObj->sName);
-        else XFile_Print(&file, "\t%s \\\n", pObj->sName);
-        xlogd("Added object to recept: %s", pObj->sName);
-    }
+        if (nObjs < 2) { XByteBuffer_AddFmt(&buffer, "%.*s.$(OBJ)\n", nLength, pObj->pName); break; }
+        if (!i) { XByteBuffer_AddFmt(&buffer, "%.*s.$(OBJ) \\\n", nLength, pObj->pName); continue; }
 
-    char sVPath[SMAKE_PATH_MAX];
-    sVPath[0] = XSTR_NUL;
+        if (i == (nObjs - 1)) XByteBuffer_AddFmt(&buffer, "\t%.*s.$(OBJ)\n\n", nLength, pObj->pName);
+        else XByteBuffer_AddFmt(&buffer, "\t%.*s.$(OBJ) \\\n", nLength, pObj->pName);
+        xlogd("Added object to recept: %.*s.$(OBJ)", nLength, pObj->pName);
+    }
 
-    if (pCtx->bVPath) SMake_AddToArray(&pCtx->pathArr, "%s", pCtx->sPath);
-    XArray_Sort(&pCtx->pathArr, SMake_CompareLen, NULL);
-    SMake_SerializeArray(&pCtx->pathArr, ":", sVPath, sizeof(sVPath));
+    xbool_t bProfileLibs, bProfileLdLibs, bProfileLdFlags;
+    bProfileLibs = bProfileLdLibs = bProfileLdFlags = XFALSE;
+    SMake_ProfilesUse(pCtx, &bProfileLibs, &bProfileLdLibs, &bProfileLdFlags);
 
     const char *pFPICOption = bShared ? " -fPIC" : XSTR_EMPTY;
-    const char *pLinkLibs = xstrused(sLibs) ? " $(LIBS)" : XSTR_EMPTY;
-    const char *pLdFlags = xstrused(sLd) ? " $(LDFLAGS)" : XSTR_EMPTY;
-    const char *pLdLibs = xstrused(sLd) ? " $(LD_LIBS)" : XSTR_EMPTY;
+    const char *pLinkLibs = xstrused(pLibs) || bProfileLibs ? " $(LIBS)" : XSTR_EMPTY;
+    const char *pLdFlags = xstrused(pLd) || xstrused(pLinkFlags) || bProfileLdFlags ? " $(LDFLAGS)" : XSTR_EMPTY;
+    const char *pLdLibs = xstrused(pLd) || bProfileLdLibs ? " $(LD_LIBS)" : XSTR_EMPTY;
+    const char *pLaunch = xstrused(pCtx->sLauncher) ? "$(LAUNCHER) " : XSTR_EMPTY;
+    const char *pPchFlags = pCtx->bUsePch ? " $(PCHFLAGS)" : XSTR_EMPTY;
+    const char *pPchDep = pCtx->bUsePch ? " $(PCH).gch" : XSTR_EMPTY;
+
+    /* GCC runs LTO partitions in parallel only if make passes jobserver to the link */
+    const char *pJobs = pCtx->nLto && !SMake_IsClang(pCtx) ? "+" : XSTR_EMPTY;
 
     xbool_t bInstallIncludes = xstrused(pCtx->sHeaderDst);
     xbool_t bInstallBinary = xstrused(pCtx->sBinaryDst);
-    int bVPathLen = strlen(sVPath);
+    int bVPathLen = strlen(pVPath);
+
+    const char *pBinPath = SMake_IsMulti(pCtx) ? "$(addprefix $(ODIR)/,$(BINS))" : "$(ODIR)/$(NAME)";
 
-    XFile_Print(&file, "OBJECTS = $(patsubst %%,$(ODIR)/%%,$(OBJS))\n");
-    if (bInstallIncludes) XFile_Print(&file, "INSTALL_INC = %s\n", pCtx->sHeaderDst);
-    if (bInstallBinary) XFile_Print(&file, "INSTALL_BIN = %s\n", pCtx->sBinaryDst);
-    if (pCtx->bVPath || bVPathLen) XFile_Print(&file, "VPATH = %s\n", sVPath);
+    XByteBuffer_AddFmt(&buffer, "OBJECTS = $(patsubst %%,$(ODIR)/%%,$(OBJS))\n");
+    xbool_t bMulti = SMake_IsMulti(pCtx);
+
+    if (bMulti)
+    {
+        XByteBuffer_AddFmt(&buffer, "COMMON_OBJS = $(filter-out $(MAIN_OBJS),$(OBJS))\n");
+        XByteBuffer_AddFmt(&buffer, "COMMON_OBJECTS = $(patsubst %%,$(ODIR)/%%,$(COMMON_OBJS))\n");
+    }
+    if (pCtx->bDepends) XByteBuffer_AddFmt(&buffer, "DEPS = $(OBJECTS:.$(OBJ)=.d)\n");
 
-    XFile_Print(&file, "\n.%s.$(OBJ):\n", pCtx->bIsCPP ? "cpp" : "c");
-    XFile_Print(&file, "\t@test -d $(ODIR) || mkdir -p $(ODIR)\n");
-    XFile_Print(&file, "\t$(%s) $(%s)%s -c -o $(ODIR)/$@ $<%s\n\n", pCompiler, pCFlags, pFPICOption, pLinkLibs);
-    XFile_Print(&file, "$(NAME):$(OBJS)\n");
+    if (pCtx->bUsePch)
+    {
+        XByteBuffer_AddFmt(&buffer, "PCH = $(ODIR)/%s\n", SMAKE_PCH_FILE);
+        XByteBuffer_AddFmt(&buffer, "PCHFLAGS = -include $(PCH) -Winvalid-pch%s\n", SMake_IsCCache(pCtx) ? " -fpch-preprocess" : XSTR_EMPTY);
+        if (SMake_IsCCache(pCtx)) XByteBuffer_AddFmt(&buffer, "export CCACHE_SLOPPINESS ?= %s\n", SMAKE_CCACHE_SLOPPINESS);
+        if (pCtx->bDepends) XByteBuffer_AddFmt(&buffer, "DEPS += $(PCH).d\n");
+    }
 
-    
-    if (bStatic) XFile_Print(&file, "\t$(AR) rcs $(ODIR)/$(NAME) $(OBJECTS)\n");
-    else if (bShared) XFile_Print(&file, "\t$(%s) -shared -o $(ODIR)/$(NAME) $(OBJECTS)\n", pCompiler);
-    else XFile_Print(&file, "\t$(%s) $(%s)%s -o $(ODIR)/$(NAME) $(OBJECTS)%s%s\n", pCompiler, pCFlags, pLdFlags, pLdLibs, pLinkLibs);
+    if (bInstallIncludes) XByteBuffer_AddFmt(&buffer, "INSTALL_INC = %s\n", pCtx->sHeaderDst);
+    if (bInstallBinary) XByteBuffer_AddFmt(&buffer, "INSTALL_BIN = %s\n", pCtx->sBinaryDst);
+    if (!pCtx->bMirror && (pCtx->bVPath || bVPathLen)) XByteBuffer_AddFmt(&buffer, "VPATH = %s\n", pVPath);
+
+    if (pCtx->bMirror)
+    {
+        /* Every rule is explicit, make does not need to search for implicit ones */
+        XByteBuffer_AddFmt(&buffer, "\nMAKEFLAGS += -r\n.SUFFIXES:\n\n");
+        if (bMulti) XByteBuffer_AddFmt(&buffer, ".PHONY: all\nall: %s\n", pBinPath);
+        else XByteBuffer_AddFmt(&buffer, ".PHONY: $(NAME)\n$(NAME): $(ODIR)/$(NAME)\n\n");
+        if (!bMulti) XByteBuffer_AddFmt(&buffer, "$(ODIR)/$(NAME): $(OBJECTS) | $(ODIR)\n");
+    }
+    else if (pCtx->bDepends)
+    {
+        /* Objects are real targets so the generated header dependencies apply to them */
+        XByteBuffer_AddFmt(&buffer, "\n$(ODIR)/%%.$(OBJ): %%.%s%s\n", pCtx->bIsCPP ? "cpp" : "c", pPchDep);
+        XByteBuffer_AddFmt(&buffer, "\t@test -d $(ODIR) || mkdir -p $(ODIR)\n");
+        XByteBuffer_AddFmt(&buffer, "\t%s$(%s) $(%s)%s%s $(DEPFLAGS) -c -o $@ $<%s", pLaunch, pCompiler, pCFlags, pFPICOption, pPchFlags, pLinkLibs);
+        SMake_AddTimeReport(pCtx, &buffer, "$@");
+        XByteBuffer_AddFmt(&buffer, "\n");
+        if (bMulti) XByteBuffer_AddFmt(&buffer, ".PHONY: all\nall: %s\n", pBinPath);
+        else XByteBuffer_AddFmt(&buffer, "$(NAME):$(OBJECTS)\n");
+    }
+    else
+    {
+        XByteBuffer_AddFmt(&buffer, "\n.%s.$(OBJ):\n", pCtx->bIsCPP ? "cpp" : "c");
+        XByteBuffer_AddFmt(&buffer, "\t@test -d $(ODIR) || mkdir -p $(ODIR)\n");
+        XByteBuffer_AddFmt(&buffer, "\t%s$(%s) $(%s)%s%s -c -o $(ODIR)/$@ $<%s", pLaunch, pCompiler, pCFlags, pFPICOption, pPchFlags, pLinkLibs);
+        SMake_AddTimeReport(pCtx, &buffer, "$(ODIR)/$@");
+        XByteBuffer_AddFmt(&buffer, "\n");
+        if (bMulti) XByteBuffer_AddFmt(&buffer, ".PHONY: all\nall: %s\n", pBinPath);
+        else XByteBuffer_AddFmt(&buffer, "$(NAME):$(OBJS)\n");
+    }
+
+    if (bMulti)
+    {
+        xbyte_buffer_t link;
+        XByteBuffer_Init(&link, SMAKE_LINE_MAX, XFALSE);
+        XByteBuffer_AddFmt(&link, "%s%s$(%s) $(%s)%s", pJobs, pLaunch, pCompiler, pCFlags, pLdFlags);
+
+        if (link.pData != NULL) SMake_WriteMainRules(pCtx, &buffer, (const char*)link.pData, pLdLibs, pLinkLibs);
+        else bStatus = XFALSE;
+        XByteBuffer_Clear(&link);
+    }
+    else if (bStatic) XByteBuffer_AddFmt(&buffer, "\t$(AR) rcs $(ODIR)/$(NAME) $(OBJECTS)\n");
+    else if (bShared) XByteBuffer_AddFmt(&buffer, "\t%s%s$(%s) -shared%s%s%s -o $(ODIR)/$(NAME) $(OBJECTS)\n", pJobs, pLaunch, pCompiler,
+        xstrused(pLinkFlags) ? " $(LDFLAGS)" : XSTR_EMPTY, pCtx->nLto ? " $(LTOFLAGS)" : XSTR_EMPTY,
+        xstrused(pCtx->sPgoTrain) ? " $(PGOFLAGS)" : XSTR_EMPTY);
+    else XByteBuffer_AddFmt(&buffer, "\t%s%s$(%s) $(%s)%s -o $(ODIR)/$(NAME) $(OBJECTS)%s%s\n", pJobs, pLaunch, pCompiler, pCFlags, pLdFlags, pLdLibs, pLinkLibs);
+
+    if (bStatus && pCtx->bMirror)
+        bStatus = SMake_WriteMirrorRules(pCtx, &buffer, pCompiler, pCFlags, pFPICOption, pLinkLibs);
+
+    if (pCtx->bUsePch) SMake_WritePchRules(pCtx, &buffer, pCompiler, pCFlags, pFPICOption);
+
+    if (pCtx->bUsePch && (XArray_Used(&pCtx->profiles) || xstrused(pCtx->sPgoTrain)))
+    {
+        /* Header is generated once, every profile and PGO phase compiles its own
+         * copy that includes it, paths in the header are relative to its directory */
+        size_t nDepth = SMake_PathDepth(pCtx->sOutDir);
+        XByteBuffer_AddFmt(&buffer, "\nifneq ($(ODIR),%s)\n$(PCH): %s/%s\n", pCtx->sOutDir, pCtx->sOutDir, SMAKE_PCH_FILE);
+        XByteBuffer_AddFmt(&buffer, "\t@test -d $(ODIR) || mkdir -p $(ODIR)\n");
+        XByteBuffer_AddFmt(&buffer, "\techo '#include \"$(subst $() ,,$(patsubst %%,../,$(wordlist %zu,999,$(filter-out .,$(subst /, ,$(ODIR))))))%s\"' > $@\nendif\n",
+            nDepth + 1, SMAKE_PCH_FILE);
+    }
+
+    if (xstrused(pCtx->sPgoTrain)) SMake_WritePgoRules(pCtx, &buffer);
 
     if (bInstallBinary || bInstallIncludes)
     {
-        XFile_Print(&file, "\n.PHONY: install\ninstall:\n");
+        XByteBuffer_AddFmt(&buffer, "\n.PHONY: install\ninstall:\n");
 
         if (bInstallBinary)
         {
             xlogi("Install location for binary: %s -> %s", pCtx->sName, pCtx->sBinaryDst);
-            XFile_Print(&file, "\t@test -d $(INSTALL_BIN) || mkdir -p $(INSTALL_BIN)\n");
-            XFile_Print(&file, "\tinstall -m 0755 $(ODIR)/$(NAME) $(INSTALL_BIN)/\n");
+            XByteBuffer_AddFmt(&buffer, "\t@test -d $(INSTALL_BIN) || mkdir -p $(INSTALL_BIN)\n");
+            XByteBuffer_AddFmt(&buffer, "\tinstall -m 0755 %s $(INSTALL_BIN)/\n", pBinPath);
         }
 
         if (bInstallIncludes)
         {
-            XFile_Print(&file, "\t@test -d $(INSTALL_INC) || mkdir -p $(INSTALL_INC)\n");
-            size_t nCount = XArray_Used(&pCtx->includes);
+            XByteBuffer_AddFmt(&buffer, "\t@test -d $(INSTALL_INC) || mkdir -p $(INSTALL_INC)\n");
+            smake_list_t *pHeaders = pCtx->bMinIncludes ? &pCtx->headerDirs : &pCtx->includes;
+            size_t nCount = XArray_Used(&pHeaders->array);
 
             for (i = 0; i < nCount; i++)
             {
-                const char *pPath = (const char*)XArray_GetData(&pCtx->includes, i);
+                const char *pPath = (const char*)XArray_GetData(&pHeaders->array, i);
                 if (pPath != NULL)
                 {
                     xlogi("Install location for headers: %s -> %s", pPath, pCtx->sHeaderDst);
-                    XFile_Print(&file, "\tcp -r %s/*.h $(INSTALL_INC)/\n", pPath);
+                    XByteBuffer_AddFmt(&buffer, "\tcp -r %s/*.h $(INSTALL_INC)/\n", pPath);
                 }
             }
         }
     }
 
-    XFile_Print(&file, "\n.PHONY: clean\nclean:\n");
-    XFile_Print(&file, "\t$(RM) $(ODIR)/$(NAME) $(OBJECTS)\n");
+    XByteBuffer_AddFmt(&buffer, "\n.PHONY: clean\nclean:\n");
+    XByteBuffer_AddFmt(&buffer, "\t$(RM) %s $(OBJECTS)%s%s%s\n", pBinPath, pCtx->bUsePch ? " $(PCH).gch" : XSTR_EMPTY, pCtx->bDepends ? " $(DEPS)" : XSTR_EMPTY,
+        !pCtx->bTimeTrace ? XSTR_EMPTY : SMake_IsClang(pCtx) ? " $(OBJECTS:.$(OBJ)=.json)" : " $(addsuffix " SMAKE_REPORT_EXT ",$(OBJECTS))");
+    if (pCtx->nUnitySize) XByteBuffer_AddFmt(&buffer, "\t$(RM) -r $(ODIR)/%s\n", SMAKE_UNITY_DIR);
+    if (pCtx->bDepends) XByteBuffer_AddFmt(&buffer, "\n-include $(DEPS)\n");
+
+    if (buffer.pData == NULL) bStatus = XFALSE;
+    if (bStatus) bStatus = SMake_UpdateFile(sOutput, (const char*)buffer.pData, buffer.nUsed);
+    else xloge("Failed to generate Makefile: %s", sOutput);
+
+    XByteBuffer_Clear(&includes);
+    XByteBuffer_Clear(&flags);
+    XByteBuffer_Clear(&libs);
+    XByteBuffer_Clear(&ld);
+    XByteBuffer_Clear(&vpath);
+    XByteBuffer_Clear(&linkFlags);
+    XByteBuffer_Clear(&buffer);
+    return bStatus;
+}
 
-    XFile_Close(&file);
-    return XTRUE;
-}
\ No newline at end of file
+xbool_t SMake_WriteBuild(smake_ctx_t *pCtx)
+{
+    /* Searched once, watch mode keeps the tools of the first run */
+    if (!pCtx->bToolsFound && (!SMake_FindLauncher(pCtx) || !SMake_FindLinker(pCtx))) return XFALSE;
+    pCtx->bToolsFound = XTRUE;
+    if (pCtx->nBackend == SMAKE_BACKEND_NINJA) return SMake_WriteNinja(pCtx);
+    return SMake_WriteMake(pCtx);
+}
+
+xbool_t SMake_WriteCache(smake_ctx_t *pCtx)
+{
+    if (!pCtx->bUseCache) return XTRUE;
+
+    char sCachePath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+    SMake_GetCachePath(pCtx, sCachePath, sizeof(sCachePath));
+
+    /* Missing cache only makes the next run slower */
+    if (SMake_CacheSave(&pCtx->nextCache, sCachePath))
+        xlogd("Saved scan cache: %s", sCachePath);
+
+    return SMake_FindSaveCache(pCtx);
+}
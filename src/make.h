@@ -11,12 +11,21 @@
 #define __SMAKE_MAKE_H__
 
 #include "stdinc.h"
+#include "arena.h"
+#include "cache.h"
+#include "excl.h"
+#include "ldcache.h"
+#include "list.h"
+#include "pkg.h"
 
 #define SMAKE_CFG_FILE "smake.json"
 #define SMAKE_PATH_MAX 4096
 #define SMAKE_LINE_MAX 2048
 #define SMAKE_NAME_MAX 128
 #define SMAKE_EXT_MAX  6
+#define SMAKE_SCAN_THREADS_MAX 256
+#define SMAKE_UNITY_SIZE_MAX 1024
+#define SMAKE_PCH_HEADERS_MAX 1024
 
 #define SMAKE_FILE_UNF  0
 #define SMAKE_FILE_OBJ  1
@@ -25,16 +34,64 @@
 #define SMAKE_FILE_C    4
 #define SMAKE_FILE_H    5
 
+/* Objects built in different checkouts are the same for the compiler cache */
+#define SMAKE_PREFIX_MAP_MAKE   "-ffile-prefix-map=$(CURDIR)=."
+#define SMAKE_PREFIX_MAP_NINJA  "-ffile-prefix-map=$$PWD=."
+#define SMAKE_CCACHE_SLOPPINESS "pch_defines,time_macros"
+
+#define SMAKE_BACKEND_MAKE  0
+#define SMAKE_BACKEND_NINJA 1
+
+/* Unused functions and data are removed by the linker with --gc-sections */
+#define SMAKE_SECTION_FLAGS "-ffunction-sections -fdata-sections"
+
+#define SMAKE_LTO_NONE 0
+#define SMAKE_LTO_FULL 1
+#define SMAKE_LTO_THIN 2
+
+/* Options given on the command line, the config file does not override them */
+#define SMAKE_ARG_BACKEND   (1 << 0)
+#define SMAKE_ARG_THREADS   (1 << 1)
+#define SMAKE_ARG_LTO       (1 << 2)
+#define SMAKE_ARG_LAUNCHER  (1 << 3)
+#define SMAKE_ARG_LINKER    (1 << 4)
+#define SMAKE_ARG_UNITY     (1 << 5)
+#define SMAKE_ARG_PCH       (1 << 6)
+#define SMAKE_ARG_DEPENDS   (1 << 7)
+#define SMAKE_ARG_CACHE     (1 << 8)
+#define SMAKE_ARG_MIRROR    (1 << 9)
+#define SMAKE_ARG_SECTIONS  (1 << 10)
+#define SMAKE_ARG_COMPDB    (1 << 11)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct {
-    char sPath[SMAKE_PATH_MAX];
-    char sName[SMAKE_NAME_MAX];
+    const char *pPath;
+    size_t nLength;
+} SMakeDir;
+
+typedef struct SMakeFile {
+    const struct SMakeFile *pSource;  /* Source of the object, NULL for source files */
+    const SMakeDir *pDir;   /* Interned directory, shared by all files in it */
+    const char *pName;      /* File name, objects use the stem of the source name */
+    const char *pBinary;    /* Binary of the entry point in multi-binary mode */
+    size_t nLength;
+    xbool_t bNoPch;         /* Object is compiled without the precompiled header */
+    xbool_t bMain;          /* Source of the object defines main() */
     int nType;
 } SMakeFile;
 
+/* Named flag set, selected with "make PROFILE=<name>" */
+typedef struct SMakeProfile {
+    char sName[SMAKE_NAME_MAX];
+    char sLDFlags[SMAKE_LINE_MAX];
+    smake_list_t flagArr;
+    smake_list_t libArr;
+    smake_list_t ldArr;
+} smake_profile_t;
+
 typedef struct SMakeContext {
     /* General info */
     char sCompiler[SMAKE_NAME_MAX];
@@ -47,37 +104,114 @@ typedef struct SMakeContext {
     char sPath[SMAKE_PATH_MAX];
     char sName[SMAKE_NAME_MAX];
     char sMain[SMAKE_NAME_MAX];
+    char sLauncher[SMAKE_PATH_MAX];
+    char sPgoTrain[SMAKE_LINE_MAX];
+    char sLinker[SMAKE_NAME_MAX];
+    char sReportDir[SMAKE_PATH_MAX];  /* Profile and PGO phase of the reported build */
 
     /* Flags */
     xbool_t bSrcFromCfg;
+    xbool_t bUseCache;
+    xbool_t bDepends;
+    xbool_t bMirror;
+    xbool_t bCompDB;
     xbool_t bOverwrite;
     xbool_t bInitProj;
     xbool_t bWriteCfg;
     xbool_t bVPath;
     xbool_t bIsCPP;
     uint8_t nVerbose;
+    uint16_t nScanThreads;
+    uint8_t nBackend;
+    uint16_t nUnitySize;        /* Average number of sources in a unity batch */
+    xbool_t bUnityPerDir;
+    uint16_t nPchHeaders;
+    xbool_t bUsePch;
+    xbool_t bAutoLauncher;
+    uint8_t nLto;
+    size_t nMains;
+    xbool_t bAutoLinker;
+    xbool_t bGcSections;
+    xbool_t bTimeTrace;
+    xbool_t bReport;
+    xbool_t bMinIncludes;
+    xbool_t bFindRefresh;
+    xbool_t bWatch;
+    xbool_t bRegenerate;        /* Watch mode run after a change, outputs are replaced without asking */
+    uint16_t nArgOptions;       /* SMAKE_ARG_* flags of the options given on the command line */
+    xbool_t bMainName;          /* Program name was taken from the entry point */
+    xbool_t bToolsFound;        /* Launcher and linker are resolved, watch mode does not search again */
+    size_t nCfgIncludes;        /* Leading include paths that come from the config */
 
     /* Arrays */
-    xarray_t includes;
-    xarray_t excludes;
+    smake_list_t includes;
+    smake_list_t headerDirs;    /* Every header directory, when includes are reduced */
+    smake_list_t excludes;
     xarray_t fileArr;
-    xarray_t pathArr;
-    xarray_t flagArr;
-    xarray_t libArr;
+    smake_list_t pathArr;
+    smake_list_t flagArr;
+    smake_list_t libArr;
     xarray_t objArr;
-    xarray_t ldArr;
+    xarray_t srcObjArr;         /* Objects of the sources replaced by unity batches */
+    smake_list_t ldArr;
+    xarray_t profiles;
+
+    /* Compiled excludes */
+    smake_excl_t excludeIdx;
+
+    /* Sources that are never part of a unity batch */
+    smake_list_t unityExcludes;
+    smake_excl_t unityExclIdx;
+
+    /* File and object records */
+    smake_arena_t arena;
+    xmap_t dirMap;
+
+    /* Scan cache from the last run and the one written by this run */
+    smake_cache_t prevCache;
+    smake_cache_t nextCache;
+
+    /* Library search results of all projects */
+    smake_find_cache_t findCache;
+    smake_ldcache_t ldCache;
+
+    /* Parsed pkg-config modules */
+    smake_pkg_cache_t pkgCache;
+
+    /* Scanned directories and sources with main(), kept for watch mode */
+    smake_list_t watchDirs;
+    smake_list_t mainFiles;
 } smake_ctx_t;
 
-SMakeFile* SMake_FileNew(const char *pPath, const char *pName, int nType);
+const SMakeDir* SMake_DirIntern(smake_ctx_t *pCtx, const char *pPath);
+SMakeFile* SMake_FileNew(smake_ctx_t *pCtx, const SMakeDir *pDir, const char *pName, int nType);
+SMakeFile* SMake_ObjectNew(smake_ctx_t *pCtx, const SMakeFile *pSource);
 int SMake_GetFileType(const char *pPath, int nLen);
+smake_profile_t* SMake_ProfileNew(smake_ctx_t *pCtx, const char *pName);
 
 void SMake_InitContext(smake_ctx_t *pCtx);
 void SMake_ClearContext(smake_ctx_t *pCtx);
+void SMake_ResetProject(smake_ctx_t *pCtx);
 
 xbool_t SMake_LoadFiles(smake_ctx_t *pCtx, const char *pPath);
 xbool_t SMake_ParseProject(smake_ctx_t *pCtx);
 xbool_t SMake_InitProject(smake_ctx_t *pCtx);
+int SMake_CompareName(const void *pData1, const void *pData2, void *pCtx);
+int SMake_CompareLen(const void *pData1, const void *pData2, void *pCtx);
+
+xbool_t SMake_IsCCache(smake_ctx_t *pCtx);
+xbool_t SMake_IsClang(smake_ctx_t *pCtx);
+xbool_t SMake_IsMulti(smake_ctx_t *pCtx);
+const char* SMake_GetMainName(smake_ctx_t *pCtx, size_t nIndex, int *pLength);
+const char* SMake_GetLtoFlags(smake_ctx_t *pCtx);
+void SMake_AddLtoAr(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer);
+const char* SMake_GetLinkFlags(smake_ctx_t *pCtx, xbyte_buffer_t *pOutput);
+void SMake_AddRelative(xbyte_buffer_t *pBuffer, const char *pFrom, const char *pTo);
+xbool_t SMake_UpdateFile(const char *pPath, const char *pData, size_t nLength);
+xbool_t SMake_CheckOutput(smake_ctx_t *pCtx, const char *pFileName, char *pOutput, size_t nSize);
+xbool_t SMake_WriteBuild(smake_ctx_t *pCtx);
 xbool_t SMake_WriteMake(smake_ctx_t *pCtx);
+xbool_t SMake_WriteCache(smake_ctx_t *pCtx);
 
 #ifdef __cplusplus
 }
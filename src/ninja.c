@@ -0,0 +1,343 @@
+/*!
+ *  @file smake/src/ninja.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Generate build.ninja from the project.
+ */
+
+#include "stdinc.h"
+#include "ninja.h"
+#include "pch.h"
+#include "report.h"
+#include "cfg.h"
+
+/* Paths in build statements must escape '$', ' ' and ':' */
+static void SMake_NinjaPath(xbyte_buffer_t *pBuffer, const char *pPath, int nLength)
+{
+    int i, nStart = 0;
+
+    for (i = 0; i < nLength && pPath[i]; i++)
+    {
+        if (pPath[i] != '$' && pPath[i] != ' ' && pPath[i] != ':') continue;
+        XByteBuffer_AddFmt(pBuffer, "%.*s$%c", i - nStart, &pPath[nStart], pPath[i]);
+        nStart = i + 1;
+    }
+
+    if (i > nStart) XByteBuffer_Add(pBuffer, (const uint8_t*)&pPath[nStart], i - nStart);
+}
+
+static void SMake_NinjaObject(xbyte_buffer_t *pBuffer, const SMakeFile *pObj)
+{
+    XByteBuffer_AddFmt(pBuffer, "$odir/");
+    SMake_NinjaPath(pBuffer, pObj->pName, (int)pObj->nLength);
+    XByteBuffer_AddFmt(pBuffer, ".o");
+}
+
+static xbool_t SMake_NinjaDuplicate(const SMakeFile *pPrev, const SMakeFile *pObj)
+{
+    if (pPrev == NULL || pPrev->nLength != pObj->nLength ||
+        strncmp(pPrev->pName, pObj->pName, pObj->nLength)) return XFALSE;
+
+    /* Ninja rejects two edges with the same output, dropping one would leave its symbols undefined */
+    xloge("Duplicate object: %.*s.o (%s/%s and %s/%s)", (int)pObj->nLength, pObj->pName,
+        pPrev->pSource->pDir->pPath, pPrev->pSource->pName, pObj->pSource->pDir->pPath, pObj->pSource->pName);
+
+    xlogi("Mirror the source tree in output directory with argument: -m");
+    return XTRUE;
+}
+
+/* Prints every linked binary, one per entry point in multi-binary mode */
+static void SMake_NinjaBinaries(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer)
+{
+    if (!SMake_IsMulti(pCtx))
+    {
+        XByteBuffer_AddFmt(pBuffer, " $odir/");
+        SMake_NinjaPath(pBuffer, pCtx->sName, (int)strlen(pCtx->sName));
+        return;
+    }
+
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+    for (i = 0; i < nObjs; i++)
+    {
+        int nLength = 0;
+        const char *pName = SMake_GetMainName(pCtx, i, &nLength);
+        if (pName == NULL) continue;
+
+        XByteBuffer_AddFmt(pBuffer, " $odir/");
+        SMake_NinjaPath(pBuffer, pName, nLength);
+    }
+}
+
+static void SMake_NinjaLink(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, const SMakeFile *pMain, const char *pName, int nLength)
+{
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+
+    XByteBuffer_AddFmt(pBuffer, "\nbuild $odir/");
+    SMake_NinjaPath(pBuffer, pName, nLength);
+    XByteBuffer_AddFmt(pBuffer, ": link");
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL) continue;
+
+        /* Each binary links its own entry point only */
+        if (pMain != NULL && pObj->bMain && pObj != pMain) continue;
+
+        XByteBuffer_AddFmt(pBuffer, " $\n    ");
+        SMake_NinjaObject(pBuffer, pObj);
+    }
+
+    XByteBuffer_AddFmt(pBuffer, "\n");
+}
+
+static void SMake_NinjaInstall(smake_ctx_t *pCtx, xbyte_buffer_t *pBuffer, xbool_t bInstallBinary, xbool_t bInstallIncludes)
+{
+    XByteBuffer_AddFmt(pBuffer, "\nrule install\n  command = ");
+
+    if (bInstallBinary)
+    {
+        xlogi("Install location for binary: %s -> %s", pCtx->sName, pCtx->sBinaryDst);
+        XByteBuffer_AddFmt(pBuffer, "(test -d %s || mkdir -p %s) && ", pCtx->sBinaryDst, pCtx->sBinaryDst);
+        XByteBuffer_AddFmt(pBuffer, "install -m 0755 $in %s/", pCtx->sBinaryDst);
+    }
+
+    if (bInstallIncludes)
+    {
+        if (bInstallBinary) XByteBuffer_AddFmt(pBuffer, " && ");
+        XByteBuffer_AddFmt(pBuffer, "(test -d %s || mkdir -p %s)", pCtx->sHeaderDst, pCtx->sHeaderDst);
+        smake_list_t *pHeaders = pCtx->bMinIncludes ? &pCtx->headerDirs : &pCtx->includes;
+        size_t i, nCount = XArray_Used(&pHeaders->array);
+
+        for (i = 0; i < nCount; i++)
+        {
+            const char *pPath = (const char*)XArray_GetData(&pHeaders->array, i);
+            if (pPath == NULL) continue;
+
+            xlogi("Install location for headers: %s -> %s", pPath, pCtx->sHeaderDst);
+            XByteBuffer_AddFmt(pBuffer, " && cp -r %s/*.h %s/", pPath, pCtx->sHeaderDst);
+        }
+    }
+
+    /* Output is never written, so install runs every time it is requested */
+    XByteBuffer_AddFmt(pBuffer, "\n  description = INSTALL $in\n\n");
+    XByteBuffer_AddFmt(pBuffer, "build $odir/.smake-install: install");
+    SMake_NinjaBinaries(pCtx, pBuffer);
+    XByteBuffer_AddFmt(pBuffer, "\nbuild install: phony $odir/.smake-install\n");
+}
+
+xbool_t SMake_WriteNinja(smake_ctx_t *pCtx)
+{
+    char sOutput[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+    if (!SMake_CheckOutput(pCtx, SMAKE_NINJA_FILE, sOutput, sizeof(sOutput))) return XFALSE;
+
+    /* Ninja has no conditionals, profiles only apply to generated Makefile */
+    if (XArray_Used(&pCtx->profiles)) xlogw("Build profiles are not supported by ninja backend, using default flags");
+    if (xstrused(pCtx->sPgoTrain)) xlogw("PGO targets are not supported by ninja backend");
+
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, SMAKE_ARENA_BLOCK, XFALSE);
+
+    XByteBuffer_AddFmt(&buffer, "####################################\n");
+    XByteBuffer_AddFmt(&buffer, "# Automatically generated by SMake #\n");
+    XByteBuffer_AddFmt(&buffer, "# https://github.com/kala13x/smake #\n");
+    XByteBuffer_AddFmt(&buffer, "####################################\n\n");
+
+    if (!xstrused(pCtx->sName) && !SMake_IsMulti(pCtx))
+    {
+        xstrncpy(pCtx->sName, sizeof(pCtx->sName), pCtx->sMain);
+        pCtx->bMainName = XTRUE;
+    }
+    xbool_t bStatic = strstr(pCtx->sName, ".a") != NULL ? XTRUE : XFALSE;
+    xbool_t bShared = !bStatic && strstr(pCtx->sName, ".so") != NULL ? XTRUE : XFALSE;
+
+    xbyte_buffer_t includes, flags, libs, ld, linkFlags;
+    const char *pIncludes = SMake_SerializeIncludes(&pCtx->includes.array, XSTR_SPACE, &includes);
+    const char *pFlags = SMake_SerializeArray(&pCtx->flagArr.array, XSTR_SPACE, &flags);
+    const char *pLibs = SMake_SerializeArray(&pCtx->libArr.array, XSTR_SPACE, &libs);
+    const char *pLd = SMake_SerializeArray(&pCtx->ldArr.array, XSTR_SPACE, &ld);
+    const char *pLinkFlags = SMake_GetLinkFlags(pCtx, &linkFlags);
+
+    if (pIncludes == NULL || pFlags == NULL || pLibs == NULL || pLd == NULL || pLinkFlags == NULL)
+    {
+        XByteBuffer_Clear(&includes);
+        XByteBuffer_Clear(&flags);
+        XByteBuffer_Clear(&libs);
+        XByteBuffer_Clear(&ld);
+        XByteBuffer_Clear(&linkFlags);
+        XByteBuffer_Clear(&buffer);
+        return XFALSE;
+    }
+
+    const char *pCompiler = xstrused(pCtx->sCompiler) ? pCtx->sCompiler : (pCtx->bIsCPP ? "c++" : "cc");
+    const char *pSpace = xstrused(pFlags) && xstrused(pIncludes) ? XSTR_SPACE : XSTR_EMPTY;
+
+    XByteBuffer_AddFmt(&buffer, "ninja_required_version = 1.3\n\n");
+    xbool_t bLauncher = xstrused(pCtx->sLauncher);
+    xbool_t bCCachePch = bLauncher && pCtx->bUsePch && SMake_IsCCache(pCtx);
+    const char *pLaunch = bLauncher ? "$launcher " : XSTR_EMPTY;
+    const char *pLto = SMake_GetLtoFlags(pCtx);
+
+    if (bStatic) pLinkFlags = XSTR_EMPTY;
+
+    XByteBuffer_AddFmt(&buffer, "cc = %s\n", pCompiler);
+    XByteBuffer_AddFmt(&buffer, "cflags = %s%s%s%s%s%s%s%s%s%s\n", pFlags, pSpace, pIncludes, bShared ? " -fPIC" : XSTR_EMPTY,
+        bLauncher ? XSTR_SPACE : XSTR_EMPTY, bLauncher ? SMAKE_PREFIX_MAP_NINJA : XSTR_EMPTY,
+        pCtx->nLto ? XSTR_SPACE : XSTR_EMPTY, pLto,
+        pCtx->bGcSections ? XSTR_SPACE : XSTR_EMPTY, pCtx->bGcSections ? SMAKE_SECTION_FLAGS : XSTR_EMPTY);
+
+    /* Ninja can not export variables, ccache reads its options from the command environment */
+    if (bCCachePch) XByteBuffer_AddFmt(&buffer, "launcher = CCACHE_SLOPPINESS=%s %s\n", SMAKE_CCACHE_SLOPPINESS, pCtx->sLauncher);
+    else if (bLauncher) XByteBuffer_AddFmt(&buffer, "launcher = %s\n", pCtx->sLauncher);
+    XByteBuffer_AddFmt(&buffer, "ldflags = %s%s%s%s%s\n", pCtx->sLDFlags,
+        xstrused(pCtx->sLDFlags) && xstrused(pLinkFlags) ? XSTR_SPACE : XSTR_EMPTY, pLinkFlags,
+        bShared && pCtx->nLto ? XSTR_SPACE : XSTR_EMPTY, bShared ? pLto : XSTR_EMPTY);
+    XByteBuffer_AddFmt(&buffer, "ldlibs = %s\n", pLd);
+    XByteBuffer_AddFmt(&buffer, "libs = %s\n", pLibs);
+    XByteBuffer_AddFmt(&buffer, "odir = %s\n", pCtx->sOutDir);
+    if (pCtx->bUsePch) XByteBuffer_AddFmt(&buffer, "pchflags = -include $odir/%s -Winvalid-pch%s\n",
+        SMAKE_PCH_FILE, bCCachePch ? " -fpch-preprocess" : XSTR_EMPTY);
+    XByteBuffer_AddFmt(&buffer, "\n");
+
+    if (xstrused(pCtx->sInjectPath))
+        xlogw("Inject file is not supported by ninja backend: %s", pCtx->sInjectPath);
+
+    /* Linking is memory heavy, do not run it next to itself */
+    XByteBuffer_AddFmt(&buffer, "pool link_pool\n  depth = 1\n\n");
+
+    const char *pPchFlags = pCtx->bUsePch ? " $pchflags" : XSTR_EMPTY;
+    XByteBuffer_AddFmt(&buffer, "rule cc\n");
+    XByteBuffer_AddFmt(&buffer, "  command = %s$cc $cflags%s%s -c -o $out $in", pLaunch, pPchFlags, pCtx->bDepends ? " -MMD -MF $out.d" : XSTR_EMPTY);
+
+    /* Clang writes the trace next to the object, gcc report is moved from stderr */
+    if (pCtx->bTimeTrace && SMake_IsClang(pCtx)) XByteBuffer_AddFmt(&buffer, " -ftime-trace");
+    else if (pCtx->bTimeTrace) XByteBuffer_AddFmt(&buffer, " -ftime-report 2> $out%s; s=$$?; %s $out%s >&2; exit $$s",
+        SMAKE_REPORT_EXT, SMAKE_REPORT_FILTER, SMAKE_REPORT_EXT);
+
+    XByteBuffer_AddFmt(&buffer, "\n");
+    if (pCtx->bDepends) XByteBuffer_AddFmt(&buffer, "  depfile = $out.d\n  deps = gcc\n");
+    XByteBuffer_AddFmt(&buffer, "  description = CC $out\n\n");
+
+    if (pCtx->bUsePch)
+    {
+        const char *pLang = pCtx->bIsCPP ? "c++-header" : "c-header";
+        XByteBuffer_AddFmt(&buffer, "rule pch\n");
+        if (pCtx->bDepends)
+        {
+            XByteBuffer_AddFmt(&buffer, "  command = %s$cc $cflags -MMD -MF $out.d -x %s -o $out $in\n", pLaunch, pLang);
+            XByteBuffer_AddFmt(&buffer, "  depfile = $out.d\n  deps = gcc\n");
+        }
+        else XByteBuffer_AddFmt(&buffer, "  command = %s$cc $cflags -x %s -o $out $in\n", pLaunch, pLang);
+        XByteBuffer_AddFmt(&buffer, "  description = PCH $out\n\n");
+    }
+
+    XByteBuffer_AddFmt(&buffer, "rule link\n");
+    if (bStatic)
+    {
+        XByteBuffer_AddFmt(&buffer, "  command = rm -f $out && ");
+        if (pCtx->nLto) SMake_AddLtoAr(pCtx, &buffer);
+        else XByteBuffer_AddFmt(&buffer, "ar");
+        XByteBuffer_AddFmt(&buffer, " rcs $out $in\n");
+    }
+    else if (bShared) XByteBuffer_AddFmt(&buffer, "  command = %s$cc -shared $ldflags -o $out $in $ldlibs $libs\n", pLaunch);
+    else XByteBuffer_AddFmt(&buffer, "  command = %s$cc $cflags $ldflags -o $out $in $ldlibs $libs\n", pLaunch);
+    XByteBuffer_AddFmt(&buffer, "  description = LINK $out\n  pool = link_pool\n\n");
+
+    xlogi("Compiler flags: %s %s", pFlags, pIncludes);
+    xlogi("Linked libraries: %s", pLibs);
+    xlogi("Custom libraries: %s", pLd);
+    xlogi("Binary file name: %s", pCtx->sName);
+    xlogi("Output Directory: %s", pCtx->sOutDir);
+    xlogi("Compiler: %s", pCompiler);
+
+    XArray_Sort(&pCtx->objArr, SMake_CompareName, NULL);
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+
+    const SMakeFile *pPrev = NULL;
+    xbool_t bUnique = XTRUE;
+
+    if (pCtx->bUsePch)
+        XByteBuffer_AddFmt(&buffer, "build $odir/%s.gch: pch $odir/%s\n\n", SMAKE_PCH_FILE, SMAKE_PCH_FILE);
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || pObj->pSource == NULL) continue;
+
+        if (SMake_NinjaDuplicate(pPrev, pObj)) bUnique = XFALSE;
+        pPrev = pObj;
+
+        XByteBuffer_AddFmt(&buffer, "build ");
+        SMake_NinjaObject(&buffer, pObj);
+        XByteBuffer_AddFmt(&buffer, ": cc ");
+        SMake_NinjaPath(&buffer, pObj->pSource->pDir->pPath, (int)pObj->pSource->pDir->nLength);
+        XByteBuffer_AddFmt(&buffer, "/");
+        SMake_NinjaPath(&buffer, pObj->pSource->pName, (int)pObj->pSource->nLength);
+
+        if (pCtx->bUsePch && !pObj->bNoPch) XByteBuffer_AddFmt(&buffer, " | $odir/%s.gch", SMAKE_PCH_FILE);
+        else if (pCtx->bUsePch) XByteBuffer_AddFmt(&buffer, "\n  pchflags =");
+        XByteBuffer_AddFmt(&buffer, "\n");
+    }
+
+    if (!SMake_IsMulti(pCtx)) SMake_NinjaLink(pCtx, &buffer, NULL, pCtx->sName, (int)strlen(pCtx->sName));
+
+    for (i = 0; i < nObjs && SMake_IsMulti(pCtx); i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || !pObj->bMain) continue;
+
+        int nLength = 0;
+        const char *pName = SMake_GetMainName(pCtx, i, &nLength);
+
+        if (pName != NULL) SMake_NinjaLink(pCtx, &buffer, pObj, pName, nLength);
+    }
+
+    /* Target name alone builds the output, unless both are the same path */
+    XByteBuffer_AddFmt(&buffer, "\n");
+    if (SMake_IsMulti(pCtx))
+    {
+        XByteBuffer_AddFmt(&buffer, "build all: phony");
+        SMake_NinjaBinaries(pCtx, &buffer);
+        XByteBuffer_AddFmt(&buffer, "\n");
+    }
+
+    for (i = 0; i < nObjs && strcmp(pCtx->sOutDir, "."); i++)
+    {
+        int nLength = (int)strlen(pCtx->sName);
+        const char *pName = pCtx->sName;
+
+        if (SMake_IsMulti(pCtx)) pName = SMake_GetMainName(pCtx, i, &nLength);
+        if (pName == NULL) continue;
+
+        XByteBuffer_AddFmt(&buffer, "build ");
+        SMake_NinjaPath(&buffer, pName, nLength);
+        XByteBuffer_AddFmt(&buffer, ": phony $odir/");
+        SMake_NinjaPath(&buffer, pName, nLength);
+        XByteBuffer_AddFmt(&buffer, "\n");
+        if (!SMake_IsMulti(pCtx)) break;
+    }
+
+    XByteBuffer_AddFmt(&buffer, "default");
+    SMake_NinjaBinaries(pCtx, &buffer);
+    XByteBuffer_AddFmt(&buffer, "\n");
+
+    xbool_t bInstallIncludes = xstrused(pCtx->sHeaderDst);
+    xbool_t bInstallBinary = xstrused(pCtx->sBinaryDst);
+
+    if (bInstallBinary || bInstallIncludes)
+        SMake_NinjaInstall(pCtx, &buffer, bInstallBinary, bInstallIncludes);
+
+    xbool_t bStatus = bUnique && buffer.pData != NULL ?
+        SMake_UpdateFile(sOutput, (const char*)buffer.pData, buffer.nUsed) : XFALSE;
+    if (!bUnique || buffer.pData == NULL) xloge("Failed to generate %s: %s", SMAKE_NINJA_FILE, sOutput);
+
+    XByteBuffer_Clear(&includes);
+    XByteBuffer_Clear(&flags);
+    XByteBuffer_Clear(&libs);
+    XByteBuffer_Clear(&ld);
+    XByteBuffer_Clear(&linkFlags);
+    XByteBuffer_Clear(&buffer);
+    return bStatus;
+}
@@ -0,0 +1,28 @@
+/*!
+ *  @file smake/src/ninja.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Generate build.ninja from the project.
+ */
+
+#ifndef __SMAKE_NINJA_H__
+#define __SMAKE_NINJA_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+#define SMAKE_NINJA_FILE "build.ninja"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_WriteNinja(smake_ctx_t *pCtx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_NINJA_H__ */
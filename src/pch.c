@@ -0,0 +1,395 @@
+/*!
+ *  @file smake/src/pch.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Generate precompiled header from the most included headers.
+ *
+ * Only the prologue of each source is read: the comments and directives
+ * before its first line of code. Headers that the prologue includes
+ * unconditionally and before any macro is defined are counted once per
+ * source, and the most included ones are written to the generated header
+ * in the order they first appear. Quoted includes are resolved against
+ * the source directory and the project include directories, unresolved
+ * ones are left out, resolved ones are written relative to the output
+ * directory. A source that defines a macro (e.g. _GNU_SOURCE)
+ * before its includes would see different headers when the precompiled
+ * header is forced in front of it, so such sources are compiled without it.
+ */
+
+#include <sys/mman.h>
+#include <limits.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include "cache.h"
+#include "pch.h"
+
+typedef struct SMakePchHeader {
+    const char *pName;  /* "<name>" or resolved path of the project header */
+    size_t nLastSource; /* Last counted source + 1, counts each source once */
+    size_t nCount;      /* Sources that include the header in their prologue */
+    size_t nOrder;      /* First appearance */
+} smake_pch_hdr_t;
+
+typedef struct SMakePchScan {
+    smake_cache_src_t *pRecord; /* Cache record of the scanned source */
+    smake_ctx_t *pCtx;
+    xarray_t headers;
+    xmap_t headerMap;
+    size_t nSources;
+    size_t nOrder;
+} smake_pch_scan_t;
+
+static size_t SMake_PchSkipComment(const char *pData, size_t nSize, size_t nPosit)
+{
+    if (pData[nPosit + 1] == '/')
+    {
+        const char *pEnd = (const char*)memchr(&pData[nPosit], '\n', nSize - nPosit);
+        return pEnd != NULL ? (size_t)(pEnd - pData) : nSize;
+    }
+
+    size_t i;
+    for (i = nPosit + 2; i + 1 < nSize; i++)
+        if (pData[i] == '*' && pData[i + 1] == '/') return i + 2;
+
+    return nSize;
+}
+
+static xbool_t SMake_PchIsComment(const char *pData, size_t nSize, size_t nPosit)
+{
+    return (pData[nPosit] == '/' && nPosit + 1 < nSize &&
+           (pData[nPosit + 1] == '/' || pData[nPosit + 1] == '*')) ? XTRUE : XFALSE;
+}
+
+/* Skips whitespace and comments, newlines only if bLines is set */
+static size_t SMake_PchSkip(const char *pData, size_t nSize, size_t nPosit, xbool_t bLines)
+{
+    while (nPosit < nSize)
+    {
+        char cChar = pData[nPosit];
+        if (cChar == ' ' || cChar == '\t' || cChar == '\r' || cChar == '\f' || cChar == '\v') nPosit++;
+        else if (cChar == '\n' && bLines) nPosit++;
+        else if (cChar == '\\' && nPosit + 1 < nSize && pData[nPosit + 1] == '\n') nPosit += 2;
+        else if (SMake_PchIsComment(pData, nSize, nPosit)) nPosit = SMake_PchSkipComment(pData, nSize, nPosit);
+        else break;
+    }
+
+    return nPosit;
+}
+
+static size_t SMake_PchLineEnd(const char *pData, size_t nSize, size_t nPosit)
+{
+    while (nPosit < nSize && pData[nPosit] != '\n')
+    {
+        if (pData[nPosit] == '\\' && nPosit + 1 < nSize && pData[nPosit + 1] == '\n') nPosit += 2;
+        else if (SMake_PchIsComment(pData, nSize, nPosit)) nPosit = SMake_PchSkipComment(pData, nSize, nPosit);
+        else nPosit++;
+    }
+
+    return nPosit;
+}
+
+static xbool_t SMake_PchIsWord(const char *pData, size_t nSize, size_t nPosit, const char *pWord)
+{
+    size_t nLength = strlen(pWord);
+    if (nPosit + nLength > nSize || strncmp(&pData[nPosit], pWord, nLength)) return XFALSE;
+    if (nPosit + nLength == nSize) return XTRUE;
+
+    char cNext = pData[nPosit + nLength];
+    return (isalnum((unsigned char)cNext) || cNext == '_') ? XFALSE : XTRUE;
+}
+
+/* Resolves quoted include to the real path of the project header */
+static xbool_t SMake_PchResolve(smake_ctx_t *pCtx, const SMakeFile *pSource,
+                                const char *pName, char *pOutput, size_t nSize)
+{
+    char sPath[SMAKE_PATH_MAX * 2];
+    char sReal[PATH_MAX];
+
+    xstrncpyf(sPath, sizeof(sPath), "%s/%s", pSource->pDir->pPath, pName);
+    size_t i, nCount = XArray_Used(&pCtx->includes.array);
+
+    for (i = 0; realpath(sPath, sReal) == NULL; i++)
+    {
+        if (i >= nCount) return XFALSE;
+        const char *pDir = (const char*)XArray_GetData(&pCtx->includes.array, i);
+        xstrncpyf(sPath, sizeof(sPath), "%s/%s", pDir, pName);
+    }
+
+    xstrncpy(pOutput, nSize, sReal);
+    return XTRUE;
+}
+
+static void SMake_PchCount(smake_pch_scan_t *pScan, const SMakeFile *pSource, const char *pInclude, size_t nLength)
+{
+    char sName[SMAKE_PATH_MAX];
+    char sKey[PATH_MAX + 2];
+
+    if (nLength < 3 || nLength >= sizeof(sName)) return;
+    xstrncpyf(sName, sizeof(sName), "%.*s", (int)nLength - 2, pInclude + 1);
+
+    if (pInclude[0] == '<') xstrncpyf(sKey, sizeof(sKey), "<%s>", sName);
+    else if (!SMake_PchResolve(pScan->pCtx, pSource, sName, sKey, sizeof(sKey)))
+    {
+        xlogd("Skipping unresolved header in precompiled header: %s", sName);
+        return;
+    }
+
+    smake_pch_hdr_t *pHeader = (smake_pch_hdr_t*)XMap_Get(&pScan->headerMap, sKey);
+    if (pHeader == NULL)
+    {
+        smake_arena_t *pArena = &pScan->pCtx->arena;
+        pHeader = (smake_pch_hdr_t*)SMake_ArenaAlloc(pArena, sizeof(smake_pch_hdr_t));
+        char *pKey = SMake_ArenaStrdup(pArena, sKey, strlen(sKey));
+        if (pHeader == NULL || pKey == NULL) return;
+
+        pHeader->pName = pKey;
+        pHeader->nOrder = pScan->nOrder++;
+        pHeader->nLastSource = 0;
+        pHeader->nCount = 0;
+
+        XMap_Put(&pScan->headerMap, pKey, pHeader);
+        XArray_AddData(&pScan->headers, pHeader, XSTDNON);
+    }
+
+    if (pHeader->nLastSource == pScan->nSources) return;
+    pHeader->nLastSource = pScan->nSources;
+    pHeader->nCount++;
+}
+
+static void SMake_PchInclude(smake_pch_scan_t *pScan, const SMakeFile *pSource, const char *pInclude, size_t nLength)
+{
+    if (pScan->pRecord != NULL) SMake_CacheAddInclude(&pScan->pCtx->nextCache, pScan->pRecord, pInclude, nLength);
+    SMake_PchCount(pScan, pSource, pInclude, nLength);
+}
+
+/* Counts prologue includes, returns XFALSE if a macro is defined before an include */
+static xbool_t SMake_PchScanBuffer(smake_pch_scan_t *pScan, const SMakeFile *pSource, const char *pData, size_t nSize)
+{
+    xbool_t bDefined = XFALSE;
+    xbool_t bCompatible = XTRUE;
+    size_t nPosit = 0, nCond = 0;
+
+    while (nPosit < nSize)
+    {
+        nPosit = SMake_PchSkip(pData, nSize, nPosit, XTRUE);
+        if (nPosit >= nSize || pData[nPosit] != '#') break;
+
+        size_t nName = SMake_PchSkip(pData, nSize, nPosit + 1, XFALSE);
+        size_t nEnd = SMake_PchLineEnd(pData, nSize, nName);
+
+        if (SMake_PchIsWord(pData, nSize, nName, "include"))
+        {
+            size_t nArg = SMake_PchSkip(pData, nSize, nName + 7, XFALSE);
+            char cClose = nArg < nEnd && pData[nArg] == '<' ? '>' : '"';
+            const char *pClose = nArg < nEnd && (pData[nArg] == '<' || pData[nArg] == '"') ?
+                (const char*)memchr(&pData[nArg + 1], cClose, nEnd - nArg - 1) : NULL;
+
+            if (pClose != NULL)
+            {
+                if (bDefined) bCompatible = XFALSE;
+                else if (!nCond) SMake_PchInclude(pScan, pSource, &pData[nArg], (size_t)(pClose - &pData[nArg]) + 1);
+            }
+        }
+        else if (SMake_PchIsWord(pData, nSize, nName, "if") ||
+                 SMake_PchIsWord(pData, nSize, nName, "ifdef") ||
+                 SMake_PchIsWord(pData, nSize, nName, "ifndef")) nCond++;
+        else if (SMake_PchIsWord(pData, nSize, nName, "endif")) { if (nCond) nCond--; }
+        else if (SMake_PchIsWord(pData, nSize, nName, "define") ||
+                 SMake_PchIsWord(pData, nSize, nName, "undef") ||
+                 SMake_PchIsWord(pData, nSize, nName, "pragma")) bDefined = XTRUE;
+
+        nPosit = nEnd;
+    }
+
+    return bCompatible;
+}
+
+/* Returns XSTDERR if the source can not be read, otherwise XSTDOK when it can use the header */
+static int SMake_PchScanFile(smake_pch_scan_t *pScan, const SMakeFile *pSource, const char *pPath)
+{
+    int nFD = open(pPath, O_RDONLY);
+    if (nFD < 0)
+    {
+        xlogw("Failed to open source file: %s (%s)", pPath, XSTRERR);
+        return XSTDERR;
+    }
+
+    struct stat fileStat;
+    if (fstat(nFD, &fileStat) < 0 || fileStat.st_size <= 0)
+    {
+        close(nFD);
+        return XSTDOK;
+    }
+
+    size_t nSize = (size_t)fileStat.st_size;
+    void *pData = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, nFD, 0);
+    close(nFD);
+
+    if (pData == MAP_FAILED)
+    {
+        xlogw("Failed to map source file: %s (%s)", pPath, XSTRERR);
+        return XSTDERR;
+    }
+
+    pScan->nSources++;
+    xbool_t bCompatible = SMake_PchScanBuffer(pScan, pSource, (const char*)pData, nSize);
+    munmap(pData, nSize);
+    return bCompatible ? XSTDOK : XSTDNON;
+}
+
+static xbool_t SMake_PchScanSource(smake_pch_scan_t *pScan, const SMakeFile *pSource)
+{
+    smake_ctx_t *pCtx = pScan->pCtx;
+    char sPath[SMAKE_PATH_MAX * 2];
+    xstrncpyf(sPath, sizeof(sPath), "%s/%s", pSource->pDir->pPath, pSource->pName);
+
+    struct stat fileStat;
+    xbool_t bStat = (pCtx->bUseCache && stat(sPath, &fileStat) >= 0) ? XTRUE : XFALSE;
+    const smake_cache_src_t *pCached = bStat ? SMake_CacheGetSource(&pCtx->prevCache, sPath, &fileStat) : NULL;
+    pScan->pRecord = bStat ? SMake_CacheSource(&pCtx->nextCache, sPath, &fileStat) : NULL;
+    int nCompatible;
+
+    /* Unchanged sources are not read again, their includes are counted from the cache */
+    if (pCached != NULL && pCached->nPch >= 0)
+    {
+        const smake_cache_incl_t *pIncl = pCached->pIncludes;
+        pScan->nSources++;
+
+        for (; pIncl != NULL; pIncl = pIncl->pNext)
+            SMake_PchInclude(pScan, pSource, pIncl->pName, strlen(pIncl->pName));
+
+        nCompatible = pCached->nPch;
+    }
+    else nCompatible = SMake_PchScanFile(pScan, pSource, sPath);
+
+    if (pScan->pRecord != NULL && nCompatible >= 0) pScan->pRecord->nPch = nCompatible;
+    pScan->pRecord = NULL;
+
+    if (!nCompatible) xlogi("Source defines macros before includes, not using precompiled header: %s", sPath);
+    return nCompatible > 0 ? XTRUE : XFALSE;
+}
+
+static int SMake_PchCompareCount(const void *pData1, const void *pData2)
+{
+    const smake_pch_hdr_t *pFirst = *(const smake_pch_hdr_t**)pData1;
+    const smake_pch_hdr_t *pSecond = *(const smake_pch_hdr_t**)pData2;
+
+    if (pFirst->nCount != pSecond->nCount) return pFirst->nCount > pSecond->nCount ? -1 : 1;
+    return (int)(pFirst->nOrder > pSecond->nOrder) - (int)(pFirst->nOrder < pSecond->nOrder);
+}
+
+static int SMake_PchCompareOrder(const void *pData1, const void *pData2)
+{
+    const smake_pch_hdr_t *pFirst = *(const smake_pch_hdr_t**)pData1;
+    const smake_pch_hdr_t *pSecond = *(const smake_pch_hdr_t**)pData2;
+    return (int)(pFirst->nOrder > pSecond->nOrder) - (int)(pFirst->nOrder < pSecond->nOrder);
+}
+
+static xbool_t SMake_PchWrite(smake_ctx_t *pCtx, smake_pch_scan_t *pScan)
+{
+    size_t i, nHeaders = XArray_Used(&pScan->headers);
+    if (!nHeaders) return XTRUE;
+
+    smake_pch_hdr_t **pHeaders = (smake_pch_hdr_t**)calloc(nHeaders, sizeof(smake_pch_hdr_t*));
+    if (pHeaders == NULL)
+    {
+        xloge("Failed to allocate memory for precompiled header: %s", XSTRERR);
+        return XFALSE;
+    }
+
+    for (i = 0; i < nHeaders; i++)
+        pHeaders[i] = (smake_pch_hdr_t*)XArray_GetData(&pScan->headers, i);
+
+    /* Top headers, but only ones that are shared by at least two sources */
+    qsort(pHeaders, nHeaders, sizeof(smake_pch_hdr_t*), SMake_PchCompareCount);
+    size_t nUsed = 0;
+
+    while (nUsed < nHeaders && nUsed < pCtx->nPchHeaders && pHeaders[nUsed]->nCount > 1) nUsed++;
+    qsort(pHeaders, nUsed, sizeof(smake_pch_hdr_t*), SMake_PchCompareOrder);
+
+    if (!nUsed)
+    {
+        xlogi("No shared headers found for precompiled header.");
+        free(pHeaders);
+        return XTRUE;
+    }
+
+    char sOutPath[PATH_MAX];
+    if ((!XPath_Exists(pCtx->sOutDir) && !XDir_Create(pCtx->sOutDir, 0775)) ||
+        realpath(pCtx->sOutDir, sOutPath) == NULL)
+    {
+        xloge("Failed to create directory: %s (%s)", pCtx->sOutDir, XSTRERR);
+        free(pHeaders);
+        return XFALSE;
+    }
+
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, SMAKE_LINE_MAX, XFALSE);
+    XByteBuffer_AddFmt(&buffer, "/* Automatically generated by SMake, do not edit */\n");
+
+    for (i = 0; i < nUsed; i++)
+    {
+        /* Project headers are included relative to the output directory */
+        const char *pName = pHeaders[i]->pName;
+        if (pName[0] == '<') XByteBuffer_AddFmt(&buffer, "#include %s\n", pName);
+        else
+        {
+            XByteBuffer_AddFmt(&buffer, "#include \"");
+            SMake_AddRelative(&buffer, sOutPath, pName);
+            XByteBuffer_AddFmt(&buffer, "\"\n");
+        }
+
+        xlogd("Precompiled header: %s (%zu/%zu sources)", pName, pHeaders[i]->nCount, pScan->nSources);
+    }
+
+    char sPath[SMAKE_PATH_MAX + SMAKE_NAME_MAX];
+    xstrncpyf(sPath, sizeof(sPath), "%s/%s", pCtx->sOutDir, SMAKE_PCH_FILE);
+
+    xbool_t bStatus = buffer.pData != NULL ?
+        SMake_UpdateFile(sPath, (const char*)buffer.pData, buffer.nUsed) : XFALSE;
+
+    if (bStatus)
+    {
+        xlogi("Precompiled header %s: %zu headers", sPath, nUsed);
+        pCtx->bUsePch = XTRUE;
+    }
+
+    XByteBuffer_Clear(&buffer);
+    free(pHeaders);
+    return bStatus;
+}
+
+xbool_t SMake_PchBuild(smake_ctx_t *pCtx)
+{
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+    /* Report reads the traces of the last build, header stays as it was */
+    if (!pCtx->nPchHeaders || nObjs < 2 || pCtx->bReport) return XTRUE;
+
+    int nType = pCtx->bIsCPP ? SMAKE_FILE_CPP : SMAKE_FILE_C;
+    smake_pch_scan_t scan;
+
+    XArray_Init(&scan.headers, NULL, XSTDNON, XFALSE);
+    XMap_Init(&scan.headerMap, SMAKE_NAME_MAX);
+    scan.headers.clearCb = NULL;
+    scan.pRecord = NULL;
+    scan.pCtx = pCtx;
+    scan.nSources = 0;
+    scan.nOrder = 0;
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || pObj->pSource == NULL) continue;
+
+        /* Header is compiled for the language of the project */
+        if (pObj->pSource->nType != nType) pObj->bNoPch = XTRUE;
+        else if (!SMake_PchScanSource(&scan, pObj->pSource)) pObj->bNoPch = XTRUE;
+    }
+
+    xbool_t bStatus = SMake_PchWrite(pCtx, &scan);
+    XMap_Destroy(&scan.headerMap);
+    XArray_Destroy(&scan.headers);
+    return bStatus;
+}
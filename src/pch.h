@@ -0,0 +1,29 @@
+/*!
+ *  @file smake/src/pch.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Generate precompiled header from the most included headers.
+ */
+
+#ifndef __SMAKE_PCH_H__
+#define __SMAKE_PCH_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+/* Reserved file name, generated in the output directory and never scanned */
+#define SMAKE_PCH_FILE "smake_pch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_PchBuild(smake_ctx_t *pCtx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_PCH_H__ */
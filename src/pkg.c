@@ -0,0 +1,332 @@
+/*!
+ *  @file smake/src/pkg.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Resolve compiler and linker flags from pkg-config files.
+ *
+ * Modules are looked up in PKG_CONFIG_PATH and in PKG_CONFIG_LIBDIR or
+ * the default pkg-config directories. Cflags are collected from the
+ * module, its Requires and Requires.private, Libs from the module and its
+ * Requires, like "pkg-config --cflags --libs" does for shared linking.
+ */
+
+#include <ctype.h>
+#include "pkg.h"
+#include "ldcache.h"
+
+#define SMAKE_PKG_MAP       64
+#define SMAKE_PKG_SPACE     " \t"
+#define SMAKE_PKG_MODULES   " \t,"
+
+void SMake_PkgInit(smake_pkg_cache_t *pCache)
+{
+    SMake_ArenaInit(&pCache->arena);
+    SMake_ListInit(&pCache->paths);
+    XMap_Init(&pCache->modules, SMAKE_PKG_MAP);
+    pCache->bPaths = XFALSE;
+}
+
+void SMake_PkgDestroy(smake_pkg_cache_t *pCache)
+{
+    XMap_Destroy(&pCache->modules);
+    SMake_ListDestroy(&pCache->paths);
+    SMake_ArenaDestroy(&pCache->arena);
+}
+
+/* Copies the next token to pToken, returns NULL when there is none */
+static const char* SMake_PkgToken(const char *pPos, const char *pDlmt, char *pToken, size_t nSize)
+{
+    while (*pPos && strchr(pDlmt, *pPos) != NULL) pPos++;
+    XASSERT(*pPos, NULL);
+
+    size_t nLength = strcspn(pPos, pDlmt);
+    xstrncpyf(pToken, nSize, "%.*s", (int)nLength, pPos);
+    return pPos + nLength;
+}
+
+static void SMake_PkgAddPaths(smake_pkg_cache_t *pCache, const char *pPaths)
+{
+    char sPath[XPATH_MAX];
+    const char *pPos = pPaths;
+
+    while ((pPos = SMake_PkgToken(pPos, ":", sPath, sizeof(sPath))) != NULL)
+        SMake_AddToList(&pCache->paths, "%s", sPath);
+}
+
+static void SMake_PkgInitPaths(smake_pkg_cache_t *pCache)
+{
+    pCache->bPaths = XTRUE;
+
+    const char *pEnvPath = getenv("PKG_CONFIG_PATH");
+    if (xstrused(pEnvPath)) SMake_PkgAddPaths(pCache, pEnvPath);
+
+    /* PKG_CONFIG_LIBDIR replaces the default search path */
+    const char *pLibDir = getenv("PKG_CONFIG_LIBDIR");
+    if (pLibDir != NULL)
+    {
+        SMake_PkgAddPaths(pCache, pLibDir);
+        return;
+    }
+
+    const char *pMultiarch = SMake_LdCacheMultiarch();
+    const char *pPrefixes[] = { "/usr/local", "/usr", NULL };
+    size_t i;
+
+    for (i = 0; pPrefixes[i] != NULL; i++)
+    {
+        if (pMultiarch != NULL) SMake_AddToList(&pCache->paths, "%s/lib/%s/pkgconfig", pPrefixes[i], pMultiarch);
+        SMake_AddToList(&pCache->paths, "%s/lib64/pkgconfig", pPrefixes[i]);
+        SMake_AddToList(&pCache->paths, "%s/lib/pkgconfig", pPrefixes[i]);
+        SMake_AddToList(&pCache->paths, "%s/share/pkgconfig", pPrefixes[i]);
+    }
+}
+
+static const char* SMake_PkgExpand(smake_pkg_cache_t *pCache, xmap_t *pVars, const char *pValue, size_t nLength)
+{
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, nLength + 1, XFALSE);
+
+    const char *pEnd = pValue + nLength;
+    const char *pPos = pValue;
+
+    while (pPos < pEnd)
+    {
+        const char *pVar = (const char*)memchr(pPos, '$', pEnd - pPos);
+        if (pVar == NULL || pVar + 1 >= pEnd)
+        {
+            XByteBuffer_Add(&buffer, (const uint8_t*)pPos, pEnd - pPos);
+            break;
+        }
+
+        XByteBuffer_Add(&buffer, (const uint8_t*)pPos, pVar - pPos);
+        const char *pClose = pVar[1] == '{' ? (const char*)memchr(pVar, '}', pEnd - pVar) : NULL;
+
+        if (pVar[1] == '$')
+        {
+            XByteBuffer_Add(&buffer, (const uint8_t*)"$", 1);
+            pPos = pVar + 2;
+        }
+        else if (pClose != NULL)
+        {
+            char sName[XNAME_MAX];
+            xstrncpyf(sName, sizeof(sName), "%.*s", (int)(pClose - pVar - 2), pVar + 2);
+
+            const char *pData = (const char*)XMap_Get(pVars, sName);
+            if (pData != NULL) XByteBuffer_Add(&buffer, (const uint8_t*)pData, strlen(pData));
+            else xlogd("Undefined pkg-config variable: %s", sName);
+            pPos = pClose + 1;
+        }
+        else
+        {
+            XByteBuffer_Add(&buffer, (const uint8_t*)pVar, 1);
+            pPos = pVar + 1;
+        }
+    }
+
+    const char *pResult = SMake_ArenaStrdup(&pCache->arena, buffer.pData ? (const char*)buffer.pData : XSTR_EMPTY, buffer.nUsed);
+    XByteBuffer_Clear(&buffer);
+    return pResult;
+}
+
+static void SMake_PkgParseLine(smake_pkg_cache_t *pCache, smake_pkg_t *pPkg, xmap_t *pVars, const char *pLine, const char *pEnd)
+{
+    /* Everything after '#' is a comment */
+    const char *pComment = (const char*)memchr(pLine, '#', pEnd - pLine);
+    if (pComment != NULL) pEnd = pComment;
+
+    while (pLine < pEnd && isspace((unsigned char)*pLine)) pLine++;
+    while (pEnd > pLine && isspace((unsigned char)pEnd[-1])) pEnd--;
+
+    const char *pKeyEnd = pLine;
+    while (pKeyEnd < pEnd && (isalnum((unsigned char)*pKeyEnd) || *pKeyEnd == '_' || *pKeyEnd == '.')) pKeyEnd++;
+    if (pKeyEnd == pLine) return;
+
+    const char *pValue = pKeyEnd;
+    while (pValue < pEnd && isspace((unsigned char)*pValue)) pValue++;
+    if (pValue >= pEnd || (*pValue != '=' && *pValue != ':')) return;
+
+    char nSep = *pValue++;
+    while (pValue < pEnd && isspace((unsigned char)*pValue)) pValue++;
+
+    char *pKey = SMake_ArenaStrdup(&pCache->arena, pLine, pKeyEnd - pLine);
+    const char *pExpanded = SMake_PkgExpand(pCache, pVars, pValue, pEnd - pValue);
+    if (pKey == NULL || pExpanded == NULL) return;
+
+    if (nSep == '=') XMap_Put(pVars, pKey, (void*)pExpanded);
+    else if (!strcmp(pKey, "Cflags") || !strcmp(pKey, "CFlags")) pPkg->pCflags = pExpanded;
+    else if (!strcmp(pKey, "Libs")) pPkg->pLibs = pExpanded;
+    else if (!strcmp(pKey, "Requires")) pPkg->pRequires = pExpanded;
+    else if (!strcmp(pKey, "Requires.private")) pPkg->pRequiresPriv = pExpanded;
+}
+
+static void SMake_PkgParse(smake_pkg_cache_t *pCache, smake_pkg_t *pPkg, const char *pBuffer, size_t nSize)
+{
+    xmap_t vars;
+    XMap_Init(&vars, SMAKE_PKG_MAP);
+
+    /* Relocatable packages refer to their own location */
+    const char *pSlash = strrchr(pPkg->pPath, '/');
+    size_t nDirLen = pSlash != NULL ? (size_t)(pSlash - pPkg->pPath) : 0;
+    XMap_Put(&vars, "pcfiledir", SMake_ArenaStrdup(&pCache->arena, pPkg->pPath, nDirLen));
+
+    const char *pLine = pBuffer;
+    const char *pBufEnd = pBuffer + nSize;
+
+    while (pLine < pBufEnd)
+    {
+        const char *pEnd = (const char*)memchr(pLine, '\n', pBufEnd - pLine);
+        if (pEnd == NULL) pEnd = pBufEnd;
+
+        SMake_PkgParseLine(pCache, pPkg, &vars, pLine, pEnd);
+        pLine = pEnd + 1;
+    }
+
+    XMap_Destroy(&vars);
+}
+
+static const smake_pkg_t* SMake_PkgLoad(smake_pkg_cache_t *pCache, const char *pName)
+{
+    smake_pkg_t *pPkg = (smake_pkg_t*)XMap_Get(&pCache->modules, pName);
+    if (pPkg != NULL) return pPkg;
+
+    pPkg = (smake_pkg_t*)SMake_ArenaAlloc(&pCache->arena, sizeof(smake_pkg_t));
+    XASSERT(pPkg, NULL);
+
+    memset(pPkg, 0, sizeof(smake_pkg_t));
+    pPkg->pName = SMake_ArenaStrdup(&pCache->arena, pName, strlen(pName));
+    XASSERT(pPkg->pName, NULL);
+
+    /* Missing modules are remembered too */
+    XMap_Put(&pCache->modules, pPkg->pName, pPkg);
+    if (!pCache->bPaths) SMake_PkgInitPaths(pCache);
+
+    size_t i, nUsed = XArray_Used(&pCache->paths.array);
+    char sPath[XPATH_MAX];
+
+    for (i = 0; i < nUsed; i++)
+    {
+        const char *pDir = (const char*)XArray_GetData(&pCache->paths.array, i);
+        xstrncpyf(sPath, sizeof(sPath), "%s/%s%s", pDir, pName, SMAKE_PKG_EXT);
+        if (XPath_Exists(sPath)) break;
+    }
+
+    XASSERT_RET((i < nUsed), pPkg);
+    size_t nSize = 0;
+
+    char *pBuffer = (char*)XPath_Load(sPath, &nSize);
+    if (pBuffer == NULL)
+    {
+        xlogw("Failed to read package: %s (%s)", sPath, XSTRERR);
+        return pPkg;
+    }
+
+    pPkg->pPath = SMake_ArenaStrdup(&pCache->arena, sPath, strlen(sPath));
+    if (pPkg->pPath != NULL) SMake_PkgParse(pCache, pPkg, pBuffer, nSize);
+
+    xlogd("Loaded package %s: %s", pName, sPath);
+    free(pBuffer);
+    return pPkg;
+}
+
+static xbool_t SMake_PkgIsSystem(const char *pFlag)
+{
+    /* Compiler and linker search these anyway, pkg-config drops them too */
+    const char *pDirs[] = { "/usr/lib", "/usr/lib64", "/lib", "/lib64", NULL };
+    const char *pMultiarch = SMake_LdCacheMultiarch();
+    size_t i;
+
+    if (!strcmp(pFlag, "-I/usr/include")) return XTRUE;
+    if (strncmp(pFlag, "-L", 2)) return XFALSE;
+
+    for (i = 0; pDirs[i] != NULL; i++)
+    {
+        size_t nLength = strlen(pDirs[i]);
+        if (strncmp(pFlag + 2, pDirs[i], nLength)) continue;
+
+        const char *pRest = pFlag + 2 + nLength;
+        if (!*pRest || !strcmp(pRest, "/")) return XTRUE;
+        if (pMultiarch != NULL && pRest[0] == '/' && !strcmp(pRest + 1, pMultiarch)) return XTRUE;
+    }
+
+    return XFALSE;
+}
+
+static void SMake_PkgAddFlags(smake_list_t *pList, const char *pFlags)
+{
+    XASSERT_VOID_RET(pFlags);
+    char sToken[XPATH_MAX];
+
+    while ((pFlags = SMake_PkgToken(pFlags, SMAKE_PKG_SPACE, sToken, sizeof(sToken))) != NULL)
+        if (!SMake_PkgIsSystem(sToken)) SMake_AddToList(pList, "%s", sToken);
+}
+
+static xbool_t SMake_PkgWalk(smake_pkg_cache_t *pCache, const char *pModules, smake_list_t *pVisited, smake_list_t *pOutput, xbool_t bLibs)
+{
+    XASSERT_RET(pModules, XTRUE);
+    char sToken[XNAME_MAX];
+    xbool_t bStatus = XTRUE;
+
+    xbool_t bVersion = XFALSE;
+
+    while ((pModules = SMake_PkgToken(pModules, SMAKE_PKG_MODULES, sToken, sizeof(sToken))) != NULL)
+    {
+        /* Version constraint, e.g. "glib-2.0 >= 2.50" or "glib-2.0>=2.50" */
+        if (bVersion)
+        {
+            bVersion = XFALSE;
+            continue;
+        }
+
+        size_t nName = strcspn(sToken, "<>=!");
+        if (sToken[nName] != XSTR_NUL)
+        {
+            const char *pOp = &sToken[nName];
+            bVersion = pOp[strspn(pOp, "<>=!")] == XSTR_NUL ? XTRUE : XFALSE;
+            sToken[nName] = XSTR_NUL;
+            if (!nName) continue;
+        }
+
+        if (SMake_ListContains(pVisited, sToken)) continue;
+        SMake_AddToList(pVisited, "%s", sToken);
+
+        const smake_pkg_t *pPkg = SMake_PkgLoad(pCache, sToken);
+        if (pPkg == NULL || pPkg->pPath == NULL)
+        {
+            if (!bLibs) xlogw("Package not found: %s", sToken);
+            bStatus = XFALSE;
+            continue;
+        }
+
+        if (bLibs)
+        {
+            SMake_PkgAddFlags(pOutput, pPkg->pLibs);
+            if (!SMake_PkgWalk(pCache, pPkg->pRequires, pVisited, pOutput, bLibs)) bStatus = XFALSE;
+            continue;
+        }
+
+        SMake_PkgAddFlags(pOutput, pPkg->pCflags);
+        if (!SMake_PkgWalk(pCache, pPkg->pRequires, pVisited, pOutput, bLibs)) bStatus = XFALSE;
+        if (!SMake_PkgWalk(pCache, pPkg->pRequiresPriv, pVisited, pOutput, bLibs)) bStatus = XFALSE;
+    }
+
+    return bStatus;
+}
+
+xbool_t SMake_PkgResolve(smake_pkg_cache_t *pCache, const char *pModules, smake_list_t *pFlags, smake_list_t *pLibs)
+{
+    XASSERT_RET(xstrused(pModules), XTRUE);
+    smake_list_t visited;
+    xbool_t bStatus;
+
+    SMake_ListInit(&visited);
+    bStatus = SMake_PkgWalk(pCache, pModules, &visited, pFlags, XFALSE);
+
+    /* Libs of Requires.private are needed only for static linking */
+    SMake_ListClear(&visited);
+    if (!SMake_PkgWalk(pCache, pModules, &visited, pLibs, XTRUE)) bStatus = XFALSE;
+
+    SMake_ListDestroy(&visited);
+    return bStatus;
+}
@@ -0,0 +1,48 @@
+/*!
+ *  @file smake/src/pkg.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Resolve compiler and linker flags from pkg-config files.
+ */
+
+#ifndef __SMAKE_PKG_H__
+#define __SMAKE_PKG_H__
+
+#include "stdinc.h"
+#include "arena.h"
+#include "list.h"
+
+#define SMAKE_PKG_EXT   ".pc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SMakePkg {
+    const char *pName;
+    const char *pPath;          /* NULL when the module was not found */
+    const char *pCflags;
+    const char *pLibs;
+    const char *pRequires;
+    const char *pRequiresPriv;  /* Adds compiler flags only */
+} smake_pkg_t;
+
+typedef struct SMakePkgCache {
+    smake_arena_t arena;
+    smake_list_t paths;
+    xmap_t modules;             /* Every module is read once per run */
+    xbool_t bPaths;
+} smake_pkg_cache_t;
+
+void SMake_PkgInit(smake_pkg_cache_t *pCache);
+void SMake_PkgDestroy(smake_pkg_cache_t *pCache);
+
+xbool_t SMake_PkgResolve(smake_pkg_cache_t *pCache, const char *pModules, smake_list_t *pFlags, smake_list_t *pLibs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_PKG_H__ */
@@ -0,0 +1,482 @@
+/*!
+ *  @file smake/src/report.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Aggregate compiler time traces into a build report.
+ *
+ * Objects are compiled with -ftime-trace by clang, which writes a Chrome
+ * trace as <object stem>.json, or with -ftime-report by gcc, whose report
+ * is saved from stderr as <object>.ftr. Clang traces have per-header and
+ * per-template events, durations of nested events include their children,
+ * so header and template times are inclusive. GCC only reports time of its
+ * internal activities, so the header and template tables stay empty.
+ * All times are kept in microseconds.
+ */
+
+#include "report.h"
+
+#define SMAKE_REPORT_TOP    20
+#define SMAKE_REPORT_MAP    1024
+#define SMAKE_REPORT_WIDTH  120
+
+typedef struct SMakeReportEntry {
+    const char *pName;
+    uint64_t nTime;
+    uint64_t nFrontend;
+    uint64_t nBackend;
+    size_t nCount;
+} smake_report_entry_t;
+
+typedef struct SMakeReportTable {
+    xarray_t entries;
+    xmap_t entryMap;
+} smake_report_table_t;
+
+typedef struct SMakeReport {
+    smake_report_table_t units;
+    smake_report_table_t headers;
+    smake_report_table_t templates;
+    smake_report_table_t activities;
+    smake_arena_t arena;
+    char sOutDir[SMAKE_PATH_MAX];
+    uint64_t nTotal;
+    size_t nMissing;
+} smake_report_t;
+
+static void SMake_TableInit(smake_report_table_t *pTable)
+{
+    XArray_Init(&pTable->entries, NULL, XSTDNON, XFALSE);
+    XMap_Init(&pTable->entryMap, SMAKE_REPORT_MAP);
+    pTable->entries.clearCb = NULL;
+}
+
+static void SMake_TableDestroy(smake_report_table_t *pTable)
+{
+    XMap_Destroy(&pTable->entryMap);
+    XArray_Destroy(&pTable->entries);
+}
+
+static int SMake_TableCompare(const void *pData1, const void *pData2, void *pCtx)
+{
+    (void)pCtx;
+    const smake_report_entry_t *pFirst = (smake_report_entry_t*)((xarray_data_t*)pData1)->pData;
+    const smake_report_entry_t *pSecond = (smake_report_entry_t*)((xarray_data_t*)pData2)->pData;
+
+    if (pFirst->nTime != pSecond->nTime) return pFirst->nTime > pSecond->nTime ? -1 : 1;
+    return strcmp(pFirst->pName, pSecond->pName);
+}
+
+static smake_report_entry_t* SMake_TableAdd(smake_report_t *pReport, smake_report_table_t *pTable, const char *pName, uint64_t nTime)
+{
+    smake_report_entry_t *pEntry = (smake_report_entry_t*)XMap_Get(&pTable->entryMap, pName);
+    if (pEntry == NULL)
+    {
+        pEntry = (smake_report_entry_t*)SMake_ArenaAlloc(&pReport->arena, sizeof(smake_report_entry_t));
+        char *pCopy = SMake_ArenaStrdup(&pReport->arena, pName, strlen(pName));
+        XASSERT((pEntry != NULL && pCopy != NULL), NULL);
+
+        memset(pEntry, 0, sizeof(smake_report_entry_t));
+        pEntry->pName = pCopy;
+
+        XMap_Put(&pTable->entryMap, pEntry->pName, pEntry);
+        XArray_AddData(&pTable->entries, pEntry, XSTDNON);
+    }
+
+    pEntry->nTime += nTime;
+    pEntry->nCount++;
+    return pEntry;
+}
+
+static const char* SMake_ReportString(xjson_obj_t *pObj, const char *pName)
+{
+    xjson_obj_t *pValueObj = XJSON_GetObject(pObj, pName);
+    return pValueObj != NULL ? XJSON_GetString(pValueObj) : NULL;
+}
+
+static xbool_t SMake_ReportClang(smake_report_t *pReport, smake_report_entry_t *pUnit, const char *pPath)
+{
+    size_t nSize = 0;
+    char *pBuffer = (char*)XPath_Load(pPath, &nSize);
+    XASSERT(pBuffer, XFALSE);
+
+    xjson_t json;
+    if (!XJSON_Parse(&json, NULL, pBuffer, nSize))
+    {
+        char sError[256];
+        XJSON_GetErrorStr(&json, sError, sizeof(sError));
+        xlogw("Failed to parse time trace: %s (%s)", pPath, sError);
+
+        XJSON_Destroy(&json);
+        free(pBuffer);
+        return XFALSE;
+    }
+
+    xjson_obj_t *pEvents = XJSON_GetObject(json.pRootObj, "traceEvents");
+    size_t i, nEvents = pEvents != NULL ? XJSON_GetArrayLength(pEvents) : 0;
+    uint64_t nLongest = 0;
+
+    for (i = 0; i < nEvents; i++)
+    {
+        xjson_obj_t *pEventObj = XJSON_GetArrayItem(pEvents, i);
+        const char *pPhase = SMake_ReportString(pEventObj, "ph");
+        const char *pName = SMake_ReportString(pEventObj, "name");
+        xjson_obj_t *pDurObj = XJSON_GetObject(pEventObj, "dur");
+        if (pPhase == NULL || pName == NULL || pDurObj == NULL || strcmp(pPhase, "X")) continue;
+
+        uint64_t nTime = XJSON_GetU64(pDurObj);
+        xjson_obj_t *pArgsObj = XJSON_GetObject(pEventObj, "args");
+        const char *pDetail = pArgsObj != NULL ? SMake_ReportString(pArgsObj, "detail") : NULL;
+        if (nTime > nLongest) nLongest = nTime;
+
+        /* Summary events of clang, one per kind of event in the unit */
+        if (!strncmp(pName, "Total ", 6)) SMake_TableAdd(pReport, &pReport->activities, pName + 6, nTime);
+        else if (!strcmp(pName, "ExecuteCompiler")) pUnit->nTime = nTime;
+        else if (!strcmp(pName, "Frontend")) pUnit->nFrontend += nTime;
+        else if (!strcmp(pName, "Backend")) pUnit->nBackend += nTime;
+        else if (!xstrused(pDetail)) continue;
+        else if (!strcmp(pName, "Source")) SMake_TableAdd(pReport, &pReport->headers, pDetail, nTime);
+        else if (!strcmp(pName, "InstantiateClass") || !strcmp(pName, "InstantiateFunction"))
+            SMake_TableAdd(pReport, &pReport->templates, pDetail, nTime);
+    }
+
+    /* Older clang versions do not have the outermost event */
+    if (!pUnit->nTime) pUnit->nTime = nLongest;
+
+    XJSON_Destroy(&json);
+    free(pBuffer);
+    return XTRUE;
+}
+
+static xbool_t SMake_ReportNumber(char **ppPos, uint64_t *pTime)
+{
+    char *pEnd = NULL;
+    double fValue = strtod(*ppPos, &pEnd);
+    if (pEnd == *ppPos) return XFALSE;
+
+    /* Skip the percentage that follows the time */
+    while (*pEnd == ' ') pEnd++;
+    if (*pEnd == '(')
+    {
+        char *pClose = strchr(pEnd, ')');
+        if (pClose != NULL) pEnd = pClose + 1;
+    }
+
+    *pTime = (uint64_t)(fValue * 1000000.0 + 0.5);
+    *ppPos = pEnd;
+    return XTRUE;
+}
+
+static xbool_t SMake_ReportGcc(smake_report_t *pReport, smake_report_entry_t *pUnit, const char *pPath)
+{
+    size_t nSize = 0;
+    char *pBuffer = (char*)XPath_Load(pPath, &nSize);
+    XASSERT(pBuffer, XFALSE);
+
+    char *pSave = NULL;
+    char *pLine = strtok_r(pBuffer, "\n", &pSave);
+    xbool_t bStarted = XFALSE;
+
+    /* Diagnostics come first, report lines look like "name : usr (%) sys (%) wall (%) ggc" */
+    for (; pLine != NULL; pLine = strtok_r(NULL, "\n", &pSave))
+    {
+        if (!bStarted)
+        {
+            bStarted = !strncmp(pLine, "Time variable", 13) || !strncmp(pLine, "Execution times", 15);
+            continue;
+        }
+
+        char *pColon = strstr(pLine, ": ");
+        if (pColon == NULL) continue;
+
+        char *pPos = pColon + 1;
+        uint64_t nUser = 0, nSys = 0, nWall = 0;
+
+        if (!SMake_ReportNumber(&pPos, &nUser) ||
+            !SMake_ReportNumber(&pPos, &nSys) ||
+            !SMake_ReportNumber(&pPos, &nWall)) continue;
+
+        char *pName = pLine;
+        while (*pName == ' ') pName++;
+        while (pColon > pName && pColon[-1] == ' ') pColon--;
+        *pColon = XSTR_NUL;
+
+        if (!strcmp(pName, "TOTAL")) pUnit->nTime = nWall;
+        else if (!nWall) continue;
+        else if (!strcmp(pName, "phase parsing")) pUnit->nFrontend = nWall;
+        else if (!strcmp(pName, "phase opt and generate")) pUnit->nBackend = nWall;
+
+        if (strcmp(pName, "TOTAL")) SMake_TableAdd(pReport, &pReport->activities, pName, nWall);
+    }
+
+    free(pBuffer);
+    return bStarted;
+}
+
+static xbool_t SMake_ReportProfile(smake_ctx_t *pCtx, const char *pName)
+{
+    size_t i, nProfiles = XArray_Used(&pCtx->profiles);
+    for (i = 0; i < nProfiles; i++)
+    {
+        smake_profile_t *pProfile = (smake_profile_t*)XArray_GetData(&pCtx->profiles, i);
+        if (pProfile != NULL && !strcmp(pProfile->sName, pName)) return XTRUE;
+    }
+
+    return XFALSE;
+}
+
+static xbool_t SMake_ReportDir(smake_ctx_t *pCtx, smake_report_t *pReport)
+{
+    /* Output directory is relative to the Makefile */
+    if (pCtx->bVPath || pCtx->sOutDir[0] == '/') xstrncpy(pReport->sOutDir, sizeof(pReport->sOutDir), pCtx->sOutDir);
+    else xstrncpyf(pReport->sOutDir, sizeof(pReport->sOutDir), "%s/%s", pCtx->sPath, pCtx->sOutDir);
+    if (!xstrused(pCtx->sReportDir)) return XTRUE;
+
+    if (pCtx->nBackend == SMAKE_BACKEND_NINJA)
+    {
+        xloge("Build profiles and PGO phases are not supported by ninja backend");
+        return XFALSE;
+    }
+
+    char sPhases[SMAKE_PATH_MAX];
+    xstrncpy(sPhases, sizeof(sPhases), pCtx->sReportDir);
+
+    char *pSave = NULL;
+    char *pPhase = strtok_r(sPhases, "/", &pSave);
+    xbool_t bProfile = XFALSE, bPgo = XFALSE;
+
+    /* Same directories as the generated Makefile: <profile>, pgo-gen, pgo-use or <profile>/pgo-use */
+    for (; pPhase != NULL; pPhase = strtok_r(NULL, "/", &pSave))
+    {
+        if (!bPgo && (!strcmp(pPhase, "pgo-gen") || !strcmp(pPhase, "pgo-use")))
+        {
+            if (!xstrused(pCtx->sPgoTrain))
+            {
+                xloge("PGO is not configured for the report: %s", pPhase);
+                return XFALSE;
+            }
+
+            bPgo = XTRUE;
+        }
+        else if (!bProfile && !bPgo && SMake_ReportProfile(pCtx, pPhase)) bProfile = XTRUE;
+        else
+        {
+            xloge("Unknown profile or PGO phase of the report: %s", pCtx->sReportDir);
+            return XFALSE;
+        }
+
+        size_t nLength = strlen(pReport->sOutDir);
+        xstrncpyf(pReport->sOutDir + nLength, sizeof(pReport->sOutDir) - nLength, "/%s", pPhase);
+    }
+
+    return XTRUE;
+}
+
+static void SMake_ReportPath(smake_report_t *pReport, const SMakeFile *pObj, const char *pExt, char *pOutput, size_t nSize)
+{
+    xstrncpyf(pOutput, nSize, "%s/%.*s%s", pReport->sOutDir, (int)pObj->nLength, pObj->pName, pExt);
+}
+
+static void SMake_ReportObject(smake_report_t *pReport, const SMakeFile *pObj)
+{
+    char sSource[SMAKE_PATH_MAX];
+    char sPath[SMAKE_PATH_MAX];
+
+    xstrncpyf(sSource, sizeof(sSource), "%s/%s", pObj->pSource->pDir->pPath, pObj->pSource->pName);
+    smake_report_entry_t *pUnit = SMake_TableAdd(pReport, &pReport->units, sSource, 0);
+    XASSERT_VOID_RET(pUnit);
+
+    xbool_t bFound = XFALSE;
+    SMake_ReportPath(pReport, pObj, ".json", sPath, sizeof(sPath));
+
+    if (XPath_Exists(sPath)) bFound = SMake_ReportClang(pReport, pUnit, sPath);
+    else
+    {
+        SMake_ReportPath(pReport, pObj, ".o" SMAKE_REPORT_EXT, sPath, sizeof(sPath));
+        if (XPath_Exists(sPath)) bFound = SMake_ReportGcc(pReport, pUnit, sPath);
+    }
+
+    if (!bFound)
+    {
+        xlogd("No time trace for object: %.*s.o (%s)", (int)pObj->nLength, pObj->pName, sSource);
+        pReport->nMissing++;
+        return;
+    }
+
+    pReport->nTotal += pUnit->nTime;
+}
+
+static void SMake_PrintTable(smake_report_table_t *pTable, const char *pTitle, const char *pColumn, xbool_t bUnits)
+{
+    size_t i, nUsed = XArray_Used(&pTable->entries);
+    if (!nUsed) return;
+
+    printf("\n%s:\n", pTitle);
+    if (bUnits) printf("%12s %12s %12s  %s\n", "Total", "Frontend", "Backend", pColumn);
+    else printf("%12s %8s  %s\n", "Total", "Count", pColumn);
+
+    for (i = 0; i < nUsed && i < SMAKE_REPORT_TOP; i++)
+    {
+        const smake_report_entry_t *pEntry = (smake_report_entry_t*)XArray_GetData(&pTable->entries, i);
+        if (pEntry == NULL || !pEntry->nTime) break;
+
+        if (bUnits)
+        {
+            printf("%9.1f ms %9.1f ms %9.1f ms  ", pEntry->nTime / 1000.0,
+                pEntry->nFrontend / 1000.0, pEntry->nBackend / 1000.0);
+        }
+        else printf("%9.1f ms %8zu  ", pEntry->nTime / 1000.0, pEntry->nCount);
+
+        /* Template names can be very long, full names are in the JSON report */
+        int nLength = (int)strlen(pEntry->pName);
+        if (nLength <= SMAKE_REPORT_WIDTH) printf("%s\n", pEntry->pName);
+        else printf("%.*s...\n", SMAKE_REPORT_WIDTH - 3, pEntry->pName);
+    }
+}
+
+static xjson_obj_t* SMake_TableToJSON(smake_report_table_t *pTable, const char *pName, const char *pKey, xbool_t bUnits)
+{
+    xjson_obj_t *pArrObj = XJSON_NewArray(NULL, pName, XFALSE);
+    XASSERT(pArrObj, NULL);
+
+    size_t i, nUsed = XArray_Used(&pTable->entries);
+    for (i = 0; i < nUsed; i++)
+    {
+        const smake_report_entry_t *pEntry = (smake_report_entry_t*)XArray_GetData(&pTable->entries, i);
+        if (pEntry == NULL || !pEntry->nTime) continue;
+
+        xjson_obj_t *pEntryObj = XJSON_NewObject(NULL, NULL, XFALSE);
+        if (pEntryObj == NULL)
+        {
+            XJSON_FreeObject(pArrObj);
+            return NULL;
+        }
+
+        XJSON_AddObject(pEntryObj, XJSON_NewString(NULL, pKey, pEntry->pName));
+        XJSON_AddObject(pEntryObj, XJSON_NewU64(NULL, "total", pEntry->nTime));
+
+        if (bUnits)
+        {
+            XJSON_AddObject(pEntryObj, XJSON_NewU64(NULL, "frontend", pEntry->nFrontend));
+            XJSON_AddObject(pEntryObj, XJSON_NewU64(NULL, "backend", pEntry->nBackend));
+        }
+        else XJSON_AddObject(pEntryObj, XJSON_NewU64(NULL, "count", (uint64_t)pEntry->nCount));
+
+        XJSON_AddObject(pArrObj, pEntryObj);
+    }
+
+    return pArrObj;
+}
+
+static xbool_t SMake_ReportToJSON(smake_report_t *pReport, size_t nTraces)
+{
+    char sPath[SMAKE_PATH_MAX];
+    xstrncpyf(sPath, sizeof(sPath), "%s/%s", pReport->sOutDir, SMAKE_REPORT_FILE);
+
+    xjson_obj_t *pRootObj = XJSON_NewObject(NULL, NULL, XFALSE);
+    if (pRootObj == NULL)
+    {
+        xloge("Failed to allocate memory for JSON object: %s", XSTRERR);
+        return XFALSE;
+    }
+
+    XJSON_AddObject(pRootObj, XJSON_NewU64(NULL, "units", (uint64_t)nTraces));
+    XJSON_AddObject(pRootObj, XJSON_NewU64(NULL, "total", pReport->nTotal));
+    XJSON_AddObject(pRootObj, SMake_TableToJSON(&pReport->units, "translationUnits", "source", XTRUE));
+    XJSON_AddObject(pRootObj, SMake_TableToJSON(&pReport->headers, "headers", "path", XFALSE));
+    XJSON_AddObject(pRootObj, SMake_TableToJSON(&pReport->templates, "templates", "name", XFALSE));
+    XJSON_AddObject(pRootObj, SMake_TableToJSON(&pReport->activities, "activities", "name", XFALSE));
+
+    /* Writer allocates the output, entries are indented by 4 spaces */
+    xjson_writer_t linter;
+    XJSON_InitWriter(&linter, NULL, NULL, 1);
+    linter.nTabSize = 4;
+    xbool_t bStatus = XTRUE;
+
+    if (!XJSON_WriteObject(pRootObj, &linter))
+    {
+        xloge("Failed to serialize build report: %s", sPath);
+        bStatus = XFALSE;
+    }
+    else
+    {
+        if (XPath_Write(sPath, (const uint8_t*)linter.pData, linter.nLength, "cwt") <= 0)
+        {
+            xloge("Failed to write data: %s (%s)", sPath, XSTRERR);
+            bStatus = XFALSE;
+        }
+
+        XJSON_DestroyWriter(&linter);
+    }
+
+    if (bStatus) xlogn("Build report saved: %s", sPath);
+    XJSON_FreeObject(pRootObj);
+    return bStatus;
+}
+
+xbool_t SMake_WriteReport(smake_ctx_t *pCtx)
+{
+    smake_report_t report;
+    if (!SMake_ReportDir(pCtx, &report)) return XFALSE;
+
+    SMake_ArenaInit(&report.arena);
+    SMake_TableInit(&report.units);
+    SMake_TableInit(&report.headers);
+    SMake_TableInit(&report.templates);
+    SMake_TableInit(&report.activities);
+    report.nMissing = 0;
+    report.nTotal = 0;
+
+    XArray_Sort(&pCtx->objArr, SMake_CompareName, NULL);
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+    const SMakeFile *pPrev = NULL;
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL || pObj->pSource == NULL) continue;
+
+        /* Objects with the same name share the output file */
+        if (pPrev != NULL && pPrev->nLength == pObj->nLength &&
+            !strncmp(pPrev->pName, pObj->pName, pObj->nLength)) continue;
+
+        SMake_ReportObject(&report, pObj);
+        pPrev = pObj;
+    }
+
+    size_t nUnits = XArray_Used(&report.units.entries);
+    size_t nTraces = nUnits - report.nMissing;
+    xbool_t bStatus = XFALSE;
+
+    if (!nTraces) xloge("No time traces found in: %s (build with -R first)", report.sOutDir);
+    else
+    {
+        if (report.nMissing) xlogw("Missing time traces of %zu from %zu objects", report.nMissing, nUnits);
+
+        XArray_Sort(&report.units.entries, SMake_TableCompare, NULL);
+        XArray_Sort(&report.headers.entries, SMake_TableCompare, NULL);
+        XArray_Sort(&report.templates.entries, SMake_TableCompare, NULL);
+        XArray_Sort(&report.activities.entries, SMake_TableCompare, NULL);
+
+        printf("Build report: %zu translation units, %.1f s of compile time\n", nTraces, report.nTotal / 1000000.0);
+        SMake_PrintTable(&report.units, "Slowest translation units", "Source", XTRUE);
+        SMake_PrintTable(&report.headers, "Most expensive headers (inclusive parse time)", "Header", XFALSE);
+        SMake_PrintTable(&report.templates, "Most expensive template instantiations", "Template", XFALSE);
+        SMake_PrintTable(&report.activities, "Time by compiler activity", "Activity", XFALSE);
+        printf("\n");
+        fflush(stdout);
+
+        if (!XArray_Used(&report.headers.entries) && !XArray_Used(&report.templates.entries))
+            xlogi("Header and template times are only available in clang traces");
+
+        bStatus = SMake_ReportToJSON(&report, nTraces);
+    }
+
+    SMake_TableDestroy(&report.units);
+    SMake_TableDestroy(&report.headers);
+    SMake_TableDestroy(&report.templates);
+    SMake_TableDestroy(&report.activities);
+    SMake_ArenaDestroy(&report.arena);
+    return bStatus;
+}
@@ -0,0 +1,35 @@
+/*!
+ *  @file smake/src/report.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Aggregate compiler time traces into a build report.
+ */
+
+#ifndef __SMAKE_REPORT_H__
+#define __SMAKE_REPORT_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+/* Written to the output directory next to the traces */
+#define SMAKE_REPORT_FILE "smake-report.json"
+
+/* GCC time report of an object is saved as <object>.ftr */
+#define SMAKE_REPORT_EXT ".ftr"
+
+/* Keeps compiler diagnostics and drops the time report that follows them */
+#define SMAKE_REPORT_FILTER "sed -e '/^$$/N' -e '/^\\n*Time variable/,$$d' -e '/^\\n*Execution times/,$$d'"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_WriteReport(smake_ctx_t *pCtx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_REPORT_H__ */
@@ -0,0 +1,502 @@
+/*!
+ *  @file smake/src/scan.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Scan project directories with a pool of worker threads.
+ */
+
+#include <limits.h>
+#include "stdinc.h"
+#include "scan.h"
+#include "cfg.h"
+#include "cache.h"
+#include "unity.h"
+#include "pch.h"
+
+#define SMAKE_SCAN_QUEUE    64
+
+typedef struct SMakeScanDir {
+    xarray_t entries;
+    struct stat stat;
+    xbool_t bStat;          /* stat is valid and listing can be cached */
+    xbool_t bOutput;        /* Output directory or one of its subdirectories */
+    char *pPath;
+} smake_scan_dir_t;
+
+typedef struct SMakeScanEntry {
+    smake_scan_dir_t *pDir;
+    xbool_t bExcluded;      /* Kept for the cache, skipped in the project */
+    char *pName;
+    int nType;
+} smake_scan_entry_t;
+
+typedef struct SMakeScanQueue {
+    smake_scan_dir_t **pDirs;
+    xsync_mutex_t lock;
+    size_t nHead;
+    size_t nTail;
+    size_t nSize;
+} smake_scan_queue_t;
+
+typedef struct SMakeScanner smake_scanner_t;
+
+typedef struct SMakeScanWorker {
+    smake_scanner_t *pScanner;
+    smake_scan_queue_t queue;
+    xthread_t thread;
+    size_t nIndex;
+} smake_scan_worker_t;
+
+struct SMakeScanner {
+    smake_scan_worker_t *pWorkers;
+    smake_ctx_t *pCtx;
+    xsync_cond_t idleCond;      /* Signaled when a directory is queued or the scan is done */
+    xatomic_t nPending;
+    xatomic_t nQueued;
+    size_t nWorkers;
+    struct stat outStat;
+    xbool_t bOutStat;       /* Output directory exists, its generated files are skipped */
+};
+
+static void SMake_ScanClearEntry(xarray_data_t *pArrData);
+static xbool_t SMake_ScanDirectory(smake_scan_worker_t *pWorker, smake_scan_dir_t *pDir);
+
+static smake_scan_dir_t* SMake_ScanDirNew(const char *pPath)
+{
+    smake_scan_dir_t *pDir = (smake_scan_dir_t*)malloc(sizeof(smake_scan_dir_t));
+    if (pDir == NULL)
+    {
+        xloge("Failed to allocate memory for directory: %s", pPath);
+        return NULL;
+    }
+
+    pDir->pPath = strdup(pPath);
+    if (pDir->pPath == NULL)
+    {
+        xloge("Failed to allocate memory for directory: %s", pPath);
+        free(pDir);
+        return NULL;
+    }
+
+    XArray_Init(&pDir->entries, NULL, XSTDNON, XFALSE);
+    pDir->entries.clearCb = SMake_ScanClearEntry;
+    pDir->bOutput = XFALSE;
+    pDir->bStat = XFALSE;
+    return pDir;
+}
+
+static void SMake_ScanDirFree(smake_scan_dir_t *pDir)
+{
+    XASSERT_VOID_RET(pDir);
+    XArray_Destroy(&pDir->entries);
+    free(pDir->pPath);
+    free(pDir);
+}
+
+static void SMake_ScanClearEntry(xarray_data_t *pArrData)
+{
+    XASSERT_VOID_RET(pArrData);
+    smake_scan_entry_t *pEntry = (smake_scan_entry_t*)pArrData->pData;
+    XASSERT_VOID_RET(pEntry);
+
+    SMake_ScanDirFree(pEntry->pDir);
+    free(pEntry->pName);
+    free(pEntry);
+
+    pArrData->pData = NULL;
+    pArrData->nSize = 0;
+}
+
+static smake_scan_entry_t* SMake_ScanAddEntry(smake_scan_dir_t *pDir, const char *pName, int nType)
+{
+    smake_scan_entry_t *pEntry = (smake_scan_entry_t*)malloc(sizeof(smake_scan_entry_t));
+    if (pEntry == NULL) return NULL;
+
+    pEntry->pName = strdup(pName);
+    pEntry->bExcluded = XFALSE;
+    pEntry->nType = nType;
+    pEntry->pDir = NULL;
+
+    if (pEntry->pName == NULL)
+    {
+        free(pEntry);
+        return NULL;
+    }
+
+    if (XArray_AddData(&pDir->entries, pEntry, XSTDNON) < 0)
+    {
+        free(pEntry->pName);
+        free(pEntry);
+        return NULL;
+    }
+
+    return pEntry;
+}
+
+static void SMake_QueueInit(smake_scan_queue_t *pQueue)
+{
+    pQueue->pDirs = NULL;
+    pQueue->nHead = 0;
+    pQueue->nTail = 0;
+    pQueue->nSize = 0;
+    XSync_Init(&pQueue->lock);
+}
+
+static void SMake_QueueDestroy(smake_scan_queue_t *pQueue)
+{
+    XSync_Destroy(&pQueue->lock);
+    free(pQueue->pDirs);
+    pQueue->pDirs = NULL;
+}
+
+static xbool_t SMake_QueuePush(smake_scan_queue_t *pQueue, smake_scan_dir_t *pDir)
+{
+    XSync_Lock(&pQueue->lock);
+
+    if (pQueue->nTail >= pQueue->nSize)
+    {
+        size_t nUsed = pQueue->nTail - pQueue->nHead;
+        if (pQueue->nHead > 0 && nUsed < pQueue->nSize / 2)
+        {
+            /* Reuse the slots that were already stolen from the front */
+            memmove(pQueue->pDirs, &pQueue->pDirs[pQueue->nHead], nUsed * sizeof(smake_scan_dir_t*));
+            pQueue->nTail = nUsed;
+            pQueue->nHead = 0;
+        }
+        else
+        {
+            size_t nSize = pQueue->nSize ? pQueue->nSize * 2 : SMAKE_SCAN_QUEUE;
+            smake_scan_dir_t **pDirs = realloc(pQueue->pDirs, nSize * sizeof(smake_scan_dir_t*));
+
+            if (pDirs == NULL)
+            {
+                XSync_Unlock(&pQueue->lock);
+                return XFALSE;
+            }
+
+            pQueue->pDirs = pDirs;
+            pQueue->nSize = nSize;
+        }
+    }
+
+    pQueue->pDirs[pQueue->nTail++] = pDir;
+    XSync_Unlock(&pQueue->lock);
+    return XTRUE;
+}
+
+static smake_scan_dir_t* SMake_QueuePop(smake_scan_queue_t *pQueue, xbool_t bSteal)
+{
+    smake_scan_dir_t *pDir = NULL;
+    XSync_Lock(&pQueue->lock);
+
+    if (pQueue->nHead < pQueue->nTail)
+    {
+        /* Owner works depth-first from the back, thieves take the oldest (widest) work */
+        if (bSteal) pDir = pQueue->pDirs[pQueue->nHead++];
+        else pDir = pQueue->pDirs[--pQueue->nTail];
+        if (pQueue->nHead == pQueue->nTail) pQueue->nHead = pQueue->nTail = 0;
+    }
+
+    XSync_Unlock(&pQueue->lock);
+    return pDir;
+}
+
+static void SMake_ScanNotify(smake_scanner_t *pScanner, xbool_t bDone)
+{
+    XSync_LockCond(&pScanner->idleCond);
+    if (bDone) XSync_BroadcastCond(&pScanner->idleCond);
+    else XSync_SignalCond(&pScanner->idleCond);
+    XSync_UnlockCond(&pScanner->idleCond);
+}
+
+static void SMake_ScanWait(smake_scanner_t *pScanner)
+{
+    /* Counters are checked under the lock, notify can not slip in before the wait */
+    XSync_LockCond(&pScanner->idleCond);
+    while (!XSYNC_ATOMIC_GET(&pScanner->nQueued) && XSYNC_ATOMIC_GET(&pScanner->nPending) > 0)
+        XSync_WaitCond(&pScanner->idleCond, 0);
+    XSync_UnlockCond(&pScanner->idleCond);
+}
+
+static xbool_t SMake_ScanGenerated(smake_scan_dir_t *pDir, const char *pName, int nType)
+{
+    /* Same names outside of the output directory are project files */
+    if (!pDir->bOutput) return XFALSE;
+    return ((nType == SMAKE_FILE_UNF && !strcmp(pName, SMAKE_UNITY_DIR)) ||
+            (nType == SMAKE_FILE_H && !strcmp(pName, SMAKE_PCH_FILE))) ? XTRUE : XFALSE;
+}
+
+static void SMake_ScanEntry(smake_scan_worker_t *pWorker, smake_scan_dir_t *pDir, const char *pFullPath, const char *pName, int nType)
+{
+    smake_scanner_t *pScanner = pWorker->pScanner;
+    smake_scan_entry_t *pEntry = SMake_ScanAddEntry(pDir, pName, nType);
+
+    if (pEntry == NULL)
+    {
+        xloge("Failed to allocate memory for entry: %s", pFullPath);
+        return;
+    }
+
+    /* Generated files in the output directory are not part of the project */
+    if (SMake_ScanGenerated(pDir, pName, nType) ||
+        SMake_IsExcluded(pScanner->pCtx, pFullPath))
+    {
+        xlogi("Path is excluded: %s", pFullPath);
+        pEntry->bExcluded = XTRUE;
+        return;
+    }
+
+    if (nType != SMAKE_FILE_UNF) return;
+    pEntry->pDir = SMake_ScanDirNew(pFullPath);
+    if (pEntry->pDir == NULL) return;
+    pEntry->pDir->bOutput = pDir->bOutput;
+
+    XSYNC_ATOMIC_ADD(&pScanner->nPending, 1);
+    XSYNC_ATOMIC_ADD(&pScanner->nQueued, 1);
+
+    if (SMake_QueuePush(&pWorker->queue, pEntry->pDir))
+    {
+        SMake_ScanNotify(pScanner, XFALSE);
+        return;
+    }
+
+    /* Queue is out of memory, walk this subtree in place */
+    XSYNC_ATOMIC_SUB(&pScanner->nQueued, 1);
+    SMake_ScanDirectory(pWorker, pEntry->pDir);
+    XSYNC_ATOMIC_SUB(&pScanner->nPending, 1);
+}
+
+static xbool_t SMake_ScanCached(smake_scan_worker_t *pWorker, smake_scan_dir_t *pDir, char *pFullPath, size_t nFullSize)
+{
+    smake_ctx_t *pCtx = pWorker->pScanner->pCtx;
+    XASSERT((pCtx->bUseCache && pDir->bStat), XFALSE);
+
+    const smake_cache_dir_t *pCached = SMake_CacheGetDir(&pCtx->prevCache, pDir->pPath, &pDir->stat);
+    XASSERT(pCached, XFALSE);
+
+    /* Directory did not change since the last run, its listing is still valid */
+    xlogd("Using cached directory listing: %s", pDir->pPath);
+    const smake_cache_entry_t *pCachedEntry = pCached->pEntries;
+
+    while (pCachedEntry != NULL)
+    {
+        int nBytes = xstrncpyf(pFullPath, nFullSize, "%s/%s", pDir->pPath, pCachedEntry->pName);
+        if (nBytes > 0) SMake_ScanEntry(pWorker, pDir, pFullPath, pCachedEntry->pName, pCachedEntry->nType);
+        pCachedEntry = pCachedEntry->pNext;
+    }
+
+    return XTRUE;
+}
+
+static xbool_t SMake_ScanDirectory(smake_scan_worker_t *pWorker, smake_scan_dir_t *pDir)
+{
+    /* Taken before reading, a change during the scan invalidates the cached listing */
+    pDir->bStat = stat(pDir->pPath, &pDir->stat) < 0 ? XFALSE : XTRUE;
+    smake_scanner_t *pScanner = pWorker->pScanner;
+
+    /* Profile and PGO copies of the generated files are in the subdirectories */
+    if (pDir->bStat && pScanner->bOutStat &&
+        pDir->stat.st_dev == pScanner->outStat.st_dev &&
+        pDir->stat.st_ino == pScanner->outStat.st_ino) pDir->bOutput = XTRUE;
+
+    /* Room for any entry name the file system can return */
+    size_t nPathLength = strlen(pDir->pPath);
+    size_t nFullSize = nPathLength + NAME_MAX + 2;
+    char *pFullPath = (char*)malloc(nFullSize);
+
+    if (pFullPath == NULL)
+    {
+        xloge("Failed to allocate memory for path: %s", pDir->pPath);
+        return XFALSE;
+    }
+
+    if (SMake_ScanCached(pWorker, pDir, pFullPath, nFullSize))
+    {
+        free(pFullPath);
+        return XTRUE;
+    }
+
+    xdir_t dir;
+    if (XDir_Open(&dir, pDir->pPath) < 0)
+    {
+        xloge("Failed to open directory: %s (%s)", pDir->pPath, XSTRERR);
+        pDir->bStat = XFALSE;
+        free(pFullPath);
+        return XFALSE;
+    }
+
+    char sFileName[NAME_MAX + 1];
+    while(XDir_Read(&dir, sFileName, sizeof(sFileName)) > 0)
+    {
+        int nBytes = xstrncpyf(pFullPath, nFullSize, "%s/%s", pDir->pPath, sFileName);
+        if (nBytes <= 0) continue;
+
+        int nType = SMake_GetFileType(pFullPath, nBytes);
+        xbool_t bIsDir = (int)(dir.pEntry->d_type) == 4 ? XTRUE : XFALSE;
+        if (!bIsDir && nType == SMAKE_FILE_UNF) continue;
+
+        SMake_ScanEntry(pWorker, pDir, pFullPath, sFileName, bIsDir ? SMAKE_FILE_UNF : nType);
+    }
+
+    XDir_Close(&dir);
+    free(pFullPath);
+    return XTRUE;
+}
+
+static smake_scan_dir_t* SMake_ScanSteal(smake_scan_worker_t *pWorker)
+{
+    smake_scanner_t *pScanner = pWorker->pScanner;
+    size_t i;
+
+    for (i = 1; i < pScanner->nWorkers; i++)
+    {
+        size_t nVictim = (pWorker->nIndex + i) % pScanner->nWorkers;
+        smake_scan_worker_t *pVictim = &pScanner->pWorkers[nVictim];
+
+        smake_scan_dir_t *pDir = SMake_QueuePop(&pVictim->queue, XTRUE);
+        if (pDir != NULL) return pDir;
+    }
+
+    return NULL;
+}
+
+static void* SMake_ScanWorker(void *pArg)
+{
+    smake_scan_worker_t *pWorker = (smake_scan_worker_t*)pArg;
+    smake_scanner_t *pScanner = pWorker->pScanner;
+
+    while (XSYNC_ATOMIC_GET(&pScanner->nPending) > 0)
+    {
+        smake_scan_dir_t *pDir = SMake_QueuePop(&pWorker->queue, XFALSE);
+        if (pDir == NULL) pDir = SMake_ScanSteal(pWorker);
+
+        if (pDir == NULL)
+        {
+            SMake_ScanWait(pScanner);
+            continue;
+        }
+
+        XSYNC_ATOMIC_SUB(&pScanner->nQueued, 1);
+        SMake_ScanDirectory(pWorker, pDir);
+
+        /* Last directory is done, wake the idle workers to exit */
+        if (!XSYNC_ATOMIC_SUB(&pScanner->nPending, 1)) SMake_ScanNotify(pScanner, XTRUE);
+    }
+
+    return NULL;
+}
+
+static xbool_t SMake_ScanCollect(smake_ctx_t *pCtx, smake_scan_dir_t *pDir)
+{
+    size_t i, nUsed = XArray_Used(&pDir->entries);
+    smake_cache_dir_t *pCacheDir = NULL;
+    const SMakeDir *pFileDir = NULL;
+
+    if (pCtx->bUseCache && pDir->bStat)
+        pCacheDir = SMake_CacheAddDir(&pCtx->nextCache, pDir->pPath, &pDir->stat);
+    if (pCtx->bWatch) SMake_AddToList(&pCtx->watchDirs, "%s", pDir->pPath);
+
+    for (i = 0; i < nUsed; i++)
+    {
+        smake_scan_entry_t *pEntry = (smake_scan_entry_t*)XArray_GetData(&pDir->entries, i);
+        if (pEntry == NULL) continue;
+
+        /* Cache keeps the raw listing so excludes can change between runs */
+        if (pCacheDir != NULL) SMake_CacheAddEntry(&pCtx->nextCache, pCacheDir, pEntry->pName, pEntry->nType);
+        if (pEntry->bExcluded) continue;
+
+        if (pEntry->pDir != NULL)
+        {
+            if (!SMake_ScanCollect(pCtx, pEntry->pDir)) return XFALSE;
+            continue;
+        }
+
+        if (pEntry->nType == SMAKE_FILE_UNF) continue;
+        if (pFileDir == NULL) pFileDir = SMake_DirIntern(pCtx, pDir->pPath);
+
+        SMakeFile *pFile = SMake_FileNew(pCtx, pFileDir, pEntry->pName, pEntry->nType);
+        if (pFile == NULL) return XFALSE;
+
+        xlogd("Found project file: %s/%s", pDir->pPath, pEntry->pName);
+        XArray_AddData(&pCtx->fileArr, pFile, XSTDNON);
+    }
+
+    return XTRUE;
+}
+
+static size_t SMake_ScanThreads(smake_ctx_t *pCtx)
+{
+    if (pCtx->nScanThreads) return pCtx->nScanThreads;
+    long nCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    return nCPUs > 0 ? (size_t)nCPUs : 1;
+}
+
+xbool_t SMake_ScanFiles(smake_ctx_t *pCtx, const char *pPath)
+{
+    smake_scan_dir_t *pRoot = SMake_ScanDirNew(pPath);
+    XASSERT(pRoot, XFALSE);
+
+    smake_scanner_t scanner;
+    scanner.nWorkers = SMake_ScanThreads(pCtx);
+    scanner.bOutStat = stat(pCtx->sOutDir, &scanner.outStat) < 0 ? XFALSE : XTRUE;
+    scanner.nPending = 0;
+    scanner.nQueued = 0;
+    scanner.pCtx = pCtx;
+
+    scanner.pWorkers = (smake_scan_worker_t*)calloc(scanner.nWorkers, sizeof(smake_scan_worker_t));
+    if (scanner.pWorkers == NULL)
+    {
+        xloge("Failed to allocate memory for scan workers: %s", XSTRERR);
+        SMake_ScanDirFree(pRoot);
+        return XFALSE;
+    }
+
+    XSync_InitCond(&scanner.idleCond);
+
+    size_t i, nStarted = 0;
+    for (i = 0; i < scanner.nWorkers; i++)
+    {
+        scanner.pWorkers[i].pScanner = &scanner;
+        scanner.pWorkers[i].nIndex = i;
+        SMake_QueueInit(&scanner.pWorkers[i].queue);
+    }
+
+    /* Root directory is read on the calling thread so a missing
+     * project directory fails the same way as without workers */
+    xlogd("Scanning project with %zu thread(s): %s", scanner.nWorkers, pPath);
+    if (!SMake_ScanDirectory(&scanner.pWorkers[0], pRoot))
+    {
+        for (i = 0; i < scanner.nWorkers; i++) SMake_QueueDestroy(&scanner.pWorkers[i].queue);
+        XSync_DestroyCond(&scanner.idleCond);
+        free(scanner.pWorkers);
+        SMake_ScanDirFree(pRoot);
+        return XFALSE;
+    }
+
+    for (i = 1; i < scanner.nWorkers; i++)
+    {
+        smake_scan_worker_t *pWorker = &scanner.pWorkers[i];
+        if (XThread_Create(&pWorker->thread, SMake_ScanWorker, pWorker, XFALSE) < 0)
+        {
+            xlogw("Failed to start scan worker: %s", XSTRERR);
+            break;
+        }
+
+        nStarted++;
+    }
+
+    /* Calling thread is the first worker */
+    SMake_ScanWorker(&scanner.pWorkers[0]);
+    for (i = 1; i <= nStarted; i++) XThread_Join(&scanner.pWorkers[i].thread);
+    for (i = 0; i < scanner.nWorkers; i++) SMake_QueueDestroy(&scanner.pWorkers[i].queue);
+    XSync_DestroyCond(&scanner.idleCond);
+
+    /* Depth-first walk in readdir order gives the same file order as a sequential scan */
+    xbool_t bStatus = SMake_ScanCollect(pCtx, pRoot);
+
+    free(scanner.pWorkers);
+    SMake_ScanDirFree(pRoot);
+    return bStatus;
+}
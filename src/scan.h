@@ -0,0 +1,26 @@
+/*!
+ *  @file smake/src/scan.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Scan project directories with a pool of worker threads.
+ */
+
+#ifndef __SMAKE_SCAN_H__
+#define __SMAKE_SCAN_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_ScanFiles(smake_ctx_t *pCtx, const char *pPath);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_SCAN_H__ */
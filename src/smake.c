@@ -11,6 +11,9 @@
 #include "make.h"
 #include "info.h"
 #include "cfg.h"
+#include "compdb.h"
+#include "report.h"
+#include "watch.h"
 
 int main(int argc, char *argv[])
 {
@@ -30,15 +33,32 @@ int main(int argc, char *argv[])
     if (!SMake_ParseConfig(&smake) ||
         !SMake_InitProject(&smake) ||
         !SMake_LoadFiles(&smake, NULL) ||
-        !SMake_ParseProject(&smake) ||
-        !SMake_WriteMake(&smake) ||
+        !SMake_ParseProject(&smake))
+    {
+        SMake_ClearContext(&smake);
+        return XSTDERR;
+    }
+
+    /* Report is made from the traces of the last build, nothing is generated */
+    if (smake.bReport)
+    {
+        int nStatus = SMake_WriteReport(&smake) ? XSTDNON : XSTDERR;
+        SMake_ClearContext(&smake);
+        return nStatus;
+    }
+
+    if (!SMake_WriteBuild(&smake) ||
+        !SMake_WriteCompDB(&smake) ||
+        !SMake_WriteCache(&smake) ||
         !SMake_WriteConfig(&smake))
     {
         SMake_ClearContext(&smake);
         return XSTDERR;
     }
 
-    xlogn("Successfuly generated Makefile.");
+    xlogn("Successfuly generated %s.", smake.nBackend == SMAKE_BACKEND_NINJA ? "build.ninja" : "Makefile");
+    int nStatus = smake.bWatch && !SMake_Watch(&smake, argc, argv) ? XSTDERR : XSTDNON;
+
     SMake_ClearContext(&smake);
-    return XSTDNON;
+    return nStatus;
 }
@@ -17,6 +17,8 @@
 #include "xutils/src/data/str.h"
 #include "xutils/src/data/map.h"
 #include "xutils/src/sys/srch.h"
+#include "xutils/src/sys/sync.h"
+#include "xutils/src/sys/thread.h"
 #include "xutils/src/sys/log.h"
 #include "xutils/src/sys/cli.h"
 #include "xutils/src/sys/xfs.h"
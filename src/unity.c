@@ -0,0 +1,291 @@
+/*!
+ *  @file smake/src/unity.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Group project sources into unity (jumbo) translation units.
+ *
+ * Sources are ordered by language, directory and name and cut into
+ * batches of about the configured number of sources. A batch ends after
+ * a source whose path hash is divisible by that number, or when it grows
+ * to four times the size. The cut points depend only on the sources
+ * themselves, not on the size of the project, so adding or removing one
+ * source changes its own batch and at most the neighbour one. Unity files are named by the hash of their
+ * first source and rewritten only when their content changes, so batches
+ * that did not change are not recompiled. Sources are included by paths
+ * relative to the unity directory, batches do not depend on the checkout.
+ */
+
+#include "unity.h"
+
+typedef struct SMakeUnitySource {
+    SMakeFile *pObj;
+    char *pPath;
+    uint32_t nHash;
+} smake_unity_src_t;
+
+static uint32_t SMake_UnityHash(const char *pStr)
+{
+    /* FNV-1a, stable across runs and platforms */
+    uint32_t nHash = 2166136261u;
+
+    while (*pStr)
+    {
+        nHash ^= (uint8_t)*pStr++;
+        nHash *= 16777619u;
+    }
+
+    return nHash;
+}
+
+static int SMake_UnityCompare(const void *pData1, const void *pData2)
+{
+    const smake_unity_src_t *pFirst = (const smake_unity_src_t*)pData1;
+    const smake_unity_src_t *pSecond = (const smake_unity_src_t*)pData2;
+    const SMakeFile *pSrc1 = pFirst->pObj->pSource;
+    const SMakeFile *pSrc2 = pSecond->pObj->pSource;
+
+    if (pSrc1->nType != pSrc2->nType) return pSrc1->nType - pSrc2->nType;
+    int nRet = strcmp(pSrc1->pDir->pPath, pSrc2->pDir->pPath);
+    return nRet ? nRet : strcmp(pSrc1->pName, pSrc2->pName);
+}
+
+static xbool_t SMake_UnityExcluded(smake_ctx_t *pCtx, const char *pPath)
+{
+    size_t i, nRules = XArray_Used(&pCtx->unityExcludes.array);
+    for (i = pCtx->unityExclIdx.nRules; i < nRules; i++)
+    {
+        const char *pRule = (const char *)XArray_GetData(&pCtx->unityExcludes.array, i);
+        if (!SMake_ExclAdd(&pCtx->unityExclIdx, pRule) && xstrused(pRule))
+            xlogw("Failed to compile unity exclude rule: %s", pRule);
+    }
+
+    return SMake_ExclMatch(&pCtx->unityExclIdx, pPath);
+}
+
+static xbool_t SMake_UnityWrite(const SMakeDir *pDir, const char *pUnityPath, const char *pName,
+                                smake_unity_src_t *pSources, size_t nCount)
+{
+    xbyte_buffer_t buffer;
+    XByteBuffer_Init(&buffer, SMAKE_LINE_MAX, XFALSE);
+    XByteBuffer_AddFmt(&buffer, "/* Automatically generated by SMake, do not edit */\n");
+
+    char sSrcDir[XPATH_MAX];
+    xbool_t bStatus = XTRUE;
+    size_t i;
+
+    for (i = 0; i < nCount && bStatus; i++)
+    {
+        /* Directory is resolved, but not the source, it may be a link to another directory */
+        const SMakeFile *pSource = pSources[i].pObj->pSource;
+        if (realpath(pSource->pDir->pPath, sSrcDir) == NULL)
+        {
+            xloge("Failed to resolve directory: %s (%s)", pSource->pDir->pPath, XSTRERR);
+            bStatus = XFALSE;
+            break;
+        }
+
+        XByteBuffer_AddFmt(&buffer, "#include \"");
+        SMake_AddRelative(&buffer, pUnityPath, sSrcDir);
+        XByteBuffer_AddFmt(&buffer, "/%s\"\n", pSource->pName);
+    }
+
+    char *pPath = xstracpy("%s/%s", pDir->pPath, pName);
+    if (pPath == NULL || buffer.pData == NULL) bStatus = XFALSE;
+    if (bStatus) bStatus = SMake_UpdateFile(pPath, (const char*)buffer.pData, buffer.nUsed);
+
+    XByteBuffer_Clear(&buffer);
+    free(pPath);
+    return bStatus;
+}
+
+static SMakeFile* SMake_UnityBatch(smake_ctx_t *pCtx, const SMakeDir *pDir, const char *pUnityPath,
+                                   smake_unity_src_t *pSources, size_t nCount, smake_list_t *pNames)
+{
+    const SMakeFile *pFirst = pSources[0].pObj->pSource;
+    const char *pExt = pFirst->nType == SMAKE_FILE_CPP ? "cpp" : "c";
+
+    char sName[SMAKE_NAME_MAX];
+    xstrncpyf(sName, sizeof(sName), "unity_%08x.%s", pSources[0].nHash, pExt);
+    SMake_AddToList(pNames, "%s", sName);
+
+    /* Report only needs the names of the batch objects */
+    xbool_t bStatus = pCtx->bReport ? XTRUE : SMake_UnityWrite(pDir, pUnityPath, sName, pSources, nCount);
+    XASSERT(bStatus, NULL);
+
+    SMakeFile *pFile = SMake_FileNew(pCtx, pDir, sName, pFirst->nType);
+    XASSERT(pFile, NULL);
+
+    SMakeFile *pObj = SMake_ObjectNew(pCtx, pFile);
+    XASSERT(pObj, NULL);
+
+    /* One source that can not use the precompiled header excludes the batch */
+    size_t i;
+    for (i = 0; i < nCount && !pObj->bNoPch; i++)
+        pObj->bNoPch = pSources[i].pObj->bNoPch;
+
+    xlogi("Unity batch %s: %zu sources", sName, nCount);
+    return pObj;
+}
+
+/* Batches of the previous runs are not compiled anymore */
+static void SMake_UnityRemoveStale(const char *pUnityDir, smake_list_t *pNames)
+{
+    char sFileName[XPATH_MAX];
+    char sFullPath[XPATH_MAX];
+    xdir_t dir;
+
+    if (XDir_Open(&dir, pUnityDir) < 0) return;
+
+    while (XDir_Read(&dir, sFileName, sizeof(sFileName)) > 0)
+    {
+        if (strncmp(sFileName, "unity_", 6) || SMake_ListContains(pNames, sFileName)) continue;
+        xstrncpyf(sFullPath, sizeof(sFullPath), "%s/%s", pUnityDir, sFileName);
+
+        if (unlink(sFullPath) < 0) xlogw("Failed to remove stale unity batch: %s (%s)", sFullPath, XSTRERR);
+        else xlogd("Removed stale unity batch: %s", sFullPath);
+    }
+
+    XDir_Close(&dir);
+}
+
+/* Splits objects into unity candidates and objects that are compiled as is */
+static xbool_t SMake_UnityCollect(smake_ctx_t *pCtx, smake_unity_src_t *pSources,
+                                  size_t *pCount, SMakeFile **pObjects, size_t *pKept)
+{
+    size_t i, nObjs = XArray_Used(&pCtx->objArr);
+    *pCount = *pKept = 0;
+
+    for (i = 0; i < nObjs; i++)
+    {
+        SMakeFile *pObj = (SMakeFile*)XArray_GetData(&pCtx->objArr, i);
+        if (pObj == NULL) continue;
+
+        /* Entry points of different binaries can not share a translation unit */
+        if (pObj->pSource == NULL || (pObj->bMain && SMake_IsMulti(pCtx)))
+        {
+            pObjects[(*pKept)++] = pObj;
+            continue;
+        }
+
+        const SMakeFile *pSource = pObj->pSource;
+        char *pPath = xstracpy("%s/%s", pSource->pDir->pPath, pSource->pName);
+        XASSERT(pPath, XFALSE);
+
+        if (SMake_UnityExcluded(pCtx, pPath))
+        {
+            xlogi("Source is excluded from unity build: %s", pPath);
+            pObjects[(*pKept)++] = pObj;
+            free(pPath);
+            continue;
+        }
+
+        smake_unity_src_t *pSrc = &pSources[(*pCount)++];
+        pSrc->nHash = SMake_UnityHash(pPath);
+        pSrc->pPath = pPath;
+        pSrc->pObj = pObj;
+    }
+
+    return XTRUE;
+}
+
+static xbool_t SMake_UnityBoundary(smake_ctx_t *pCtx, const smake_unity_src_t *pCurr,
+                                   const smake_unity_src_t *pNext, size_t nMembers)
+{
+    if (pNext == NULL) return XTRUE;
+    const SMakeFile *pCurrSrc = pCurr->pObj->pSource;
+    const SMakeFile *pNextSrc = pNext->pObj->pSource;
+
+    /* C and C++ sources can not share a translation unit */
+    if (pCurrSrc->nType != pNextSrc->nType) return XTRUE;
+    if (pCtx->bUnityPerDir && pCurrSrc->pDir != pNextSrc->pDir) return XTRUE;
+
+    /* Hard bound for a long run of sources without a cut point */
+    if (nMembers >= (size_t)pCtx->nUnitySize * SMAKE_UNITY_MAX) return XTRUE;
+    return !(pCurr->nHash % pCtx->nUnitySize) ? XTRUE : XFALSE;
+}
+
+xbool_t SMake_UnityBuild(smake_ctx_t *pCtx)
+{
+    size_t nObjs = XArray_Used(&pCtx->objArr);
+    if (!pCtx->nUnitySize || nObjs < 2) return XTRUE;
+
+    char sUnityDir[SMAKE_PATH_MAX];
+    xstrncpyf(sUnityDir, sizeof(sUnityDir), "%s/%s", pCtx->sOutDir, SMAKE_UNITY_DIR);
+
+    if (!pCtx->bReport && !XPath_Exists(sUnityDir) && !XDir_Create(sUnityDir, 0775))
+    {
+        xloge("Failed to create directory: %s (%s)", sUnityDir, XSTRERR);
+        return XFALSE;
+    }
+
+    char sUnityPath[XPATH_MAX];
+    sUnityPath[0] = XSTR_NUL;
+    if (!pCtx->bReport && realpath(sUnityDir, sUnityPath) == NULL)
+    {
+        xloge("Failed to resolve directory: %s (%s)", sUnityDir, XSTRERR);
+        return XFALSE;
+    }
+
+    const SMakeDir *pUnityDir = SMake_DirIntern(pCtx, sUnityDir);
+    smake_unity_src_t *pSources = (smake_unity_src_t*)calloc(nObjs, sizeof(smake_unity_src_t));
+    SMakeFile **pObjects = (SMakeFile**)calloc(nObjs, sizeof(SMakeFile*));
+
+    if (pUnityDir == NULL || pSources == NULL || pObjects == NULL)
+    {
+        xloge("Failed to allocate memory for unity build: %s", XSTRERR);
+        free(pSources);
+        free(pObjects);
+        return XFALSE;
+    }
+
+    smake_list_t names;
+    SMake_ListInit(&names);
+
+    size_t i, nCount = 0, nKept = 0;
+    xbool_t bStatus = SMake_UnityCollect(pCtx, pSources, &nCount, pObjects, &nKept);
+    qsort(pSources, nCount, sizeof(smake_unity_src_t), SMake_UnityCompare);
+    size_t nStart = 0, nBatches = 0;
+
+    for (i = 0; i < nCount && bStatus; i++)
+    {
+        size_t nMembers = i + 1 - nStart;
+        const smake_unity_src_t *pNext = i + 1 < nCount ? &pSources[i + 1] : NULL;
+        if (!SMake_UnityBoundary(pCtx, &pSources[i], pNext, nMembers)) continue;
+
+        if (nMembers < 2)
+        {
+            /* No point in wrapping a single source */
+            pObjects[nKept++] = pSources[nStart].pObj;
+        }
+        else
+        {
+            SMakeFile *pObj = SMake_UnityBatch(pCtx, pUnityDir, sUnityPath, &pSources[nStart], nMembers, &names);
+            if (pObj != NULL) pObjects[nKept++] = pObj;
+            else bStatus = XFALSE;
+            nBatches++;
+        }
+
+        nStart = i + 1;
+    }
+
+    if (bStatus)
+    {
+        /* Compilation database still lists the sources */
+        for (i = 0; i < nObjs; i++) XArray_AddData(&pCtx->srcObjArr, XArray_GetData(&pCtx->objArr, i), XSTDNON);
+        if (!pCtx->bReport) SMake_UnityRemoveStale(sUnityDir, &names);
+
+        XArray_Clear(&pCtx->objArr);
+        for (i = 0; i < nKept; i++) XArray_AddData(&pCtx->objArr, pObjects[i], XSTDNON);
+
+        if (nBatches) SMake_AddToList(&pCtx->pathArr, "%s", pUnityDir->pPath);
+        xlogd("Unity build: %zu sources in %zu batches", nCount, nBatches);
+    }
+
+    for (i = 0; i < nCount; i++) free(pSources[i].pPath);
+    SMake_ListDestroy(&names);
+    free(pSources);
+    free(pObjects);
+    return bStatus;
+}
@@ -0,0 +1,32 @@
+/*!
+ *  @file smake/src/unity.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Group project sources into unity (jumbo) translation units.
+ */
+
+#ifndef __SMAKE_UNITY_H__
+#define __SMAKE_UNITY_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+/* Reserved directory name, never scanned as part of the project */
+#define SMAKE_UNITY_DIR ".smake-unity"
+
+/* Batch is cut at this many times the configured size without a cut point */
+#define SMAKE_UNITY_MAX 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_UnityBuild(smake_ctx_t *pCtx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_UNITY_H__ */
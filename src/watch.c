@@ -0,0 +1,488 @@
+/*!
+ *  @file smake/src/watch.c
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Keep the generated build files in sync with the project tree.
+ *
+ * Every scanned directory is watched with inotify. Events are collected
+ * until the tree is quiet and then compared with the project of the last
+ * run: build files are generated again only if a source or header was
+ * added or removed, or a written source gained or lost main(). The next
+ * run reuses the scan cache of the previous one from memory. Arguments
+ * and config are parsed again only when the config file changes, the
+ * results of library searches, pkg-config and tool probing are kept.
+ */
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "stdinc.h"
+#include "watch.h"
+#include "cfg.h"
+#include "compdb.h"
+#include "entry.h"
+#include "pch.h"
+#include "unity.h"
+
+#define SMAKE_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                          IN_CLOSE_WRITE | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+#define SMAKE_WATCH_DIR_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#define SMAKE_WATCH_BUFFER 65536
+
+typedef struct SMakeWatch {
+    smake_ctx_t *pCtx;
+    smake_list_t files;         /* Sources and headers of the last run */
+    smake_list_t dirtyFiles;
+    smake_list_t dirtyDirs;
+    smake_list_t eventDirs;     /* Directories that reported an event */
+    char **pPaths;              /* Watched directories by descriptor */
+    size_t nPaths;
+    xbool_t bOverflow;
+    struct stat cfgStat;        /* Config file after the last parse or write */
+    xbool_t bCfgStat;
+    char **argv;
+    int argc;
+    int nFd;
+} smake_watch_t;
+
+static uint64_t SMake_WatchTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static void SMake_WatchConfigStat(smake_watch_t *pWatch, struct stat *pStat, xbool_t *pExists)
+{
+    /* Config may be created after the start, default file is checked then */
+    const char *pPath = xstrused(pWatch->pCtx->sConfig) ? pWatch->pCtx->sConfig : SMAKE_CFG_FILE;
+    *pExists = stat(pPath, pStat) >= 0 ? XTRUE : XFALSE;
+}
+
+static xbool_t SMake_WatchConfigChanged(smake_watch_t *pWatch)
+{
+    struct stat cfgStat;
+    xbool_t bExists;
+
+    SMake_WatchConfigStat(pWatch, &cfgStat, &bExists);
+    if (bExists != pWatch->bCfgStat) return XTRUE;
+    if (!bExists) return XFALSE;
+
+    /* Editors often write a new file and rename it over the old one */
+    return (cfgStat.st_ino != pWatch->cfgStat.st_ino ||
+            cfgStat.st_size != pWatch->cfgStat.st_size ||
+            cfgStat.st_mtim.tv_sec != pWatch->cfgStat.st_mtim.tv_sec ||
+            cfgStat.st_mtim.tv_nsec != pWatch->cfgStat.st_mtim.tv_nsec) ? XTRUE : XFALSE;
+}
+
+static void SMake_WatchAddDir(smake_watch_t *pWatch, const char *pPath)
+{
+    int nWd = inotify_add_watch(pWatch->nFd, pPath, SMAKE_WATCH_MASK);
+    if (nWd < 0)
+    {
+        xlogw("Failed to watch directory: %s (%s)", pPath, XSTRERR);
+        return;
+    }
+
+    if ((size_t)nWd >= pWatch->nPaths)
+    {
+        size_t nSize = (size_t)nWd * 2 + 1;
+        char **pPaths = (char**)realloc(pWatch->pPaths, nSize * sizeof(char*));
+
+        if (pPaths == NULL)
+        {
+            xloge("Failed to allocate memory for watch: %s", pPath);
+            inotify_rm_watch(pWatch->nFd, nWd);
+            return;
+        }
+
+        memset(&pPaths[pWatch->nPaths], 0, (nSize - pWatch->nPaths) * sizeof(char*));
+        pWatch->pPaths = pPaths;
+        pWatch->nPaths = nSize;
+    }
+
+    /* Renamed directory keeps its descriptor, events come with the new path */
+    if (pWatch->pPaths[nWd] != NULL && !strcmp(pWatch->pPaths[nWd], pPath)) return;
+    free(pWatch->pPaths[nWd]);
+
+    pWatch->pPaths[nWd] = strdup(pPath);
+    if (pWatch->pPaths[nWd] == NULL) xloge("Failed to allocate memory for watch: %s", pPath);
+    else xlogd("Watching directory: %s", pPath);
+}
+
+static size_t SMake_WatchCount(smake_watch_t *pWatch)
+{
+    size_t i, nCount = 0;
+    for (i = 0; i < pWatch->nPaths; i++)
+        if (pWatch->pPaths[i] != NULL) nCount++;
+
+    return nCount;
+}
+
+static void SMake_WatchModel(smake_watch_t *pWatch)
+{
+    smake_ctx_t *pCtx = pWatch->pCtx;
+    size_t i, nFiles = XArray_Used(&pCtx->fileArr);
+    SMake_ListClear(&pWatch->files);
+
+    for (i = 0; i < nFiles; i++)
+    {
+        SMakeFile *pFile = (SMakeFile*)XArray_GetData(&pCtx->fileArr, i);
+        if (pFile != NULL) SMake_AddToList(&pWatch->files, "%s/%s", pFile->pDir->pPath, pFile->pName);
+    }
+
+    /* Sources listed in the config are not scanned, their own directories are watched */
+    if (pCtx->bSrcFromCfg)
+    {
+        for (i = 0; i < nFiles; i++)
+        {
+            SMakeFile *pFile = (SMakeFile*)XArray_GetData(&pCtx->fileArr, i);
+            if (pFile != NULL) SMake_AddToList(&pCtx->watchDirs, "%s", pFile->pDir->pPath);
+        }
+    }
+
+    size_t nDirs = XArray_Used(&pCtx->watchDirs.array);
+    for (i = 0; i < nDirs; i++)
+    {
+        const char *pDir = (const char*)XArray_GetData(&pCtx->watchDirs.array, i);
+        if (pDir != NULL) SMake_WatchAddDir(pWatch, pDir);
+    }
+}
+
+static xbool_t SMake_WatchIgnored(const char *pName, xbool_t bIsDir)
+{
+    /* Generated files in the output directory are not part of the project */
+    if (bIsDir) return !strcmp(pName, SMAKE_UNITY_DIR) ? XTRUE : XFALSE;
+    return !strcmp(pName, SMAKE_PCH_FILE) ? XTRUE : XFALSE;
+}
+
+static int SMake_WatchRead(smake_watch_t *pWatch)
+{
+    char sBuffer[SMAKE_WATCH_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int nEvents = 0;
+
+    for (;;)
+    {
+        ssize_t nLength = read(pWatch->nFd, sBuffer, sizeof(sBuffer));
+        if (nLength <= 0) return (nLength < 0 && errno != EAGAIN && errno != EINTR) ? XSTDERR : nEvents;
+
+        char *pData = sBuffer;
+        while (pData < sBuffer + nLength)
+        {
+            const struct inotify_event *pEvent = (const struct inotify_event*)pData;
+            pData += sizeof(struct inotify_event) + pEvent->len;
+            nEvents++;
+
+            if (pEvent->mask & IN_Q_OVERFLOW)
+            {
+                pWatch->bOverflow = XTRUE;
+                continue;
+            }
+
+            if (pEvent->wd < 0 || (size_t)pEvent->wd >= pWatch->nPaths) continue;
+            const char *pDir = pWatch->pPaths[pEvent->wd];
+
+            if (pEvent->mask & IN_IGNORED)
+            {
+                /* Directory was removed, its parent reports the files that are gone */
+                free(pWatch->pPaths[pEvent->wd]);
+                pWatch->pPaths[pEvent->wd] = NULL;
+                continue;
+            }
+
+            if (pDir == NULL || !pEvent->len || !pEvent->name[0]) continue;
+            xbool_t bIsDir = (pEvent->mask & IN_ISDIR) ? XTRUE : XFALSE;
+            if (SMake_WatchIgnored(pEvent->name, bIsDir)) continue;
+            SMake_AddToList(&pWatch->eventDirs, "%s", pDir);
+
+            if (bIsDir)
+            {
+                if (pEvent->mask & SMAKE_WATCH_DIR_EVENTS)
+                    SMake_AddToList(&pWatch->dirtyDirs, "%s/%s", pDir, pEvent->name);
+                continue;
+            }
+
+            char *pPath = xstracpy("%s/%s", pDir, pEvent->name);
+            if (pPath == NULL) continue;
+
+            /* Only sources and headers make a difference to the build files */
+            int nType = SMake_GetFileType(pPath, (int)strlen(pPath));
+            if (nType != SMAKE_FILE_UNF) SMake_AddToList(&pWatch->dirtyFiles, "%s", pPath);
+            free(pPath);
+        }
+    }
+}
+
+static xbool_t SMake_WatchWalk(smake_watch_t *pWatch, const char *pPath)
+{
+    smake_ctx_t *pCtx = pWatch->pCtx;
+    xbool_t bChanged = XFALSE;
+
+    /* Watch is added before reading, files created meanwhile are reported as events */
+    SMake_WatchAddDir(pWatch, pPath);
+
+    xdir_t dir;
+    if (XDir_Open(&dir, pPath) < 0) return XFALSE;
+
+    char sFileName[NAME_MAX + 1];
+    while (XDir_Read(&dir, sFileName, sizeof(sFileName)) > 0)
+    {
+        char *pFullPath = xstracpy("%s/%s", pPath, sFileName);
+        if (pFullPath == NULL) continue;
+
+        int nType = SMake_GetFileType(pFullPath, (int)strlen(pFullPath));
+        xbool_t bIsDir = (int)(dir.pEntry->d_type) == 4 ? XTRUE : XFALSE;
+
+        if ((bIsDir || nType != SMAKE_FILE_UNF) &&
+            !SMake_WatchIgnored(sFileName, bIsDir) &&
+            !SMake_IsExcluded(pCtx, pFullPath))
+        {
+            if (bIsDir && SMake_WatchWalk(pWatch, pFullPath)) bChanged = XTRUE;
+            else if (!bIsDir && !SMake_ListContains(&pWatch->files, pFullPath))
+            {
+                xlogi("New project file: %s", pFullPath);
+                bChanged = XTRUE;
+            }
+        }
+
+        free(pFullPath);
+    }
+
+    XDir_Close(&dir);
+    return bChanged;
+}
+
+static xbool_t SMake_WatchRemoved(smake_watch_t *pWatch, const char *pPath)
+{
+    size_t i, nFiles = XArray_Used(&pWatch->files.array);
+    size_t nLength = strlen(pPath);
+
+    for (i = 0; i < nFiles; i++)
+    {
+        const char *pFile = (const char*)XArray_GetData(&pWatch->files.array, i);
+        if (pFile == NULL || strncmp(pFile, pPath, nLength) || pFile[nLength] != '/') continue;
+
+        if (!XPath_Exists(pFile))
+        {
+            xlogi("Removed project file: %s", pFile);
+            return XTRUE;
+        }
+    }
+
+    return XFALSE;
+}
+
+static xbool_t SMake_WatchChanged(smake_watch_t *pWatch)
+{
+    smake_ctx_t *pCtx = pWatch->pCtx;
+    size_t i, nDirs = XArray_Used(&pWatch->dirtyDirs.array);
+    size_t nFiles = XArray_Used(&pWatch->dirtyFiles.array);
+    xbool_t bChanged = XFALSE;
+
+    if (pWatch->bOverflow)
+    {
+        xlogw("Too many file system events, scanning the project again");
+        return XTRUE;
+    }
+
+    if (SMake_WatchConfigChanged(pWatch))
+    {
+        xlogi("Config file changed: %s", xstrused(pCtx->sConfig) ? pCtx->sConfig : SMAKE_CFG_FILE);
+        return XTRUE;
+    }
+
+    for (i = 0; i < nDirs; i++)
+    {
+        const char *pDir = (const char*)XArray_GetData(&pWatch->dirtyDirs.array, i);
+        if (pDir == NULL || SMake_IsExcluded(pCtx, pDir)) continue;
+
+        struct stat dirStat;
+        if (stat(pDir, &dirStat) >= 0 && S_ISDIR(dirStat.st_mode) && SMake_WatchWalk(pWatch, pDir)) bChanged = XTRUE;
+        if (!bChanged && SMake_WatchRemoved(pWatch, pDir)) bChanged = XTRUE;
+    }
+
+    /* Libraries do not have entry points, their sources are not read for it */
+    xbool_t bMains = strstr(pCtx->sName, ".a") == NULL && strstr(pCtx->sName, ".so") == NULL;
+
+    for (i = 0; i < nFiles && !bChanged; i++)
+    {
+        const char *pFile = (const char*)XArray_GetData(&pWatch->dirtyFiles.array, i);
+        if (pFile == NULL || SMake_IsExcluded(pCtx, pFile)) continue;
+
+        struct stat fileStat;
+        xbool_t bExists = stat(pFile, &fileStat) >= 0 && S_ISREG(fileStat.st_mode);
+        xbool_t bKnown = SMake_ListContains(&pWatch->files, pFile);
+
+        if (bExists != bKnown)
+        {
+            xlogi("%s project file: %s", bExists ? "New" : "Removed", pFile);
+            bChanged = XTRUE;
+            continue;
+        }
+
+        /* Edits inside a source matter only if they add or remove main() */
+        int nType = SMake_GetFileType(pFile, (int)strlen(pFile));
+        if (!bExists || !bMains || (nType != SMAKE_FILE_C && nType != SMAKE_FILE_CPP)) continue;
+
+        xbool_t bMain = SMake_HasMain(pFile);
+        if (bMain != SMake_ListContains(&pCtx->mainFiles, pFile))
+        {
+            xlogi("Main function %s: %s", bMain ? "added" : "removed", pFile);
+            bChanged = XTRUE;
+        }
+    }
+
+    return bChanged;
+}
+
+static xbool_t SMake_WatchGenerate(smake_watch_t *pWatch)
+{
+    uint64_t nStart = SMake_WatchTime();
+    smake_ctx_t *pCtx = pWatch->pCtx;
+    smake_ctx_t *pNext = pCtx;
+    xbool_t bStatus = XTRUE;
+
+    /* Sources listed in the config are loaded by its parser */
+    xbool_t bParse = pCtx->bSrcFromCfg || SMake_WatchConfigChanged(pWatch);
+    if (!bParse) SMake_ResetProject(pCtx);
+    else
+    {
+        pNext = (smake_ctx_t*)malloc(sizeof(smake_ctx_t));
+        if (pNext == NULL)
+        {
+            xloge("Failed to allocate memory for context: %s", XSTRERR);
+            return XFALSE;
+        }
+
+        /* Context is made from the same arguments as the first run */
+        SMake_InitContext(pNext);
+        optind = 1;
+
+        bStatus = SMake_ParseArgs(pNext, pWatch->argc, pWatch->argv) ? XTRUE : XFALSE;
+        bStatus = bStatus && SMake_ParseConfig(pNext);
+    }
+
+    pNext->bRegenerate = XTRUE;
+    pNext->bInitProj = XFALSE;
+
+    /* Directories and sources that did not change are taken from the last run */
+    SMake_CacheDestroy(&pNext->prevCache);
+    pNext->prevCache = pCtx->nextCache;
+    SMake_CacheInit(&pCtx->nextCache);
+
+    /* Change in the same timestamp tick as the last scan keeps the mtime, events are trusted instead */
+    smake_list_t *pLists[] = { &pWatch->eventDirs, &pWatch->dirtyDirs, &pWatch->dirtyFiles };
+    size_t i, j;
+
+    for (i = 0; i < sizeof(pLists) / sizeof(pLists[0]); i++)
+    {
+        for (j = 0; j < XArray_Used(&pLists[i]->array); j++)
+        {
+            const char *pPath = (const char*)XArray_GetData(&pLists[i]->array, j);
+            if (pPath != NULL) SMake_CacheForget(&pNext->prevCache, pPath);
+        }
+    }
+
+    bStatus = bStatus &&
+        SMake_LoadFiles(pNext, NULL) &&
+        SMake_ParseProject(pNext) &&
+        SMake_WriteBuild(pNext) &&
+        SMake_WriteCompDB(pNext) &&
+        SMake_WriteCache(pNext) &&
+        SMake_WriteConfig(pNext);
+
+    /* Failed run is kept as well, the next change is compared with its files */
+    if (pNext != pCtx)
+    {
+        SMake_ClearContext(pCtx);
+        memcpy(pCtx, pNext, sizeof(smake_ctx_t));
+        free(pNext);
+    }
+
+    /* Config written by this run is not a change of the user */
+    SMake_WatchConfigStat(pWatch, &pWatch->cfgStat, &pWatch->bCfgStat);
+    SMake_WatchModel(pWatch);
+    if (!bStatus) return XFALSE;
+
+    xlogn("Regenerated %s in %llu ms.", pCtx->nBackend == SMAKE_BACKEND_NINJA ? "build.ninja" : "Makefile",
+        (unsigned long long)(SMake_WatchTime() - nStart));
+
+    return XTRUE;
+}
+
+xbool_t SMake_Watch(smake_ctx_t *pCtx, int argc, char *argv[])
+{
+    smake_watch_t watch;
+    watch.nFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (watch.nFd < 0)
+    {
+        xloge("Failed to initialize inotify: %s", XSTRERR);
+        return XFALSE;
+    }
+
+    SMake_ListInit(&watch.files);
+    SMake_ListInit(&watch.dirtyFiles);
+    SMake_ListInit(&watch.dirtyDirs);
+    SMake_ListInit(&watch.eventDirs);
+    watch.bOverflow = XFALSE;
+    watch.pPaths = NULL;
+    watch.nPaths = 0;
+    watch.argc = argc;
+    watch.argv = argv;
+    watch.pCtx = pCtx;
+
+    SMake_WatchConfigStat(&watch, &watch.cfgStat, &watch.bCfgStat);
+    SMake_WatchModel(&watch);
+    xlogn("Watching %zu directories for changes, press Ctrl+C to stop.", SMake_WatchCount(&watch));
+
+    struct pollfd pollFd;
+    pollFd.fd = watch.nFd;
+    pollFd.events = POLLIN;
+    xbool_t bStatus = XTRUE;
+
+    for (;;)
+    {
+        if (poll(&pollFd, 1, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            xloge("Failed to wait for file system events: %s", XSTRERR);
+            bStatus = XFALSE;
+            break;
+        }
+
+        /* Editors and checkouts touch many files at once, they are handled together */
+        uint64_t nStart = SMake_WatchTime();
+        int nEvents = SMake_WatchRead(&watch);
+
+        while (nEvents >= 0 && SMake_WatchTime() - nStart < SMAKE_WATCH_WAIT_MS &&
+               poll(&pollFd, 1, SMAKE_WATCH_QUIET_MS) > 0) nEvents = SMake_WatchRead(&watch);
+
+        if (nEvents < 0)
+        {
+            xloge("Failed to read file system events: %s", XSTRERR);
+            bStatus = XFALSE;
+            break;
+        }
+
+        if (SMake_WatchChanged(&watch)) SMake_WatchGenerate(&watch);
+        SMake_ListClear(&watch.dirtyFiles);
+        SMake_ListClear(&watch.dirtyDirs);
+        SMake_ListClear(&watch.eventDirs);
+        watch.bOverflow = XFALSE;
+    }
+
+    size_t i;
+    for (i = 0; i < watch.nPaths; i++) free(watch.pPaths[i]);
+    free(watch.pPaths);
+
+    SMake_ListDestroy(&watch.files);
+    SMake_ListDestroy(&watch.dirtyFiles);
+    SMake_ListDestroy(&watch.dirtyDirs);
+    SMake_ListDestroy(&watch.eventDirs);
+    close(watch.nFd);
+    return bStatus;
+}
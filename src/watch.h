@@ -0,0 +1,32 @@
+/*!
+ *  @file smake/src/watch.h
+ *
+ *  This source is part of "smake" project
+ *  2020-2023  Sun Dro (s.kalatoz@gmail.com)
+ * 
+ * @brief Keep the generated build files in sync with the project tree.
+ */
+
+#ifndef __SMAKE_WATCH_H__
+#define __SMAKE_WATCH_H__
+
+#include "stdinc.h"
+#include "make.h"
+
+/* Events closer than this are handled together */
+#define SMAKE_WATCH_QUIET_MS    20
+
+/* Upper bound of the coalescing window while events keep coming */
+#define SMAKE_WATCH_WAIT_MS     500
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+xbool_t SMake_Watch(smake_ctx_t *pCtx, int argc, char *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMAKE_WATCH_H__ */